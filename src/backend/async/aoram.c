@@ -0,0 +1,480 @@
+/*-------------------------------------------------------------------------
+ *
+ * aoram.c
+ *		  Asynchronous front-end of an ORAM state.
+ *
+ * Client threads push their requests to an intrusive multi-producer
+ * single-consumer queue (Vyukov's algorithm): a producer only swaps the head
+ * of the queue and links the previous head to its request, so submitting
+ * never blocks on the worker or on other producers. A single worker thread
+ * per state pops the requests and is the only thread that accesses the ORAM
+ * state.
+ *
+ * The worker pops up to AORAM_MAX_PASS requests at a time and serves them in
+ * one pass. Every request is an ORAM access of its own, even if an earlier
+ * request of the pass targets the same block, and the consecutive requests of
+ * the same kind go through read_oram_batch or write_oram_batch so that they
+ * share the paths they fetch. Clients are notified at the end of the pass.
+ *
+ * Like the ORAM engines, the only errors handled are out of memory errors,
+ * in which case the execution is aborted.
+ *
+ * Copyright (c) 2018-2020, HASLab
+ *
+ * IDENTIFICATION
+ *		  backend/async/aoram.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "oram/aoram.h"
+#include "oram/logger.h"
+
+/*
+ * Maximum number of requests served by the worker in a single pass, which
+ * bounds the size of the batches given to the ORAM state.
+ */
+#ifndef AORAM_MAX_PASS
+#define AORAM_MAX_PASS 64
+#endif
+
+typedef enum AORAMOperation
+{
+	AORAM_READ,
+	AORAM_WRITE
+} AORAMOperation;
+
+struct AORAMRequest
+{
+	_Atomic(struct AORAMRequest *) next;
+	AORAMState	astate;
+	AORAMOperation op;
+	BlockNumber blkno;
+	char	   *data;
+	/* Block to write or block read */
+	unsigned int blksize;
+	/* Size of the block to write */
+	int			result;
+	/* Result of read_oram or write_oram */
+	atomic_int	done;
+};
+
+struct AORAMState
+{
+	ORAMState	state;
+	void	   *appData;
+
+	_Atomic(AORAMRequest) head;
+	/* Last request pushed by the producers */
+	AORAMRequest tail;
+	/* Next request to be popped, only accessed by the worker */
+	struct AORAMRequest stub;
+	/* Empty node that keeps the queue non-empty */
+
+	atomic_int	sleeping;
+	atomic_int	stop;
+	pthread_t	worker;
+	pthread_mutex_t lock;
+	pthread_cond_t wakeup;
+	/* Signaled when the worker sleeps and a request is pushed */
+	pthread_cond_t served;
+	/* Broadcast at the end of every pass */
+
+	AORAMRequest pass[AORAM_MAX_PASS];
+	BlockNumber blknos[AORAM_MAX_PASS];
+	char	   *data[AORAM_MAX_PASS];
+	unsigned int blksizes[AORAM_MAX_PASS];
+	int			results[AORAM_MAX_PASS];
+	/* Arguments of the batches of a pass */
+};
+
+
+/* non-export function prototypes */
+static void *workerMain(void *arg);
+
+static AORAMRequest createRequest(AORAMState astate, AORAMOperation op, BlockNumber blkno);
+
+static void pushRequest(AORAMState astate, AORAMRequest request);
+
+static AORAMRequest popRequest(AORAMState astate);
+
+static unsigned int queueEmpty(AORAMState astate);
+
+static void waitForRequests(AORAMState astate);
+
+static void servePass(AORAMState astate, unsigned int npass);
+
+static unsigned int serveBatch(AORAMState astate, unsigned int first, unsigned int npass);
+
+static char *copyBlock(const char *data, int size);
+
+
+AORAMState
+init_aoram(ORAMState state, void *appData)
+{
+	AORAMState	astate;
+	int			save_errno = errno;
+
+	errno = 0;
+	astate = (AORAMState) malloc(sizeof(struct AORAMState));
+
+	if (astate == NULL && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory init_aoram");
+		errno = save_errno;
+		abort();
+	}
+	errno = save_errno;
+
+	astate->state = state;
+	astate->appData = appData;
+	atomic_init(&astate->stub.next, NULL);
+	atomic_init(&astate->head, &astate->stub);
+	astate->tail = &astate->stub;
+	atomic_init(&astate->sleeping, 0);
+	atomic_init(&astate->stop, 0);
+
+	pthread_mutex_init(&astate->lock, NULL);
+	pthread_cond_init(&astate->wakeup, NULL);
+	pthread_cond_init(&astate->served, NULL);
+
+	if (pthread_create(&astate->worker, NULL, workerMain, astate) != 0)
+	{
+		logger(DEBUG, "Could not start the worker thread of init_aoram");
+		abort();
+	}
+
+	return astate;
+}
+
+AORAMRequest
+createRequest(AORAMState astate, AORAMOperation op, BlockNumber blkno)
+{
+	AORAMRequest request;
+	int			save_errno = errno;
+
+	errno = 0;
+	request = (AORAMRequest) malloc(sizeof(struct AORAMRequest));
+
+	if (request == NULL && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory creating asynchronous request");
+		errno = save_errno;
+		abort();
+	}
+	errno = save_errno;
+
+	request->astate = astate;
+	request->op = op;
+	request->blkno = blkno;
+	request->data = NULL;
+	request->blksize = 0;
+	request->result = DUMMY_BLOCK;
+	atomic_init(&request->done, 0);
+
+	return request;
+}
+
+/*
+ * Appends request to the queue and wakes the worker if it is sleeping.
+ */
+void
+pushRequest(AORAMState astate, AORAMRequest request)
+{
+	AORAMRequest prev;
+
+	atomic_store_explicit(&request->next, NULL, memory_order_relaxed);
+	prev = atomic_exchange(&astate->head, request);
+	atomic_store_explicit(&prev->next, request, memory_order_release);
+
+	/* The worker pushes the stub node and is never asleep when it does */
+	if (request != &astate->stub && atomic_load(&astate->sleeping))
+	{
+		pthread_mutex_lock(&astate->lock);
+		atomic_store(&astate->sleeping, 0);
+		pthread_cond_signal(&astate->wakeup);
+		pthread_mutex_unlock(&astate->lock);
+	}
+}
+
+/*
+ * Returns the oldest request of the queue or NULL if it is empty or if a
+ * producer has not linked its request yet.
+ */
+AORAMRequest
+popRequest(AORAMState astate)
+{
+	AORAMRequest tail = astate->tail;
+	AORAMRequest next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+	if (tail == &astate->stub)
+	{
+		if (next == NULL)
+			return NULL;
+
+		astate->tail = next;
+		tail = next;
+		next = atomic_load_explicit(&next->next, memory_order_acquire);
+	}
+
+	if (next != NULL)
+	{
+		astate->tail = next;
+		return tail;
+	}
+
+	if (tail != atomic_load(&astate->head))
+		return NULL;
+
+	pushRequest(astate, &astate->stub);
+	next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+	if (next != NULL)
+	{
+		astate->tail = next;
+		return tail;
+	}
+
+	return NULL;
+}
+
+unsigned int
+queueEmpty(AORAMState astate)
+{
+	return astate->tail == &astate->stub
+		&& atomic_load(&astate->head) == &astate->stub;
+}
+
+/*
+ * Sleeps until a request is pushed or close_aoram is called. The flag is set
+ * before checking the queue, so a producer either sees it and signals the
+ * worker or pushes its request before the check.
+ */
+void
+waitForRequests(AORAMState astate)
+{
+	pthread_mutex_lock(&astate->lock);
+	atomic_store(&astate->sleeping, 1);
+
+	while (atomic_load(&astate->sleeping) && queueEmpty(astate)
+		   && !atomic_load(&astate->stop))
+	{
+		pthread_cond_wait(&astate->wakeup, &astate->lock);
+	}
+
+	atomic_store(&astate->sleeping, 0);
+	pthread_mutex_unlock(&astate->lock);
+}
+
+char *
+copyBlock(const char *data, int size)
+{
+	char	   *copy;
+	int			save_errno = errno;
+
+	if (data == NULL || size == DUMMY_BLOCK)
+		return NULL;
+
+	errno = 0;
+	copy = (char *) malloc(size);
+
+	if (copy == NULL && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory copying block %d", size);
+		errno = save_errno;
+		abort();
+	}
+	errno = save_errno;
+
+	memcpy(copy, data, size);
+	return copy;
+}
+
+/*
+ * Serves the requests of the pass from first on that have the same kind as
+ * the first one in a single batch and returns how many were served.
+ */
+unsigned int
+serveBatch(AORAMState astate, unsigned int first, unsigned int npass)
+{
+	unsigned int index;
+	unsigned int nbatch;
+	AORAMOperation op = astate->pass[first]->op;
+	AORAMRequest request;
+
+	for (nbatch = 0; first + nbatch < npass; nbatch++)
+	{
+		request = astate->pass[first + nbatch];
+		if (request->op != op)
+			break;
+
+		astate->blknos[nbatch] = request->blkno;
+		astate->data[nbatch] = request->data;
+		astate->blksizes[nbatch] = request->blksize;
+	}
+
+	if (op == AORAM_READ)
+	{
+		read_oram_batch(astate->data, astate->results, astate->blknos, nbatch,
+                        astate->state, astate->appData);
+	}
+	else
+	{
+		write_oram_batch(astate->data, astate->blksizes, astate->results,
+                         astate->blknos, nbatch, astate->state, astate->appData);
+	}
+
+	for (index = 0; index < nbatch; index++)
+	{
+		request = astate->pass[first + index];
+		request->result = astate->results[index];
+		if (op == AORAM_READ)
+		{
+			request->data = astate->data[index];
+		}
+	}
+
+	return nbatch;
+}
+
+/*
+ * Serves the requests of the pass in order, as batches of consecutive
+ * requests of the same kind.
+ */
+void
+servePass(AORAMState astate, unsigned int npass)
+{
+	unsigned int index;
+
+	for (index = 0; index < npass;)
+	{
+		index += serveBatch(astate, index, npass);
+	}
+
+	for (index = 0; index < npass; index++)
+	{
+		atomic_store_explicit(&astate->pass[index]->done, 1, memory_order_release);
+	}
+
+	pthread_mutex_lock(&astate->lock);
+	pthread_cond_broadcast(&astate->served);
+	pthread_mutex_unlock(&astate->lock);
+}
+
+void *
+workerMain(void *arg)
+{
+	AORAMState	astate = (AORAMState) arg;
+	AORAMRequest request;
+	unsigned int npass;
+
+	for (;;)
+	{
+		npass = 0;
+		while (npass < AORAM_MAX_PASS && (request = popRequest(astate)) != NULL)
+		{
+			astate->pass[npass++] = request;
+		}
+
+		if (npass > 0)
+		{
+			servePass(astate, npass);
+		}
+		else if (!queueEmpty(astate))
+		{
+			/* A producer is linking its request */
+			sched_yield();
+		}
+		else if (atomic_load(&astate->stop))
+		{
+			break;
+		}
+		else
+		{
+			waitForRequests(astate);
+		}
+	}
+
+	return NULL;
+}
+
+AORAMRequest
+submit_read_aoram(AORAMState astate, BlockNumber blkno)
+{
+	AORAMRequest request = createRequest(astate, AORAM_READ, blkno);
+
+	pushRequest(astate, request);
+	return request;
+}
+
+AORAMRequest
+submit_write_aoram(AORAMState astate, char *data, unsigned int blksize, BlockNumber blkno)
+{
+	AORAMRequest request = createRequest(astate, AORAM_WRITE, blkno);
+
+	request->data = copyBlock(data, blksize);
+	request->blksize = blksize;
+
+	pushRequest(astate, request);
+	return request;
+}
+
+int
+poll_aoram(AORAMRequest request)
+{
+	return atomic_load_explicit(&request->done, memory_order_acquire);
+}
+
+int
+wait_aoram(AORAMRequest request, char **ptr)
+{
+	AORAMState	astate = request->astate;
+	int			result;
+
+	if (!poll_aoram(request))
+	{
+		pthread_mutex_lock(&astate->lock);
+		while (!poll_aoram(request))
+		{
+			pthread_cond_wait(&astate->served, &astate->lock);
+		}
+		pthread_mutex_unlock(&astate->lock);
+	}
+
+	result = request->result;
+
+	if (request->op == AORAM_READ && ptr != NULL)
+	{
+		*ptr = request->data;
+	}
+	else
+	{
+		free(request->data);
+	}
+	free(request);
+
+	return result;
+}
+
+void
+close_aoram(AORAMState astate)
+{
+	pthread_mutex_lock(&astate->lock);
+	atomic_store(&astate->stop, 1);
+	pthread_cond_signal(&astate->wakeup);
+	pthread_mutex_unlock(&astate->lock);
+
+	pthread_join(astate->worker, NULL);
+
+	pthread_cond_destroy(&astate->served);
+	pthread_cond_destroy(&astate->wakeup);
+	pthread_mutex_destroy(&astate->lock);
+	free(astate);
+}
@@ -21,6 +21,22 @@
 
 PLBlock		dummyBlock = NULL;
 
+struct BlockPool
+{
+	unsigned int blockSize;
+	/* Number of blocks owned by the pool */
+	unsigned int nblocks;
+	/* Number of blocks available in freeList */
+	unsigned int nfree;
+	unsigned int nchunks;
+	/* Stack of available blocks */
+	PLBList		freeList;
+	/* Memory regions allocated by the pool */
+	void	  **chunks;
+};
+
+static void growBlockPool(BlockPool pool, unsigned int nblocks);
+
 /* Assumes that the block already comes allocated from the client. */
 PLBlock
 createBlock(int blkno, int size, void *data)
@@ -69,6 +85,7 @@ createEmptyBlock(void)
 	block->blkno = DUMMY_BLOCK;
 	block->size = -1;
 	block->block = NULL;
+	block->pool = NULL;
     memset(block->location, 0, sizeof(unsigned int)*2);
 	errno = save_errno;
 	return block;
@@ -127,10 +144,205 @@ setLocation(PLBlock block, Location location, unsigned int size){
 void
 freeBlock(PLBlock block)
 {
+	BlockPool	pool = block->pool;
+
+	if (pool != NULL)
+	{
+		pool->freeList[pool->nfree] = block;
+		pool->nfree++;
+		return;
+	}
     free(block->block);
 	free(block);
 }
 
+
+/*
+ * Takes the payload buffer out of block so that an oblivious file following
+ * the malloc contract of ofileread allocates a new one.
+ */
+void *
+detachPayload(PLBlock block)
+{
+	void	   *payload = block->block;
+
+	block->block = NULL;
+	return payload;
+}
+
+/*
+ * Gives back to block the buffer taken by detachPayload, moving to it and
+ * releasing the payload allocated by the oblivious file, if any.
+ */
+void
+attachPayload(PLBlock block, void *payload)
+{
+	if (block->block != NULL && block->block != payload)
+	{
+		if (block->size > 0)
+		{
+			memcpy(payload, block->block, block->size);
+		}
+		free(block->block);
+	}
+	block->block = payload;
+}
+
+
+/*
+ * Aborts unless block comes from pool or was individually allocated by the
+ * constructors, e.g., a PLBlock allocated by the application.
+ */
+void
+checkBlock(PLBlock block, BlockPool pool)
+{
+	if (block->pool != NULL && block->pool != pool)
+	{
+		logger(DEBUG, "Block %d was not created by createBlock or the ORAM block pool\n",
+               block->blkno);
+		abort();
+	}
+}
+
+
+BlockPool
+createBlockPool(unsigned int nblocks, unsigned int blockSize)
+{
+	int			save_errno = 0;
+	BlockPool	pool = NULL;
+
+	save_errno = errno;
+	errno = 0;
+
+	pool = (BlockPool) malloc(sizeof(struct BlockPool));
+
+	if (pool == NULL && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory createBlockPool");
+		errno = save_errno;
+		abort();
+	}
+	errno = save_errno;
+
+	pool->blockSize = blockSize;
+	pool->nblocks = 0;
+	pool->nfree = 0;
+	pool->nchunks = 0;
+	pool->freeList = NULL;
+	pool->chunks = NULL;
+
+	growBlockPool(pool, nblocks > 0 ? nblocks : 1);
+
+	return pool;
+}
+
+/*
+ * Adds nblocks to the pool. The headers and the payloads of the new blocks
+ * are carved from a single allocation.
+ */
+void
+growBlockPool(BlockPool pool, unsigned int nblocks)
+{
+	int			save_errno = 0;
+	unsigned int offset;
+	char	   *chunk;
+	char	   *payloads;
+	PLBlock		headers;
+
+	save_errno = errno;
+	errno = 0;
+
+	chunk = (char *) malloc(nblocks * (sizeof(struct PLBlock) + pool->blockSize));
+	pool->freeList = (PLBList) realloc(pool->freeList,
+                                       sizeof(PLBlock) * (pool->nblocks + nblocks));
+	pool->chunks = (void **) realloc(pool->chunks,
+                                     sizeof(void *) * (pool->nchunks + 1));
+
+	if ((chunk == NULL || pool->freeList == NULL || pool->chunks == NULL)
+        && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory growBlockPool");
+		errno = save_errno;
+		abort();
+	}
+	errno = save_errno;
+
+	headers = (PLBlock) chunk;
+	payloads = chunk + nblocks * sizeof(struct PLBlock);
+
+	for (offset = 0; offset < nblocks; offset++)
+	{
+		headers[offset].blkno = DUMMY_BLOCK;
+		headers[offset].size = -1;
+		headers[offset].location[0] = 0;
+		headers[offset].location[1] = 0;
+		headers[offset].block = payloads + offset * pool->blockSize;
+		headers[offset].pool = pool;
+		pool->freeList[pool->nfree + offset] = &headers[offset];
+	}
+
+	pool->chunks[pool->nchunks] = chunk;
+	pool->nchunks++;
+	pool->nblocks += nblocks;
+	pool->nfree += nblocks;
+}
+
+PLBlock
+createEmptyPooledBlock(BlockPool pool)
+{
+	PLBlock		block;
+
+	if (pool->nfree == 0)
+	{
+		/* Double the pool size to amortize the cost of growing. */
+		growBlockPool(pool, pool->nblocks);
+	}
+
+	pool->nfree--;
+	block = pool->freeList[pool->nfree];
+
+	block->blkno = DUMMY_BLOCK;
+	block->size = -1;
+	block->location[0] = 0;
+	block->location[1] = 0;
+
+	return block;
+}
+
+PLBlock
+createPooledBlock(BlockPool pool, int blkno, int size, void *data)
+{
+	PLBlock		block;
+
+	if (size > pool->blockSize)
+	{
+		logger(DEBUG, "Block of size %d does not fit pool blocks of size %d\n",
+               size, pool->blockSize);
+		abort();
+	}
+
+	block = createEmptyPooledBlock(pool);
+	block->blkno = blkno;
+	block->size = size;
+	memcpy(block->block, data, size);
+
+	return block;
+}
+
+void
+freeBlockPool(BlockPool pool)
+{
+	unsigned int index;
+
+	for (index = 0; index < pool->nchunks; index++)
+	{
+		free(pool->chunks[index]);
+	}
+	free(pool->chunks);
+	free(pool->freeList);
+	free(pool);
+}
+
 void 
 freeDummyBlock(){
     if(dummyBlock != NULL){
@@ -0,0 +1,412 @@
+/*-------------------------------------------------------------------------
+ *
+ * aes.c
+ *      AES-128 block encryption, CTR mode and CBC-MAC.
+ *
+ * On x86 processors with AES-NI, blocks are encrypted with the AES
+ * instructions and CTR mode keeps AESNI_PIPELINE blocks in flight, so that
+ * the latency of each round is hidden behind the rounds of the other blocks.
+ * Otherwise, a portable byte-oriented implementation is used. It is slower
+ * and is not hardened against cache-timing attacks, as it looks up the
+ * S-box with secret indexes.
+ *
+ * The key schedule is computed in software for both implementations, as it
+ * only runs when a key is set.
+ *
+ * Copyright (c) 2018-2020, HASLab
+ *
+ * IDENTIFICATION
+ *        backend/crypto/aes.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "oram/aes.h"
+
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define HAVE_AESNI 1
+#include <wmmintrin.h>
+#include <emmintrin.h>
+#endif
+
+/* Number of blocks encrypted in parallel by the AES-NI CTR mode */
+#define AESNI_PIPELINE 8
+
+static const uint8_t sbox[256] = {
+	0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+	0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+	0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+	0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+	0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+	0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+	0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+	0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+	0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+	0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+	0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+	0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+	0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+	0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+	0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+	0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static const uint8_t rcon[AES_ROUNDS] = {
+	0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36
+};
+
+
+static void encryptBlockPortable(const AESKey *key, const uint8_t *in, uint8_t *out);
+
+static void encryptBlocksPortable(const AESKey *key, const uint8_t *in, uint8_t *out,
+                                  size_t nblocks);
+
+static void ctrPortable(const AESKey *key, uint64_t nonce, uint64_t counter,
+                        uint8_t *data, size_t len);
+
+static void cbcMacPortable(const AESKey *key, uint8_t *mac, const uint8_t *data,
+                           size_t nblocks);
+
+static int	hasAESNI(void);
+
+
+void
+aesSetKey(AESKey *key, const uint8_t raw[AES_KEY_SIZE])
+{
+	uint8_t    *words = &key->roundKeys[0][0];
+	uint8_t		temp[4];
+	uint8_t		aux;
+	int			index;
+
+	memcpy(words, raw, AES_KEY_SIZE);
+
+	for (index = 4; index < 4 * (AES_ROUNDS + 1); index++)
+	{
+		memcpy(temp, words + 4 * (index - 1), 4);
+
+		if (index % 4 == 0)
+		{
+			/* RotWord, SubWord and the round constant */
+			aux = temp[0];
+			temp[0] = sbox[temp[1]] ^ rcon[index / 4 - 1];
+			temp[1] = sbox[temp[2]];
+			temp[2] = sbox[temp[3]];
+			temp[3] = sbox[aux];
+		}
+
+		words[4 * index] = words[4 * (index - 4)] ^ temp[0];
+		words[4 * index + 1] = words[4 * (index - 4) + 1] ^ temp[1];
+		words[4 * index + 2] = words[4 * (index - 4) + 2] ^ temp[2];
+		words[4 * index + 3] = words[4 * (index - 4) + 3] ^ temp[3];
+	}
+}
+
+static inline uint8_t
+xtime(uint8_t value)
+{
+	return (uint8_t) ((value << 1) ^ ((value >> 7) * 0x1b));
+}
+
+void
+encryptBlockPortable(const AESKey *key, const uint8_t *in, uint8_t *out)
+{
+	uint8_t		state[AES_BLOCK_SIZE];
+	uint8_t		shifted[AES_BLOCK_SIZE];
+	uint8_t		a0, a1, a2, a3, all;
+	int			round;
+	int			index;
+	int			column;
+
+	for (index = 0; index < AES_BLOCK_SIZE; index++)
+	{
+		state[index] = in[index] ^ key->roundKeys[0][index];
+	}
+
+	for (round = 1; round <= AES_ROUNDS; round++)
+	{
+		/* SubBytes and ShiftRows, the state is stored column by column */
+		for (index = 0; index < AES_BLOCK_SIZE; index++)
+		{
+			shifted[index] = sbox[state[(index + 4 * (index % 4)) % AES_BLOCK_SIZE]];
+		}
+
+		if (round < AES_ROUNDS)
+		{
+			for (column = 0; column < 4; column++)
+			{
+				a0 = shifted[4 * column];
+				a1 = shifted[4 * column + 1];
+				a2 = shifted[4 * column + 2];
+				a3 = shifted[4 * column + 3];
+				all = a0 ^ a1 ^ a2 ^ a3;
+
+				shifted[4 * column] = a0 ^ all ^ xtime(a0 ^ a1);
+				shifted[4 * column + 1] = a1 ^ all ^ xtime(a1 ^ a2);
+				shifted[4 * column + 2] = a2 ^ all ^ xtime(a2 ^ a3);
+				shifted[4 * column + 3] = a3 ^ all ^ xtime(a3 ^ a0);
+			}
+		}
+
+		for (index = 0; index < AES_BLOCK_SIZE; index++)
+		{
+			state[index] = shifted[index] ^ key->roundKeys[round][index];
+		}
+	}
+
+	memcpy(out, state, AES_BLOCK_SIZE);
+}
+
+void
+encryptBlocksPortable(const AESKey *key, const uint8_t *in, uint8_t *out,
+                      size_t nblocks)
+{
+	size_t		index;
+
+	for (index = 0; index < nblocks; index++)
+	{
+		encryptBlockPortable(key, in + index * AES_BLOCK_SIZE,
+                             out + index * AES_BLOCK_SIZE);
+	}
+}
+
+static inline void
+counterBlock(uint8_t *block, uint64_t nonce, uint64_t counter)
+{
+	int			index;
+
+	for (index = 0; index < 8; index++)
+	{
+		block[index] = (uint8_t) (nonce >> (8 * index));
+		block[8 + index] = (uint8_t) (counter >> (8 * index));
+	}
+}
+
+void
+ctrPortable(const AESKey *key, uint64_t nonce, uint64_t counter,
+            uint8_t *data, size_t len)
+{
+	uint8_t		keystream[AES_BLOCK_SIZE];
+	size_t		offset;
+	size_t		index;
+	size_t		chunk;
+
+	for (offset = 0; offset < len; offset += AES_BLOCK_SIZE)
+	{
+		counterBlock(keystream, nonce, counter++);
+		encryptBlockPortable(key, keystream, keystream);
+
+		chunk = len - offset < AES_BLOCK_SIZE ? len - offset : AES_BLOCK_SIZE;
+		for (index = 0; index < chunk; index++)
+		{
+			data[offset + index] ^= keystream[index];
+		}
+	}
+}
+
+void
+cbcMacPortable(const AESKey *key, uint8_t *mac, const uint8_t *data,
+               size_t nblocks)
+{
+	size_t		index;
+	int			offset;
+
+	for (index = 0; index < nblocks; index++)
+	{
+		for (offset = 0; offset < AES_BLOCK_SIZE; offset++)
+		{
+			mac[offset] ^= data[index * AES_BLOCK_SIZE + offset];
+		}
+		encryptBlockPortable(key, mac, mac);
+	}
+}
+
+#ifdef HAVE_AESNI
+
+__attribute__((target("aes,sse2")))
+static void
+encryptBlocksAESNI(const AESKey *key, const uint8_t *in, uint8_t *out,
+                   size_t nblocks)
+{
+	__m128i		rk[AES_ROUNDS + 1];
+	__m128i		block;
+	size_t		index;
+	int			round;
+
+	for (round = 0; round <= AES_ROUNDS; round++)
+	{
+		rk[round] = _mm_load_si128((const __m128i *) key->roundKeys[round]);
+	}
+
+	for (index = 0; index < nblocks; index++)
+	{
+		block = _mm_loadu_si128((const __m128i *) (in + index * AES_BLOCK_SIZE));
+		block = _mm_xor_si128(block, rk[0]);
+		for (round = 1; round < AES_ROUNDS; round++)
+		{
+			block = _mm_aesenc_si128(block, rk[round]);
+		}
+		block = _mm_aesenclast_si128(block, rk[AES_ROUNDS]);
+		_mm_storeu_si128((__m128i *) (out + index * AES_BLOCK_SIZE), block);
+	}
+}
+
+__attribute__((target("aes,sse2")))
+static void
+ctrAESNI(const AESKey *key, uint64_t nonce, uint64_t counter,
+         uint8_t *data, size_t len)
+{
+	__m128i		rk[AES_ROUNDS + 1];
+	__m128i		blocks[AESNI_PIPELINE];
+	uint8_t		keystream[AES_BLOCK_SIZE];
+	size_t		nblocks = len / AES_BLOCK_SIZE;
+	size_t		index = 0;
+	size_t		offset;
+	int			lane;
+	int			round;
+
+	for (round = 0; round <= AES_ROUNDS; round++)
+	{
+		rk[round] = _mm_load_si128((const __m128i *) key->roundKeys[round]);
+	}
+
+	/* Full groups of blocks, every round is issued for the whole group */
+	for (; index + AESNI_PIPELINE <= nblocks; index += AESNI_PIPELINE)
+	{
+		for (lane = 0; lane < AESNI_PIPELINE; lane++)
+		{
+			blocks[lane] = _mm_xor_si128(_mm_set_epi64x((long long) (counter + lane),
+                                                        (long long) nonce), rk[0]);
+		}
+		counter += AESNI_PIPELINE;
+
+		for (round = 1; round < AES_ROUNDS; round++)
+		{
+			for (lane = 0; lane < AESNI_PIPELINE; lane++)
+			{
+				blocks[lane] = _mm_aesenc_si128(blocks[lane], rk[round]);
+			}
+		}
+
+		for (lane = 0; lane < AESNI_PIPELINE; lane++)
+		{
+			__m128i    *chunk = (__m128i *) (data + (index + lane) * AES_BLOCK_SIZE);
+
+			blocks[lane] = _mm_aesenclast_si128(blocks[lane], rk[AES_ROUNDS]);
+			_mm_storeu_si128(chunk, _mm_xor_si128(_mm_loadu_si128(chunk), blocks[lane]));
+		}
+	}
+
+	/* Remaining blocks and the trailing partial block */
+	for (; index * AES_BLOCK_SIZE < len; index++)
+	{
+		blocks[0] = _mm_xor_si128(_mm_set_epi64x((long long) counter++, (long long) nonce),
+                                  rk[0]);
+		for (round = 1; round < AES_ROUNDS; round++)
+		{
+			blocks[0] = _mm_aesenc_si128(blocks[0], rk[round]);
+		}
+		blocks[0] = _mm_aesenclast_si128(blocks[0], rk[AES_ROUNDS]);
+		_mm_storeu_si128((__m128i *) keystream, blocks[0]);
+
+		for (offset = 0; offset < AES_BLOCK_SIZE && index * AES_BLOCK_SIZE + offset < len; offset++)
+		{
+			data[index * AES_BLOCK_SIZE + offset] ^= keystream[offset];
+		}
+	}
+}
+
+__attribute__((target("aes,sse2")))
+static void
+cbcMacAESNI(const AESKey *key, uint8_t *mac, const uint8_t *data,
+            size_t nblocks)
+{
+	__m128i		rk[AES_ROUNDS + 1];
+	__m128i		state;
+	size_t		index;
+	int			round;
+
+	for (round = 0; round <= AES_ROUNDS; round++)
+	{
+		rk[round] = _mm_load_si128((const __m128i *) key->roundKeys[round]);
+	}
+
+	state = _mm_loadu_si128((const __m128i *) mac);
+	for (index = 0; index < nblocks; index++)
+	{
+		state = _mm_xor_si128(state, _mm_loadu_si128((const __m128i *) (data + index * AES_BLOCK_SIZE)));
+		state = _mm_xor_si128(state, rk[0]);
+		for (round = 1; round < AES_ROUNDS; round++)
+		{
+			state = _mm_aesenc_si128(state, rk[round]);
+		}
+		state = _mm_aesenclast_si128(state, rk[AES_ROUNDS]);
+	}
+	_mm_storeu_si128((__m128i *) mac, state);
+}
+
+#endif
+
+/*
+ * Returns whether the AES-NI implementation is used. The processor is only
+ * queried once.
+ */
+int
+hasAESNI(void)
+{
+#ifdef HAVE_AESNI
+	static int	supported = -1;
+
+	if (supported < 0)
+	{
+		__builtin_cpu_init();
+		supported = __builtin_cpu_supports("aes") ? 1 : 0;
+	}
+	return supported;
+#else
+	return 0;
+#endif
+}
+
+void
+aesEncryptBlocks(const AESKey *key, const uint8_t *in, uint8_t *out,
+                 size_t nblocks)
+{
+#ifdef HAVE_AESNI
+	if (hasAESNI())
+	{
+		encryptBlocksAESNI(key, in, out, nblocks);
+		return;
+	}
+#endif
+	encryptBlocksPortable(key, in, out, nblocks);
+}
+
+void
+aesCtr(const AESKey *key, uint64_t nonce, uint64_t counter, uint8_t *data,
+       size_t len)
+{
+#ifdef HAVE_AESNI
+	if (hasAESNI())
+	{
+		ctrAESNI(key, nonce, counter, data, len);
+		return;
+	}
+#endif
+	ctrPortable(key, nonce, counter, data, len);
+}
+
+void
+aesCbcMac(const AESKey *key, uint8_t mac[AES_BLOCK_SIZE], const uint8_t *data,
+          size_t nblocks)
+{
+#ifdef HAVE_AESNI
+	if (hasAESNI())
+	{
+		cbcMacAESNI(key, mac, data, nblocks);
+		return;
+	}
+#endif
+	cbcMacPortable(key, mac, data, nblocks);
+}
@@ -0,0 +1,508 @@
+/*-------------------------------------------------------------------------
+ *
+ * diskfile.c
+ *        Oblivious file stored in a regular file.
+ *
+ *
+ * Slot ob_blkno of the ORAM is stored at offset ob_blkno * recordSize of the
+ * file as a fixed size record of diskformat.h, a DiskHeader followed by
+ * blockSize bytes of payload, in host byte order. A record that was never
+ * written reads as zeros and is a dummy block, which lets fileInit size the
+ * file with ftruncate instead of writing every slot.
+ *
+ * The ORAM constructions number the slots of a bucket consecutively, so the
+ * slots of a path are split in runs of consecutive records and each run is
+ * read or written with a single system call. By default, the run is
+ * transferred with preadv/pwritev directly between the file and the blocks.
+ * If DISKFILE_DIRECT is defined, the file is opened with O_DIRECT, records
+ * are padded to DISKFILE_ALIGNMENT bytes and the run goes through an aligned
+ * buffer with pread/pwrite.
+ *
+ * The data is flushed with fdatasync when the file is closed and, if
+ * DISKFILE_SYNC_PERIOD is not zero, after every DISKFILE_SYNC_PERIOD writes.
+ *
+ * The file is created, or truncated, in the current directory with the name
+ * given to ofileinit between DISKFILE_PREFIX and DISKFILE_SUFFIX, and it is
+ * kept after the file is closed. As the stash and the position map are not
+ * stored, an existing file is not loaded.
+ *
+ * Like the ORAM engines, I/O errors are not recovered from and abort the
+ * execution.
+ *
+ * Copyright (c) 2018-2020, HASLab
+ *
+ * IDENTIFICATION
+ *        backend/ofile/diskfile.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#define _GNU_SOURCE
+
+#include "oram/ofile.h"
+#include "oram/diskformat.h"
+#include "oram/logger.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/* Number of writes between calls to fdatasync, 0 syncs only on close */
+#ifndef DISKFILE_SYNC_PERIOD
+#define DISKFILE_SYNC_PERIOD 0
+#endif
+
+/*
+ * Maximum number of records transferred with a single system call. A run
+ * takes up to three iovecs per record, which must stay below IOV_MAX.
+ */
+#define DISKFILE_MAX_RUN 128
+
+#ifdef __APPLE__
+#define fdatasync fsync
+#endif
+
+struct FileHandler{
+    int fd;
+    unsigned int nblocks;
+    unsigned int blockSize;
+    unsigned int nwrites;
+    size_t recordSize;
+
+    DiskHeader headers[DISKFILE_MAX_RUN];
+    struct iovec iov[3 * DISKFILE_MAX_RUN];
+    char *padding;
+    /* Zeros written after blocks smaller than blockSize */
+
+    char *buffer;
+    /* Aligned buffer of DISKFILE_MAX_RUN records, only used with O_DIRECT */
+};
+
+static FileHandler fileInit(const char *filename, unsigned int nblocks,
+                            unsigned int blocksize, unsigned int locationSize,
+                            void* appData);
+
+static void fileRead(FileHandler fhandler, PLBlock block,
+                     const char *fileName, const BlockNumber ob_blkno,
+                     void* appData);
+
+static void fileWrite(FileHandler fhandler, const PLBlock block,
+                      const char *fileName, const BlockNumber ob_blkno,
+                      void* appData);
+
+static void fileClose(FileHandler fhandler, const char *filename,
+                      void* appData);
+
+static void fileReadPath(FileHandler fhandler, PLBList blocks,
+                         const char *fileName, const BlockNumber *ob_blknos,
+                         unsigned int nblocks, void* appData);
+
+static void fileWritePath(FileHandler fhandler, const PLBList blocks,
+                          const char *fileName, const BlockNumber *ob_blknos,
+                          unsigned int nblocks, void* appData);
+
+static void *allocFile(size_t size);
+
+static void ioFailed(const char *operation);
+
+static void transferv(FileHandler handler, struct iovec *iov, int iovcnt,
+                      off_t offset, unsigned int write);
+
+static void transfer(FileHandler handler, char *buffer, size_t size,
+                     off_t offset, unsigned int write);
+
+static unsigned int runLength(const BlockNumber *ob_blknos, unsigned int nblocks);
+
+static void readRun(FileHandler handler, PLBList blocks, BlockNumber ob_blkno,
+                    unsigned int nblocks);
+
+static void writeRun(FileHandler handler, const PLBList blocks,
+                     BlockNumber ob_blkno, unsigned int nblocks);
+
+static void syncFile(FileHandler handler);
+
+
+void *
+allocFile(size_t size)
+{
+    void *result;
+    int save_errno = errno;
+
+    errno = 0;
+    result = malloc(size);
+
+    if(result == NULL && errno == ENOMEM)
+    {
+        logger(OUT_OF_MEMORY, "Out of memory allocating disk file\n");
+        errno = save_errno;
+        abort();
+    }
+    errno = save_errno;
+
+    return result;
+}
+
+void
+ioFailed(const char *operation)
+{
+    logger(DEBUG, "Disk file %s failed: %s\n", operation, strerror(errno));
+    abort();
+}
+
+FileHandler fileInit(const char *filename, unsigned int nblocks,
+                     unsigned int blocksize, unsigned int locationSize,
+                     void* appData) {
+
+    FileHandler handler;
+    char *path;
+    size_t pathlen;
+    int flags = O_RDWR | O_CREAT | O_TRUNC;
+
+    handler = (FileHandler) allocFile(sizeof(struct FileHandler));
+
+    pathlen = diskFilePathSize(filename);
+    path = (char *) allocFile(pathlen);
+    formatDiskFilePath(path, pathlen, filename);
+
+    handler->nblocks = nblocks;
+    handler->blockSize = blocksize;
+    handler->nwrites = 0;
+    handler->recordSize = sizeof(DiskHeader) + blocksize;
+    handler->buffer = NULL;
+
+    handler->padding = (char *) allocFile(blocksize);
+    memset(handler->padding, 0, blocksize);
+
+#if defined(DISKFILE_DIRECT) && defined(O_DIRECT)
+    handler->recordSize = (handler->recordSize + DISKFILE_ALIGNMENT - 1)
+        / DISKFILE_ALIGNMENT * DISKFILE_ALIGNMENT;
+
+    if (posix_memalign((void **) &handler->buffer, DISKFILE_ALIGNMENT,
+                       handler->recordSize * DISKFILE_MAX_RUN) != 0)
+    {
+        logger(OUT_OF_MEMORY, "Out of memory initializing disk file buffer\n");
+        abort();
+    }
+
+    handler->fd = open(path, flags | O_DIRECT, 0600);
+
+    /* Some file systems, e.g., tmpfs, do not support O_DIRECT */
+    if (handler->fd < 0 && errno == EINVAL)
+    {
+        logger(DEBUG, "O_DIRECT is not supported for %s\n", path);
+        handler->fd = open(path, flags, 0600);
+    }
+#else
+    handler->fd = open(path, flags, 0600);
+#endif
+
+    if (handler->fd < 0)
+    {
+        ioFailed("open");
+    }
+    free(path);
+
+    /* The file is sparse, every slot holds a dummy block */
+    if (ftruncate(handler->fd, (off_t) handler->recordSize * nblocks) != 0)
+    {
+        ioFailed("ftruncate");
+    }
+
+    return handler;
+}
+
+/*
+ * Reads or writes the iovecs at offset, resuming partial transfers.
+ */
+void
+transferv(FileHandler handler, struct iovec *iov, int iovcnt, off_t offset,
+          unsigned int write)
+{
+    ssize_t done;
+
+    while (iovcnt > 0)
+    {
+        if (write)
+            done = pwritev(handler->fd, iov, iovcnt, offset);
+        else
+            done = preadv(handler->fd, iov, iovcnt, offset);
+
+        if (done < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (done <= 0)
+        {
+            ioFailed(write ? "pwritev" : "preadv");
+        }
+
+        offset += done;
+        while (iovcnt > 0 && (size_t) done >= iov->iov_len)
+        {
+            done -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = (char *) iov->iov_base + done;
+            iov->iov_len -= done;
+        }
+    }
+}
+
+void
+transfer(FileHandler handler, char *buffer, size_t size, off_t offset,
+         unsigned int write)
+{
+    ssize_t done;
+
+    while (size > 0)
+    {
+        if (write)
+            done = pwrite(handler->fd, buffer, size, offset);
+        else
+            done = pread(handler->fd, buffer, size, offset);
+
+        if (done < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (done <= 0)
+        {
+            ioFailed(write ? "pwrite" : "pread");
+        }
+
+        buffer += done;
+        size -= done;
+        offset += done;
+    }
+}
+
+/*
+ * Returns the number of consecutive slots at the start of ob_blknos.
+ */
+unsigned int
+runLength(const BlockNumber *ob_blknos, unsigned int nblocks)
+{
+    unsigned int length = 1;
+
+    while (length < nblocks && length < DISKFILE_MAX_RUN
+           && ob_blknos[length] == ob_blknos[length - 1] + 1)
+    {
+        length++;
+    }
+
+    return length;
+}
+
+static inline void
+decodeBlock(FileHandler handler, PLBlock block, const DiskHeader *header,
+            const char *payload)
+{
+    decodeDiskHeader(block, header, handler->blockSize);
+
+    if (payload != NULL)
+    {
+        memcpy(block->block, payload, handler->blockSize);
+    }
+}
+
+void
+readRun(FileHandler handler, PLBList blocks, BlockNumber ob_blkno,
+        unsigned int nblocks)
+{
+    unsigned int index;
+    off_t offset = (off_t) handler->recordSize * ob_blkno;
+    char *record;
+
+    for (index = 0; index < nblocks; index++)
+    {
+        if (blocks[index]->block == NULL)
+        {
+            blocks[index]->block = allocFile(handler->blockSize);
+        }
+    }
+
+    if (handler->buffer != NULL)
+    {
+        transfer(handler, handler->buffer, handler->recordSize * nblocks,
+                 offset, 0);
+
+        for (index = 0; index < nblocks; index++)
+        {
+            record = handler->buffer + handler->recordSize * index;
+            decodeBlock(handler, blocks[index], (DiskHeader *) record,
+                        record + sizeof(DiskHeader));
+        }
+        return;
+    }
+
+    /* The payload is read in place, blocks have room for blockSize bytes */
+    for (index = 0; index < nblocks; index++)
+    {
+        handler->iov[2 * index].iov_base = &handler->headers[index];
+        handler->iov[2 * index].iov_len = sizeof(DiskHeader);
+        handler->iov[2 * index + 1].iov_base = blocks[index]->block;
+        handler->iov[2 * index + 1].iov_len = handler->blockSize;
+    }
+
+    transferv(handler, handler->iov, 2 * nblocks, offset, 0);
+
+    for (index = 0; index < nblocks; index++)
+    {
+        decodeBlock(handler, blocks[index], &handler->headers[index], NULL);
+    }
+}
+
+void
+writeRun(FileHandler handler, const PLBList blocks, BlockNumber ob_blkno,
+         unsigned int nblocks)
+{
+    unsigned int index;
+    unsigned int niov = 0;
+    off_t offset = (off_t) handler->recordSize * ob_blkno;
+    char *record;
+
+    if (handler->buffer != NULL)
+    {
+        for (index = 0; index < nblocks; index++)
+        {
+            record = handler->buffer + handler->recordSize * index;
+            memset(record, 0, handler->recordSize);
+            encodeDiskHeader((DiskHeader *) record, blocks[index]);
+            memcpy(record + sizeof(DiskHeader), blocks[index]->block,
+                   blocks[index]->size);
+        }
+
+        transfer(handler, handler->buffer, handler->recordSize * nblocks,
+                 offset, 1);
+        return;
+    }
+
+    for (index = 0; index < nblocks; index++)
+    {
+        encodeDiskHeader(&handler->headers[index], blocks[index]);
+
+        handler->iov[niov].iov_base = &handler->headers[index];
+        handler->iov[niov].iov_len = sizeof(DiskHeader);
+        niov++;
+        handler->iov[niov].iov_base = blocks[index]->block;
+        handler->iov[niov].iov_len = blocks[index]->size;
+        niov++;
+
+        if (blocks[index]->size < handler->blockSize)
+        {
+            handler->iov[niov].iov_base = handler->padding;
+            handler->iov[niov].iov_len = handler->blockSize - blocks[index]->size;
+            niov++;
+        }
+    }
+
+    transferv(handler, handler->iov, niov, offset, 1);
+}
+
+/*
+ * Counts a write and flushes the file every DISKFILE_SYNC_PERIOD writes.
+ */
+void
+syncFile(FileHandler handler)
+{
+    handler->nwrites++;
+
+#if DISKFILE_SYNC_PERIOD > 0
+    if (handler->nwrites >= DISKFILE_SYNC_PERIOD)
+    {
+        if (fdatasync(handler->fd) != 0)
+        {
+            ioFailed("fdatasync");
+        }
+        handler->nwrites = 0;
+    }
+#endif
+}
+
+void
+fileRead(FileHandler handler, PLBlock block, const char *fileName,
+         const BlockNumber ob_blkno, void* appData) {
+
+    readRun(handler, &block, ob_blkno, 1);
+}
+
+void
+fileWrite(FileHandler handler, const PLBlock block, const char *fileName,
+          const BlockNumber ob_blkno, void* appData) {
+
+    PLBlock aux = block;
+
+    writeRun(handler, &aux, ob_blkno, 1);
+    syncFile(handler);
+}
+
+void
+fileReadPath(FileHandler handler, PLBList blocks, const char *fileName,
+             const BlockNumber *ob_blknos, unsigned int nblocks, void* appData) {
+
+    unsigned int index = 0;
+    unsigned int length;
+
+    while (index < nblocks)
+    {
+        length = runLength(&ob_blknos[index], nblocks - index);
+        readRun(handler, &blocks[index], ob_blknos[index], length);
+        index += length;
+    }
+}
+
+void
+fileWritePath(FileHandler handler, const PLBList blocks, const char *fileName,
+              const BlockNumber *ob_blknos, unsigned int nblocks, void* appData) {
+
+    unsigned int index = 0;
+    unsigned int length;
+
+    while (index < nblocks)
+    {
+        length = runLength(&ob_blknos[index], nblocks - index);
+        writeRun(handler, &blocks[index], ob_blknos[index], length);
+        index += length;
+    }
+    syncFile(handler);
+}
+
+
+void
+fileClose(FileHandler handler, const char * filename, void* appData){
+
+    if (fdatasync(handler->fd) != 0)
+    {
+        ioFailed("fdatasync");
+    }
+    close(handler->fd);
+
+    free(handler->buffer);
+    free(handler->padding);
+    free(handler);
+}
+
+AMOFile *OFILE_CREATE(void) {
+    AMOFile *file = (AMOFile *) malloc(sizeof(AMOFile));
+    file->ofileinit = &fileInit;
+    file->ofileread = &fileRead;
+    file->ofilewrite = &fileWrite;
+    file->ofileclose = &fileClose;
+    return file;
+}
+
+AMOFileExt *OFILE_EXT_CREATE(void) {
+    AMOFileExt *ext = (AMOFileExt *) malloc(sizeof(AMOFileExt));
+    ext->ofilereadpath = &fileReadPath;
+    ext->ofilewritepath = &fileWritePath;
+    return ext;
+}
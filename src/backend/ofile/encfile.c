@@ -0,0 +1,425 @@
+/*-------------------------------------------------------------------------
+ *
+ * encfile.c
+ *        Oblivious file that encrypts the blocks stored in another one.
+ *
+ *
+ * Every block is encrypted with AES-128 in CTR mode before it is written to
+ * the wrapped oblivious file, together with its block number, size and
+ * location, so dummy and real blocks are indistinguishable. Blocks are
+ * encrypted with a fresh nonce on every write, so rewriting a bucket with the
+ * same contents yields a new ciphertext. The key is drawn from the system
+ * random source when the file is opened and never leaves client memory.
+ *
+ * A path is written with a single nonce: the blocks of the path are
+ * encrypted as consecutive segments of one keystream, generated several
+ * AES blocks at a time (see aes.c), and handed to the wrapped file with a
+ * single call to ofilewritepath. Each stored record is
+ *
+ *     nonce (8 bytes) | counter (8 bytes) | E(EncHeader | payload)
+ *
+ * with the payload padded to a multiple of the AES block size. Slots that
+ * were never written are reported by the wrapped file as dummy blocks and
+ * are returned as such.
+ *
+ * This layer only provides confidentiality. CTR mode does not authenticate
+ * the records, so a record modified by the storage decrypts to random bytes
+ * that are returned as a block. The decrypted header is checked so that such
+ * a record cannot overflow the block, but only the Merkle tree of pathoram.c
+ * (MERKLE_INTEGRITY), stacked above this file, detects tampering.
+ *
+ * The wrapped file is the oblivious file linked with this one. Its source is
+ * compiled with ENCFILE, which makes it export innerOFileCreate and
+ * innerOFileExtCreate instead of ofileCreate and ofileExtCreate (see
+ * ofile.h). This implementation assumes a single wrapped
+ * implementation per process.
+ *
+ * Copyright (c) 2018-2020, HASLab
+ *
+ * IDENTIFICATION
+ *        backend/ofile/encfile.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "oram/ofile.h"
+#include "oram/logger.h"
+#include "oram/aes.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+
+typedef struct EncHeader
+{
+    int32_t     blkno;
+    int32_t     size;
+    uint32_t    location[2];
+} EncHeader;
+
+/* Plaintext nonce and counter stored in front of each record */
+#define ENCFILE_IV_SIZE (2 * sizeof(uint64_t))
+
+struct FileHandler{
+    FileHandler inner;
+    /* Handler of the wrapped oblivious file */
+    AESKey key;
+    uint64_t nonce;
+    /* Next unused nonce, one per write */
+    unsigned int nblocks;
+    /* Slots of the file, real block numbers are below it */
+    unsigned int blockSize;
+    unsigned int cipherSize;
+    /* Encrypted bytes of a record, header and padded payload */
+    unsigned int recordSize;
+    PLBList records;
+    char *arena;
+    unsigned int nrecords;
+    /* Blocks that hold the records exchanged with the wrapped file */
+};
+
+static AMOFile *innerFile = NULL;
+static AMOFileExt *innerFileExt = NULL;
+
+static FileHandler fileInit(const char *filename, unsigned int nblocks,
+                            unsigned int blocksize, unsigned int locationSize,
+                            void* appData);
+
+static void fileRead(FileHandler fhandler, PLBlock block,
+                     const char *fileName, const BlockNumber ob_blkno,
+                     void* appData);
+
+static void fileWrite(FileHandler fhandler, const PLBlock block,
+                      const char *fileName, const BlockNumber ob_blkno,
+                      void* appData);
+
+static void fileClose(FileHandler fhandler, const char *filename,
+                      void* appData);
+
+static void fileReadPath(FileHandler fhandler, PLBList blocks,
+                         const char *fileName, const BlockNumber *ob_blknos,
+                         unsigned int nblocks, void* appData);
+
+static void fileWritePath(FileHandler fhandler, const PLBList blocks,
+                          const char *fileName, const BlockNumber *ob_blknos,
+                          unsigned int nblocks, void* appData);
+
+static void reserveRecords(FileHandler handler, unsigned int nrecords);
+
+
+FileHandler fileInit(const char *filename, unsigned int nblocks,
+                     unsigned int blocksize, unsigned int locationSize,
+                     void* appData) {
+
+    FileHandler handler;
+    uint8_t raw[AES_KEY_SIZE];
+    size_t filled = 0;
+    ssize_t result;
+    int save_errno = errno;
+
+    errno = 0;
+    handler = (FileHandler) malloc(sizeof(struct FileHandler));
+
+    if(handler == NULL && errno == ENOMEM)
+    {
+        logger(OUT_OF_MEMORY, "Out of memory initializing encrypted file handler\n");
+        errno = save_errno;
+        abort();
+    }
+    errno = save_errno;
+
+    while (filled < AES_KEY_SIZE)
+    {
+        result = getrandom(raw + filled, AES_KEY_SIZE - filled, 0);
+        if (result < 0 && errno != EINTR)
+        {
+            logger(DEBUG, "Encrypted file key generation failed: %s\n", strerror(errno));
+            abort();
+        }
+        if (result > 0)
+        {
+            filled += (size_t) result;
+        }
+    }
+    errno = save_errno;
+
+    aesSetKey(&handler->key, raw);
+    memset(raw, 0, AES_KEY_SIZE);
+
+    handler->nonce = 0;
+    handler->nblocks = nblocks;
+    handler->blockSize = blocksize;
+    handler->cipherSize = (sizeof(EncHeader) + blocksize + AES_BLOCK_SIZE - 1)
+        / AES_BLOCK_SIZE * AES_BLOCK_SIZE;
+    handler->recordSize = ENCFILE_IV_SIZE + handler->cipherSize;
+    handler->records = NULL;
+    handler->arena = NULL;
+    handler->nrecords = 0;
+
+    handler->inner = innerFile->ofileinit(filename, nblocks, handler->recordSize,
+                                          locationSize, appData);
+
+    return handler;
+}
+
+/*
+ * Makes room for nrecords records in a single arena, so that a path is
+ * encrypted and decrypted over contiguous memory.
+ */
+void
+reserveRecords(FileHandler handler, unsigned int nrecords)
+{
+    unsigned int index;
+    int save_errno = errno;
+
+    if (nrecords <= handler->nrecords)
+    {
+        return;
+    }
+
+    for (index = 0; index < handler->nrecords; index++)
+    {
+        free(handler->records[index]);
+    }
+    free(handler->records);
+    free(handler->arena);
+
+    errno = 0;
+    handler->records = (PLBList) malloc(sizeof(PLBlock) * nrecords);
+    handler->arena = (char *) malloc((size_t) handler->recordSize * nrecords);
+
+    if ((handler->records == NULL || handler->arena == NULL) && errno == ENOMEM)
+    {
+        logger(OUT_OF_MEMORY, "Out of memory allocating encrypted file records\n");
+        errno = save_errno;
+        abort();
+    }
+    errno = save_errno;
+
+    for (index = 0; index < nrecords; index++)
+    {
+        handler->records[index] = createEmptyBlock();
+        handler->records[index]->block = handler->arena
+            + (size_t) handler->recordSize * index;
+    }
+    handler->nrecords = nrecords;
+}
+
+/*
+ * Encrypts block into record with the keystream of nonce starting at counter.
+ */
+static inline void
+encryptRecord(FileHandler handler, const PLBlock block, PLBlock record,
+              uint64_t nonce, uint64_t counter)
+{
+    uint8_t *data = (uint8_t *) record->block;
+    uint8_t *plain = data + ENCFILE_IV_SIZE;
+    EncHeader header;
+    unsigned int size = (unsigned int) block->size;
+
+    memcpy(data, &nonce, sizeof(uint64_t));
+    memcpy(data + sizeof(uint64_t), &counter, sizeof(uint64_t));
+
+    header.blkno = block->blkno;
+    header.size = block->size;
+    header.location[0] = block->location[0];
+    header.location[1] = block->location[1];
+
+    memcpy(plain, &header, sizeof(EncHeader));
+    memcpy(plain + sizeof(EncHeader), block->block, size);
+    memset(plain + sizeof(EncHeader) + size, 0,
+           handler->cipherSize - sizeof(EncHeader) - size);
+
+    aesCtr(&handler->key, nonce, counter, plain, handler->cipherSize);
+
+    /* The wrapped file only sees a used slot of opaque data */
+    record->blkno = 0;
+    record->size = handler->recordSize;
+    record->location[0] = 0;
+    record->location[1] = 0;
+}
+
+static inline void
+decryptRecord(FileHandler handler, PLBlock block, PLBlock record)
+{
+    uint8_t *data = (uint8_t *) record->block;
+    uint8_t *plain = data + ENCFILE_IV_SIZE;
+    EncHeader header;
+    uint64_t nonce;
+    uint64_t counter;
+    int save_errno;
+
+    if (block->block == NULL)
+    {
+        save_errno = errno;
+        errno = 0;
+        block->block = malloc(handler->blockSize);
+
+        if (block->block == NULL && errno == ENOMEM)
+        {
+            logger(OUT_OF_MEMORY, "Out of memory reading encrypted block\n");
+            errno = save_errno;
+            abort();
+        }
+        errno = save_errno;
+    }
+
+    if (record->blkno == DUMMY_BLOCK)
+    {
+        block->blkno = DUMMY_BLOCK;
+        block->size = handler->blockSize;
+        block->location[0] = 0;
+        block->location[1] = 0;
+        memset(block->block, 0, handler->blockSize);
+        return;
+    }
+
+    memcpy(&nonce, data, sizeof(uint64_t));
+    memcpy(&counter, data + sizeof(uint64_t), sizeof(uint64_t));
+    aesCtr(&handler->key, nonce, counter, plain, handler->cipherSize);
+
+    memcpy(&header, plain, sizeof(EncHeader));
+
+    if (header.size < 0 || header.size > (int32_t) handler->blockSize
+        || header.blkno < DUMMY_BLOCK || header.blkno >= (int32_t) handler->nblocks)
+    {
+        logger(DEBUG, "Encrypted record with block %d of size %d is corrupted\n",
+               header.blkno, header.size);
+        abort();
+    }
+
+    block->blkno = header.blkno;
+    block->size = header.size;
+    block->location[0] = header.location[0];
+    block->location[1] = header.location[1];
+    memcpy(block->block, plain + sizeof(EncHeader), header.size);
+}
+
+void
+fileRead(FileHandler handler, PLBlock block, const char *fileName,
+         const BlockNumber ob_blkno, void* appData) {
+
+    reserveRecords(handler, 1);
+    innerFile->ofileread(handler->inner, handler->records[0], fileName,
+                         ob_blkno, appData);
+    decryptRecord(handler, block, handler->records[0]);
+}
+
+void
+fileWrite(FileHandler handler, const PLBlock block, const char *fileName,
+          const BlockNumber ob_blkno, void* appData) {
+
+    reserveRecords(handler, 1);
+    encryptRecord(handler, block, handler->records[0], handler->nonce++, 0);
+    innerFile->ofilewrite(handler->inner, handler->records[0], fileName,
+                          ob_blkno, appData);
+}
+
+void
+fileReadPath(FileHandler handler, PLBList blocks, const char *fileName,
+             const BlockNumber *ob_blknos, unsigned int nblocks, void* appData) {
+
+    unsigned int index;
+
+    reserveRecords(handler, nblocks);
+
+    if (innerFileExt->ofilereadpath != NULL)
+    {
+        innerFileExt->ofilereadpath(handler->inner, handler->records, fileName,
+                                 ob_blknos, nblocks, appData);
+    }
+    else
+    {
+        for (index = 0; index < nblocks; index++)
+        {
+            innerFile->ofileread(handler->inner, handler->records[index],
+                                 fileName, ob_blknos[index], appData);
+        }
+    }
+
+    for (index = 0; index < nblocks; index++)
+    {
+        decryptRecord(handler, blocks[index], handler->records[index]);
+    }
+}
+
+void
+fileWritePath(FileHandler handler, const PLBList blocks, const char *fileName,
+              const BlockNumber *ob_blknos, unsigned int nblocks, void* appData) {
+
+    unsigned int index;
+    uint64_t nonce = handler->nonce++;
+    uint64_t blocksPerRecord = handler->cipherSize / AES_BLOCK_SIZE;
+
+    reserveRecords(handler, nblocks);
+
+    for (index = 0; index < nblocks; index++)
+    {
+        encryptRecord(handler, blocks[index], handler->records[index], nonce,
+                      index * blocksPerRecord);
+    }
+
+    if (innerFileExt->ofilewritepath != NULL)
+    {
+        innerFileExt->ofilewritepath(handler->inner, handler->records, fileName,
+                                  ob_blknos, nblocks, appData);
+    }
+    else
+    {
+        for (index = 0; index < nblocks; index++)
+        {
+            innerFile->ofilewrite(handler->inner, handler->records[index],
+                                  fileName, ob_blknos[index], appData);
+        }
+    }
+}
+
+
+void
+fileClose(FileHandler handler, const char * filename, void* appData){
+
+    unsigned int index;
+
+    innerFile->ofileclose(handler->inner, filename, appData);
+
+    for (index = 0; index < handler->nrecords; index++)
+    {
+        free(handler->records[index]);
+    }
+    free(handler->records);
+    free(handler->arena);
+
+    memset(&handler->key, 0, sizeof(AESKey));
+    free(handler);
+}
+
+AMOFile *ofileCreate(void) {
+    AMOFile *file = (AMOFile *) malloc(sizeof(AMOFile));
+
+    if (innerFile == NULL)
+    {
+        innerFile = innerOFileCreate();
+    }
+
+    file->ofileinit = &fileInit;
+    file->ofileread = &fileRead;
+    file->ofilewrite = &fileWrite;
+    file->ofileclose = &fileClose;
+    return file;
+}
+
+AMOFileExt *ofileExtCreate(void) {
+    AMOFileExt *ext = (AMOFileExt *) malloc(sizeof(AMOFileExt));
+
+    if (innerFileExt == NULL)
+    {
+        innerFileExt = innerOFileExtCreate();
+    }
+
+    ext->ofilereadpath = &fileReadPath;
+    ext->ofilewritepath = &fileWritePath;
+    return ext;
+}
@@ -0,0 +1,325 @@
+/*-------------------------------------------------------------------------
+ *
+ * mmapfile.c
+ *        Oblivious file kept in a single memory mapping.
+ *
+ *
+ * Unlike ofile.c, which allocates a header and a payload per slot, the slots
+ * are records of a fixed stride in one mapping, using the record format of
+ * diskformat.h: a DiskHeader followed by blockSize bytes of payload. The header
+ * keeps blkno + 1, so the zero pages of a fresh mapping are dummy blocks and
+ * the tree needs no initialization; pages are only populated when a path
+ * first writes them.
+ *
+ * By default the mapping is anonymous and transparent huge pages are
+ * requested with madvise, so that the walk of a path takes fewer TLB misses.
+ * If MMAPFILE_HUGETLB is defined, the mapping is first tried with
+ * MAP_HUGETLB, which needs huge pages reserved by the system, and falls back
+ * to a regular mapping otherwise. If MMAPFILE_BACKED is defined, the mapping
+ * is a shared mapping of a file named as in diskfile.c, which is synced with
+ * msync when the file is closed.
+ *
+ * The engines own the payload buffers of the blocks they read, so blocks are
+ * still copied in and out of the mapping, but each slot is a single memcpy
+ * from contiguous memory.
+ *
+ * Copyright (c) 2018-2020, HASLab
+ *
+ * IDENTIFICATION
+ *        backend/ofile/mmapfile.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#define _GNU_SOURCE
+
+#include "oram/ofile.h"
+#include "oram/diskformat.h"
+#include "oram/logger.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* Records are aligned to 8 bytes so that headers are naturally aligned */
+#define MMAPFILE_RECORD_ALIGNMENT 8
+
+/* Size of the huge pages used with MAP_HUGETLB */
+#define MMAPFILE_HUGE_PAGE (2 * 1024 * 1024)
+
+struct FileHandler{
+    char *region;
+    size_t regionSize;
+    size_t recordSize;
+    unsigned int nblocks;
+    unsigned int blockSize;
+    int fd;
+    /* Descriptor of the mapped file or -1 for an anonymous mapping */
+};
+
+static FileHandler fileInit(const char *filename, unsigned int nblocks,
+                            unsigned int blocksize, unsigned int locationSize,
+                            void* appData);
+
+static void fileRead(FileHandler fhandler, PLBlock block,
+                     const char *fileName, const BlockNumber ob_blkno,
+                     void* appData);
+
+static void fileWrite(FileHandler fhandler, const PLBlock block,
+                      const char *fileName, const BlockNumber ob_blkno,
+                      void* appData);
+
+static void fileClose(FileHandler fhandler, const char *filename,
+                      void* appData);
+
+static void fileReadPath(FileHandler fhandler, PLBList blocks,
+                         const char *fileName, const BlockNumber *ob_blknos,
+                         unsigned int nblocks, void* appData);
+
+static void fileWritePath(FileHandler fhandler, const PLBList blocks,
+                          const char *fileName, const BlockNumber *ob_blknos,
+                          unsigned int nblocks, void* appData);
+
+static void mapFailed(const char *operation);
+
+static void mapRegion(FileHandler handler, const char *filename);
+
+
+void
+mapFailed(const char *operation)
+{
+    logger(DEBUG, "Memory mapped file %s failed: %s\n", operation, strerror(errno));
+    abort();
+}
+
+/*
+ * Maps handler->regionSize bytes for the records of the file.
+ */
+void
+mapRegion(FileHandler handler, const char *filename)
+{
+#ifdef MMAPFILE_BACKED
+    char *path;
+    size_t pathlen;
+    int save_errno = errno;
+
+    pathlen = diskFilePathSize(filename);
+
+    errno = 0;
+    path = (char *) malloc(pathlen);
+    if (path == NULL && errno == ENOMEM)
+    {
+        logger(OUT_OF_MEMORY, "Out of memory initializing memory mapped file\n");
+        errno = save_errno;
+        abort();
+    }
+    errno = save_errno;
+
+    formatDiskFilePath(path, pathlen, filename);
+
+    handler->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (handler->fd < 0)
+    {
+        mapFailed("open");
+    }
+    free(path);
+
+    /* The file is sparse, every slot holds a dummy block */
+    if (ftruncate(handler->fd, (off_t) handler->regionSize) != 0)
+    {
+        mapFailed("ftruncate");
+    }
+
+    handler->region = (char *) mmap(NULL, handler->regionSize,
+                                    PROT_READ | PROT_WRITE, MAP_SHARED,
+                                    handler->fd, 0);
+#else
+    handler->fd = -1;
+    handler->region = MAP_FAILED;
+
+#if defined(MMAPFILE_HUGETLB) && defined(MAP_HUGETLB)
+    {
+        size_t hugeSize = (handler->regionSize + MMAPFILE_HUGE_PAGE - 1)
+            / MMAPFILE_HUGE_PAGE * MMAPFILE_HUGE_PAGE;
+
+        handler->region = (char *) mmap(NULL, hugeSize, PROT_READ | PROT_WRITE,
+                                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                                        -1, 0);
+        if (handler->region != MAP_FAILED)
+        {
+            handler->regionSize = hugeSize;
+            return;
+        }
+        logger(DEBUG, "No huge pages available, using a regular mapping\n");
+    }
+#endif
+
+    handler->region = (char *) mmap(NULL, handler->regionSize,
+                                    PROT_READ | PROT_WRITE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                                    -1, 0);
+#endif
+
+    if (handler->region == MAP_FAILED)
+    {
+        mapFailed("mmap");
+    }
+
+#ifdef MADV_HUGEPAGE
+    /* Transparent huge pages are only a hint, the result is ignored */
+    madvise(handler->region, handler->regionSize, MADV_HUGEPAGE);
+#endif
+}
+
+FileHandler fileInit(const char *filename, unsigned int nblocks,
+                     unsigned int blocksize, unsigned int locationSize,
+                     void* appData) {
+
+    FileHandler handler;
+    int save_errno = errno;
+
+    errno = 0;
+    handler = (FileHandler) malloc(sizeof(struct FileHandler));
+
+    if(handler == NULL && errno == ENOMEM)
+    {
+        logger(OUT_OF_MEMORY, "Out of memory initializing memory mapped file handler\n");
+        errno = save_errno;
+        abort();
+    }
+    errno = save_errno;
+
+    handler->nblocks = nblocks;
+    handler->blockSize = blocksize;
+    handler->recordSize = (sizeof(DiskHeader) + blocksize + MMAPFILE_RECORD_ALIGNMENT - 1)
+        / MMAPFILE_RECORD_ALIGNMENT * MMAPFILE_RECORD_ALIGNMENT;
+    handler->regionSize = handler->recordSize * nblocks;
+
+    mapRegion(handler, filename);
+
+    return handler;
+}
+
+static inline void
+readRecord(FileHandler handler, PLBlock block, BlockNumber ob_blkno)
+{
+    const char *record = handler->region + handler->recordSize * ob_blkno;
+    const DiskHeader *header = (const DiskHeader *) record;
+    int save_errno;
+
+    if (block->block == NULL)
+    {
+        save_errno = errno;
+        errno = 0;
+        block->block = malloc(handler->blockSize);
+
+        if (block->block == NULL && errno == ENOMEM)
+        {
+            logger(OUT_OF_MEMORY, "Out of memory reading memory mapped block\n");
+            errno = save_errno;
+            abort();
+        }
+        errno = save_errno;
+    }
+
+    decodeDiskHeader(block, header, handler->blockSize);
+
+    memcpy(block->block, record + sizeof(DiskHeader), block->size);
+}
+
+static inline void
+writeRecord(FileHandler handler, const PLBlock block, BlockNumber ob_blkno)
+{
+    char *record = handler->region + handler->recordSize * ob_blkno;
+    DiskHeader *header = (DiskHeader *) record;
+
+    encodeDiskHeader(header, block);
+
+    memcpy(record + sizeof(DiskHeader), block->block, block->size);
+}
+
+void
+fileRead(FileHandler handler, PLBlock block, const char *fileName,
+         const BlockNumber ob_blkno, void* appData) {
+
+    readRecord(handler, block, ob_blkno);
+}
+
+void
+fileWrite(FileHandler handler, const PLBlock block, const char *fileName,
+          const BlockNumber ob_blkno, void* appData) {
+
+    writeRecord(handler, block, ob_blkno);
+}
+
+void
+fileReadPath(FileHandler handler, PLBList blocks, const char *fileName,
+             const BlockNumber *ob_blknos, unsigned int nblocks, void* appData) {
+
+    unsigned int index;
+
+    for (index = 0; index < nblocks; index++)
+    {
+        /* Buckets of a path are far apart, fetch the next one early */
+        if (index + 1 < nblocks)
+        {
+            __builtin_prefetch(handler->region + handler->recordSize * ob_blknos[index + 1]);
+        }
+        readRecord(handler, blocks[index], ob_blknos[index]);
+    }
+}
+
+void
+fileWritePath(FileHandler handler, const PLBList blocks, const char *fileName,
+              const BlockNumber *ob_blknos, unsigned int nblocks, void* appData) {
+
+    unsigned int index;
+
+    for (index = 0; index < nblocks; index++)
+    {
+        if (index + 1 < nblocks)
+        {
+            __builtin_prefetch(handler->region + handler->recordSize * ob_blknos[index + 1], 1);
+        }
+        writeRecord(handler, blocks[index], ob_blknos[index]);
+    }
+}
+
+
+void
+fileClose(FileHandler handler, const char * filename, void* appData){
+
+    if (handler->fd >= 0 && msync(handler->region, handler->regionSize, MS_SYNC) != 0)
+    {
+        mapFailed("msync");
+    }
+
+    munmap(handler->region, handler->regionSize);
+
+    if (handler->fd >= 0)
+    {
+        close(handler->fd);
+    }
+    free(handler);
+}
+
+AMOFile *OFILE_CREATE(void) {
+    AMOFile *file = (AMOFile *) malloc(sizeof(AMOFile));
+    file->ofileinit = &fileInit;
+    file->ofileread = &fileRead;
+    file->ofilewrite = &fileWrite;
+    file->ofileclose = &fileClose;
+    return file;
+}
+
+AMOFileExt *OFILE_EXT_CREATE(void) {
+    AMOFileExt *ext = (AMOFileExt *) malloc(sizeof(AMOFileExt));
+    ext->ofilereadpath = &fileReadPath;
+    ext->ofilewritepath = &fileWritePath;
+    return ext;
+}
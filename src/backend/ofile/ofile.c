@@ -8,6 +8,10 @@
  * provide an example and have an in-memory implementation of the methods
  * the ORAM requires to write blocks to a file. This code is used for testing
  * the implementation without having to actually write to a file.
+ *
+ * With LAZY_INIT, fileInit only allocates the array of blocks. A block is
+ * allocated the first time it is written, and reading a block never written
+ * returns a dummy block, so the file is ready in constant time.
  * 
  * Copyright (c) 2018-2019, HASLab
  *
@@ -28,6 +32,7 @@
 struct FileHandler{
     PLBList file;
     unsigned int nblocks;
+    unsigned int blocksize;
 };
 
 static FileHandler fileInit(const char *filename, unsigned int nblocks, 
@@ -45,13 +50,60 @@ static void fileWrite(FileHandler fhandler, const PLBlock block,
 static void fileClose(FileHandler fhandler, const char *filename, 
                       void* appData);
 
+static void fileReadPath(FileHandler fhandler, PLBList blocks,
+                         const char *fileName, const BlockNumber *ob_blknos,
+                         unsigned int nblocks, void* appData);
+
+static void fileWritePath(FileHandler fhandler, const PLBList blocks,
+                          const char *fileName, const BlockNumber *ob_blknos,
+                          unsigned int nblocks, void* appData);
+
+static PLBlock newFileBlock(unsigned int blocksize);
+
+
+/*
+ * Allocates a dummy block of the file filled with zeros.
+ */
+static PLBlock newFileBlock(unsigned int blocksize) {
+
+    PLBlock block;
+    unsigned int save_errno = 0;
+
+    save_errno = errno;
+    errno = 0;
+
+    block = (PLBlock) malloc(sizeof(struct PLBlock));
+
+    if(block == NULL && errno == ENOMEM)
+    {
+        logger(OUT_OF_MEMORY, "Out of memory initializing file block\n");
+        errno = save_errno;
+        abort();
+    }
+
+    errno = save_errno;
+
+    block->blkno = -1;
+    block->size = blocksize;
+
+    /*TODO: Add verification code for available size*/
+    block->block = (void *) malloc(blocksize);
+
+    memset(block->block, 0, blocksize);
+    block->location[0] = 0;
+    block->location[1] = 0;
+
+    return block;
+}
 
 FileHandler fileInit(const char *filename, unsigned int nblocks, 
                      unsigned int blocksize, unsigned int locationSize,
                      void* appData) {
 
     FileHandler handler;
+#ifndef LAZY_INIT
     int offset;
+#endif
     unsigned int save_errno = 0;
 
     save_errno = errno;
@@ -67,8 +119,12 @@ FileHandler fileInit(const char *filename, unsigned int nblocks,
     }
 
     
-
+#ifdef LAZY_INIT
+    /* Blocks never written are NULL */
+    handler->file = (PLBList) calloc(nblocks, sizeof(PLBlock));
+#else
     handler->file = (PLBList) malloc(sizeof(PLBlock) * nblocks);
+#endif
     
     if(handler->file  == NULL && errno == ENOMEM){
 
@@ -80,32 +136,13 @@ FileHandler fileInit(const char *filename, unsigned int nblocks,
     errno = save_errno;
 
     handler->nblocks = nblocks;
+    handler->blocksize = blocksize;
 
+#ifndef LAZY_INIT
     for (offset = 0; offset < nblocks; offset++) {
-        save_errno = errno;
-        errno = 0;
-
-        handler->file[offset] = (PLBlock) malloc(sizeof(struct PLBlock));
-
-        if(handler->file[offset] == NULL && errno == ENOMEM)
-        {
-            logger(OUT_OF_MEMORY, "Out of memory initializing file block\n");
-		    errno = save_errno;
-		    abort();
-        }
-
-        errno = save_errno;
-        
-        handler->file[offset]->blkno = -1;
-        handler->file[offset]->size = blocksize;
-
-        /*TODO: Add verification code for available size*/
-        handler->file[offset]->block = (void *) malloc(blocksize);
-                
-        memset(handler->file[offset]->block, 0, blocksize);
-        handler->file[offset]->location[0] = 0;   
-        handler->file[offset]->location[1] = 0;    
+        handler->file[offset] = newFileBlock(blocksize);
     }
+#endif
 
     return handler;
 
@@ -116,12 +153,53 @@ fileRead(FileHandler handler, PLBlock block, const char *fileName,
          const BlockNumber ob_blkno, void* appData) {
 
     PLBlock cblock = handler->file[ob_blkno];
+    int save_errno;
+
+#ifdef LAZY_INIT
+    if(cblock == NULL){
+        /* Never written, the block is a dummy block filled with zeros */
+        block->blkno = -1;
+        block->size = handler->blocksize;
+        block->location[0] = 0;
+        block->location[1] = 0;
+
+        if(block->block == NULL){
+            save_errno = errno;
+            errno = 0;
+            block->block = malloc(handler->blocksize);
+
+            if (block->block == NULL && errno == ENOMEM)
+            {
+                logger(OUT_OF_MEMORY, "Out of memory reading file block\n");
+                errno = save_errno;
+                abort();
+            }
+            errno = save_errno;
+        }
+
+        memset(block->block, 0, handler->blocksize);
+        return;
+    }
+#endif
 
     block->blkno = cblock->blkno;
     block->size = cblock->size;
     block->location[0] = cblock->location[0];
     block->location[1] = cblock->location[1];
-    block->block = malloc(cblock->size);
+
+    if(block->block == NULL){
+        save_errno = errno;
+        errno = 0;
+        block->block = malloc(cblock->size);
+
+        if (block->block == NULL && errno == ENOMEM)
+        {
+            logger(OUT_OF_MEMORY, "Out of memory reading file block\n");
+            errno = save_errno;
+            abort();
+        }
+        errno = save_errno;
+    }
 
     memcpy(block->block, cblock->block, cblock->size);
 }
@@ -132,6 +210,13 @@ fileWrite(FileHandler handler, const PLBlock block, const char *fileName,
 
     PLBlock cblock = handler->file[ob_blkno];
 
+#ifdef LAZY_INIT
+    if(cblock == NULL){
+        cblock = newFileBlock(handler->blocksize);
+        handler->file[ob_blkno] = cblock;
+    }
+#endif
+
     cblock->blkno = block->blkno;
     cblock->size = block->size;
     cblock->location[0] = block->location[0];
@@ -140,6 +225,28 @@ fileWrite(FileHandler handler, const PLBlock block, const char *fileName,
     memcpy(cblock->block, block->block, block->size);
 }
 
+void
+fileReadPath(FileHandler handler, PLBList blocks, const char *fileName,
+             const BlockNumber *ob_blknos, unsigned int nblocks, void* appData) {
+
+    unsigned int index;
+
+    for (index = 0; index < nblocks; index++) {
+        fileRead(handler, blocks[index], fileName, ob_blknos[index], appData);
+    }
+}
+
+void
+fileWritePath(FileHandler handler, const PLBList blocks, const char *fileName,
+              const BlockNumber *ob_blknos, unsigned int nblocks, void* appData) {
+
+    unsigned int index;
+
+    for (index = 0; index < nblocks; index++) {
+        fileWrite(handler, blocks[index], fileName, ob_blknos[index], appData);
+    }
+}
+
 
 void 
 fileClose(FileHandler handler, const char * filename, void* appData){
@@ -147,6 +254,11 @@ fileClose(FileHandler handler, const char * filename, void* appData){
     int i;
 
     for(i=0; i < handler->nblocks; i++){
+#ifdef LAZY_INIT
+        if(handler->file[i] == NULL){
+            continue;
+        }
+#endif
         free(handler->file[i]->block);
         free(handler->file[i]);
     }
@@ -154,7 +266,7 @@ fileClose(FileHandler handler, const char * filename, void* appData){
     free(handler);
 }
 
-AMOFile *ofileCreate(void) {
+AMOFile *OFILE_CREATE(void) {
     AMOFile *file = (AMOFile *) malloc(sizeof(AMOFile));
     file->ofileinit = &fileInit;
     file->ofileread = &fileRead;
@@ -163,3 +275,10 @@ AMOFile *ofileCreate(void) {
     return file;
 }
 
+AMOFileExt *OFILE_EXT_CREATE(void) {
+    AMOFileExt *ext = (AMOFileExt *) malloc(sizeof(AMOFileExt));
+    ext->ofilereadpath = &fileReadPath;
+    ext->ofilewritepath = &fileWritePath;
+    return ext;
+}
+
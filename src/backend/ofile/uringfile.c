@@ -0,0 +1,817 @@
+/*-------------------------------------------------------------------------
+ *
+ * uringfile.c
+ *        Oblivious file stored in a regular file and accessed with io_uring.
+ *
+ *
+ * The file uses the record format of diskformat.h, a DiskHeader followed by
+ * blockSize bytes of payload per slot, and the same DISKFILE_PREFIX,
+ * DISKFILE_SUFFIX and DISKFILE_SYNC_PERIOD options. Instead of a system call
+ * per run of consecutive slots, every run of a path is queued in an io_uring
+ * submission queue, so that the buckets of a path are fetched concurrently
+ * with a single io_uring_enter that submits the reads and waits for them.
+ *
+ * Writes are asynchronous. ofilewritepath copies the records of the path to
+ * a write buffer, submits them and returns, so the eviction of an access
+ * overlaps the path fetch of the next one. Until the next ofilewritepath, the
+ * slots being written are read from the write buffer instead of the file,
+ * which keeps reads consistent with the writes in flight (e.g., the root
+ * bucket, which is on every path). The next ofilewritepath waits for the
+ * previous writes before reusing the buffer.
+ *
+ * The rings are set up with the raw system calls of <linux/io_uring.h>
+ * (Linux 5.1 or later), so liburing is not required. Reads go directly to
+ * the payload of the blocks with one iovec per header and payload. If
+ * DISKFILE_DIRECT is defined, the file is opened with O_DIRECT as in
+ * diskfile.c and reads go through an aligned buffer instead, which is what
+ * lets the requests of a path reach the device concurrently; buffered
+ * reads that hit the page cache gain little from io_uring. Like the ORAM
+ * engines, I/O errors abort the execution.
+ *
+ * Copyright (c) 2018-2020, HASLab
+ *
+ * IDENTIFICATION
+ *        backend/ofile/uringfile.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#define _GNU_SOURCE
+
+#include "oram/ofile.h"
+#include "oram/diskformat.h"
+#include "oram/logger.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/* Number of writes between calls to fdatasync, 0 syncs only on close */
+#ifndef DISKFILE_SYNC_PERIOD
+#define DISKFILE_SYNC_PERIOD 0
+#endif
+
+/* Maximum number of requests in flight, the size of the submission queue */
+#ifndef URINGFILE_QUEUE_DEPTH
+#define URINGFILE_QUEUE_DEPTH 64
+#endif
+
+/*
+ * Maximum number of records read by a request. A read takes two iovecs per
+ * record, which must stay below IOV_MAX.
+ */
+#define URINGFILE_MAX_RUN 128
+
+typedef struct UringRequest
+{
+    struct iovec *iov;
+    int         iovcnt;
+    unsigned int write;
+    off_t       offset;
+    size_t      length;
+} UringRequest;
+
+/* Consecutive slots written by the last ofilewritepath */
+typedef struct PendingRun
+{
+    BlockNumber start;
+    unsigned int nblocks;
+    char       *data;
+} PendingRun;
+
+struct FileHandler{
+    int fd;
+    int ringfd;
+    unsigned int nblocks;
+    unsigned int blockSize;
+    size_t recordSize;
+    unsigned int nwrites;
+
+    unsigned int sqEntries;
+    unsigned int *sqTail;
+    unsigned int *sqMask;
+    unsigned int *sqArray;
+    struct io_uring_sqe *sqes;
+    unsigned int *cqHead;
+    unsigned int *cqTail;
+    unsigned int *cqMask;
+    struct io_uring_cqe *cqes;
+    void *sqRing;
+    void *cqRing;
+    size_t sqRingSize;
+    size_t cqRingSize;
+    size_t sqesSize;
+
+    unsigned int nqueued;
+    /* Requests queued and not submitted yet */
+    unsigned int ninflight;
+    /* Requests queued or submitted that have not completed */
+    unsigned int nreads;
+    unsigned int nwritesInFlight;
+
+    UringRequest *readReqs;
+    struct iovec *readIov;
+    DiskHeader *headers;
+    unsigned int readCapacity;
+    char *readBuffer;
+    /* Requests, iovecs and headers of the path being read */
+
+    UringRequest *writeReqs;
+    struct iovec *writeIov;
+    PendingRun *runs;
+    char *writeBuffer;
+    unsigned int nruns;
+    unsigned int writeCapacity;
+    /* Requests and records of the last path written */
+};
+
+static FileHandler fileInit(const char *filename, unsigned int nblocks,
+                            unsigned int blocksize, unsigned int locationSize,
+                            void* appData);
+
+static void fileRead(FileHandler fhandler, PLBlock block,
+                     const char *fileName, const BlockNumber ob_blkno,
+                     void* appData);
+
+static void fileWrite(FileHandler fhandler, const PLBlock block,
+                      const char *fileName, const BlockNumber ob_blkno,
+                      void* appData);
+
+static void fileClose(FileHandler fhandler, const char *filename,
+                      void* appData);
+
+static void fileReadPath(FileHandler fhandler, PLBList blocks,
+                         const char *fileName, const BlockNumber *ob_blknos,
+                         unsigned int nblocks, void* appData);
+
+static void fileWritePath(FileHandler fhandler, const PLBList blocks,
+                          const char *fileName, const BlockNumber *ob_blknos,
+                          unsigned int nblocks, void* appData);
+
+static void *allocFile(void *ptr, size_t size);
+
+static char *allocBuffer(FileHandler handler, char *ptr, unsigned int nrecords);
+
+static void ioFailed(const char *operation);
+
+static void setupRing(FileHandler handler);
+
+static void queueRequest(FileHandler handler, UringRequest *request);
+
+static void enterRing(FileHandler handler, unsigned int minComplete);
+
+static void completeRequest(FileHandler handler, UringRequest *request, int result);
+
+static void transferRest(FileHandler handler, UringRequest *request, size_t done);
+
+static void writeRecords(FileHandler handler, const PLBList blocks,
+                         const BlockNumber *ob_blknos, unsigned int nblocks,
+                         unsigned int async);
+
+static void drainWrites(FileHandler handler);
+
+static char *findPending(FileHandler handler, BlockNumber ob_blkno);
+
+
+void *
+allocFile(void *ptr, size_t size)
+{
+    void *result;
+    int save_errno = errno;
+
+    errno = 0;
+    result = realloc(ptr, size);
+
+    if(result == NULL && errno == ENOMEM)
+    {
+        logger(OUT_OF_MEMORY, "Out of memory allocating io_uring file\n");
+        errno = save_errno;
+        abort();
+    }
+    errno = save_errno;
+
+    return result;
+}
+
+/*
+ * Replaces ptr by a buffer of nrecords records, aligned for O_DIRECT if it is
+ * used. The content of the buffer is not kept.
+ */
+char *
+allocBuffer(FileHandler handler, char *ptr, unsigned int nrecords)
+{
+#if defined(DISKFILE_DIRECT) && defined(O_DIRECT)
+    void *result;
+
+    free(ptr);
+    if (posix_memalign(&result, DISKFILE_ALIGNMENT,
+                       handler->recordSize * nrecords) != 0)
+    {
+        logger(OUT_OF_MEMORY, "Out of memory allocating io_uring file buffer\n");
+        abort();
+    }
+    return (char *) result;
+#else
+    return (char *) allocFile(ptr, handler->recordSize * nrecords);
+#endif
+}
+
+void
+ioFailed(const char *operation)
+{
+    logger(DEBUG, "io_uring file %s failed: %s\n", operation, strerror(errno));
+    abort();
+}
+
+/*
+ * Creates the io_uring instance and maps its submission and completion
+ * queues.
+ */
+void
+setupRing(FileHandler handler)
+{
+    struct io_uring_params params;
+    char *sq;
+    char *cq;
+
+    memset(&params, 0, sizeof(params));
+    handler->ringfd = (int) syscall(__NR_io_uring_setup, URINGFILE_QUEUE_DEPTH,
+                                    &params);
+    if (handler->ringfd < 0)
+    {
+        ioFailed("io_uring_setup");
+    }
+
+    handler->sqEntries = params.sq_entries;
+    handler->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    handler->cqRingSize = params.cq_off.cqes
+        + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (handler->cqRingSize > handler->sqRingSize)
+            handler->sqRingSize = handler->cqRingSize;
+        handler->cqRingSize = handler->sqRingSize;
+    }
+
+    handler->sqRing = mmap(NULL, handler->sqRingSize, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, handler->ringfd,
+                           IORING_OFF_SQ_RING);
+    if (handler->sqRing == MAP_FAILED)
+    {
+        ioFailed("mmap of the submission queue");
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        handler->cqRing = handler->sqRing;
+    }
+    else
+    {
+        handler->cqRing = mmap(NULL, handler->cqRingSize, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, handler->ringfd,
+                               IORING_OFF_CQ_RING);
+        if (handler->cqRing == MAP_FAILED)
+        {
+            ioFailed("mmap of the completion queue");
+        }
+    }
+
+    handler->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    handler->sqes = mmap(NULL, handler->sqesSize, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, handler->ringfd,
+                         IORING_OFF_SQES);
+    if (handler->sqes == MAP_FAILED)
+    {
+        ioFailed("mmap of the submission entries");
+    }
+
+    sq = (char *) handler->sqRing;
+    cq = (char *) handler->cqRing;
+    handler->sqTail = (unsigned int *) (sq + params.sq_off.tail);
+    handler->sqMask = (unsigned int *) (sq + params.sq_off.ring_mask);
+    handler->sqArray = (unsigned int *) (sq + params.sq_off.array);
+    handler->cqHead = (unsigned int *) (cq + params.cq_off.head);
+    handler->cqTail = (unsigned int *) (cq + params.cq_off.tail);
+    handler->cqMask = (unsigned int *) (cq + params.cq_off.ring_mask);
+    handler->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+}
+
+FileHandler fileInit(const char *filename, unsigned int nblocks,
+                     unsigned int blocksize, unsigned int locationSize,
+                     void* appData) {
+
+    FileHandler handler;
+    char *path;
+    size_t pathlen;
+
+    handler = (FileHandler) allocFile(NULL, sizeof(struct FileHandler));
+    memset(handler, 0, sizeof(struct FileHandler));
+
+    handler->nblocks = nblocks;
+    handler->blockSize = blocksize;
+    handler->recordSize = sizeof(DiskHeader) + blocksize;
+
+    pathlen = diskFilePathSize(filename);
+    path = (char *) allocFile(NULL, pathlen);
+    formatDiskFilePath(path, pathlen, filename);
+
+#if defined(DISKFILE_DIRECT) && defined(O_DIRECT)
+    handler->recordSize = (handler->recordSize + DISKFILE_ALIGNMENT - 1)
+        / DISKFILE_ALIGNMENT * DISKFILE_ALIGNMENT;
+
+    handler->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_DIRECT, 0600);
+
+    /* Some file systems, e.g., tmpfs, do not support O_DIRECT */
+    if (handler->fd < 0 && errno == EINVAL)
+    {
+        logger(DEBUG, "O_DIRECT is not supported for %s\n", path);
+        handler->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    }
+#else
+    handler->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+#endif
+    if (handler->fd < 0)
+    {
+        ioFailed("open");
+    }
+    free(path);
+
+    /* The file is sparse, every slot holds a dummy block */
+    if (ftruncate(handler->fd, (off_t) handler->recordSize * nblocks) != 0)
+    {
+        ioFailed("ftruncate");
+    }
+
+    setupRing(handler);
+
+    return handler;
+}
+
+/*
+ * Adds request to the submission queue. If the queue depth is reached, the
+ * queued requests are submitted and a request is waited for.
+ */
+void
+queueRequest(FileHandler handler, UringRequest *request)
+{
+    unsigned int tail;
+    unsigned int index;
+    struct io_uring_sqe *sqe;
+
+    while (handler->ninflight >= handler->sqEntries)
+    {
+        enterRing(handler, 1);
+    }
+
+    tail = *handler->sqTail;
+    index = tail & *handler->sqMask;
+    sqe = &handler->sqes[index];
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = request->write ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe->fd = handler->fd;
+    sqe->addr = (uint64_t) (uintptr_t) request->iov;
+    sqe->len = request->iovcnt;
+    sqe->off = request->offset;
+    sqe->user_data = (uint64_t) (uintptr_t) request;
+
+    handler->sqArray[index] = index;
+    __atomic_store_n(handler->sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    handler->nqueued++;
+    handler->ninflight++;
+    if (request->write)
+        handler->nwritesInFlight++;
+    else
+        handler->nreads++;
+}
+
+/*
+ * Submits the queued requests, waits for minComplete completions and
+ * processes every completion available.
+ */
+void
+enterRing(FileHandler handler, unsigned int minComplete)
+{
+    int submitted;
+    unsigned int head;
+    struct io_uring_cqe *cqe;
+
+    do
+    {
+        submitted = (int) syscall(__NR_io_uring_enter, handler->ringfd,
+                                  handler->nqueued, minComplete,
+                                  minComplete > 0 ? IORING_ENTER_GETEVENTS : 0,
+                                  NULL, 0);
+        if (submitted < 0 && errno != EINTR)
+        {
+            ioFailed("io_uring_enter");
+        }
+        if (submitted > 0)
+        {
+            handler->nqueued -= submitted;
+        }
+    } while (submitted < 0 || handler->nqueued > 0);
+
+    head = *handler->cqHead;
+    while (head != __atomic_load_n(handler->cqTail, __ATOMIC_ACQUIRE))
+    {
+        cqe = &handler->cqes[head & *handler->cqMask];
+        completeRequest(handler, (UringRequest *) (uintptr_t) cqe->user_data,
+                        cqe->res);
+        head++;
+    }
+    __atomic_store_n(handler->cqHead, head, __ATOMIC_RELEASE);
+}
+
+/*
+ * Accounts for a completed request. A short transfer is finished
+ * synchronously.
+ */
+void
+completeRequest(FileHandler handler, UringRequest *request, int result)
+{
+    if (result < 0)
+    {
+        errno = -result;
+        ioFailed(request->write ? "write" : "read");
+    }
+
+    transferRest(handler, request, result);
+
+    handler->ninflight--;
+    if (request->write)
+        handler->nwritesInFlight--;
+    else
+        handler->nreads--;
+}
+
+/*
+ * Transfers the bytes of request after the first done ones with preadv or
+ * pwritev.
+ */
+void
+transferRest(FileHandler handler, UringRequest *request, size_t done)
+{
+    struct iovec *iov = request->iov;
+    int iovcnt = request->iovcnt;
+    off_t offset = request->offset;
+    size_t remaining = request->length;
+    ssize_t result;
+
+    for (;;)
+    {
+        offset += done;
+        remaining -= done;
+        while (iovcnt > 0 && (size_t) done >= iov->iov_len)
+        {
+            done -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (remaining == 0)
+        {
+            break;
+        }
+        iov->iov_base = (char *) iov->iov_base + done;
+        iov->iov_len -= done;
+
+        if (request->write)
+            result = pwritev(handler->fd, iov, iovcnt, offset);
+        else
+            result = preadv(handler->fd, iov, iovcnt, offset);
+
+        if (result < 0 && errno == EINTR)
+        {
+            result = 0;
+        }
+        else if (result <= 0)
+        {
+            ioFailed(request->write ? "pwritev" : "preadv");
+        }
+        done = result;
+    }
+}
+
+void
+drainWrites(FileHandler handler)
+{
+    while (handler->nwritesInFlight > 0)
+    {
+        enterRing(handler, handler->nwritesInFlight);
+    }
+}
+
+/*
+ * Returns the record of ob_blkno in the write buffer or NULL if the slot was
+ * not written by the last ofilewritepath.
+ */
+char *
+findPending(FileHandler handler, BlockNumber ob_blkno)
+{
+    unsigned int index;
+    PendingRun *run;
+
+    for (index = 0; index < handler->nruns; index++)
+    {
+        run = &handler->runs[index];
+        if (ob_blkno >= run->start && ob_blkno < run->start + (BlockNumber) run->nblocks)
+        {
+            return run->data + handler->recordSize * (ob_blkno - run->start);
+        }
+    }
+
+    return NULL;
+}
+
+void
+fileReadPath(FileHandler handler, PLBList blocks, const char *fileName,
+             const BlockNumber *ob_blknos, unsigned int nblocks, void* appData) {
+
+    unsigned int index;
+    unsigned int nreqs = 0;
+    unsigned int niov = 0;
+    unsigned int runLength = 0;
+    char *record;
+    UringRequest *request = NULL;
+
+    if (nblocks > handler->readCapacity)
+    {
+        handler->readCapacity = nblocks;
+        handler->readReqs = (UringRequest *) allocFile(handler->readReqs,
+                                                       sizeof(UringRequest) * nblocks);
+        handler->readIov = (struct iovec *) allocFile(handler->readIov,
+                                                      sizeof(struct iovec) * 2 * nblocks);
+        handler->headers = (DiskHeader *) allocFile(handler->headers,
+                                                    sizeof(DiskHeader) * nblocks);
+#if defined(DISKFILE_DIRECT) && defined(O_DIRECT)
+        handler->readBuffer = allocBuffer(handler, handler->readBuffer, nblocks);
+#endif
+    }
+
+    for (index = 0; index < nblocks; index++)
+    {
+        if (blocks[index]->block == NULL)
+        {
+            blocks[index]->block = allocFile(NULL, handler->blockSize);
+        }
+
+        record = findPending(handler, ob_blknos[index]);
+        if (record != NULL)
+        {
+            decodeDiskHeader(blocks[index], (DiskHeader *) record, handler->blockSize);
+            memcpy(blocks[index]->block, record + sizeof(DiskHeader),
+                   handler->blockSize);
+            /* Marks the slot as read, stored blknos are not negative */
+            handler->headers[index].blkno = -1;
+            request = NULL;
+            continue;
+        }
+
+        /* Extends the request of the previous slot if they are consecutive */
+        if (request == NULL || runLength == URINGFILE_MAX_RUN
+            || ob_blknos[index] != ob_blknos[index - 1] + 1)
+        {
+            request = &handler->readReqs[nreqs++];
+            request->iov = &handler->readIov[niov];
+            request->iovcnt = 0;
+            request->write = 0;
+            request->offset = (off_t) handler->recordSize * ob_blknos[index];
+            request->length = 0;
+            runLength = 0;
+        }
+
+        if (handler->readBuffer != NULL)
+        {
+            /* The records of a request are consecutive in the buffer */
+            if (request->iovcnt == 0)
+            {
+                handler->readIov[niov].iov_base = handler->readBuffer
+                    + handler->recordSize * index;
+                handler->readIov[niov].iov_len = 0;
+                niov++;
+                request->iovcnt = 1;
+            }
+            request->iov->iov_len += handler->recordSize;
+            handler->headers[index].blkno = 0;
+        }
+        else
+        {
+            handler->readIov[niov].iov_base = &handler->headers[index];
+            handler->readIov[niov].iov_len = sizeof(DiskHeader);
+            handler->readIov[niov + 1].iov_base = blocks[index]->block;
+            handler->readIov[niov + 1].iov_len = handler->blockSize;
+            niov += 2;
+            request->iovcnt += 2;
+        }
+        request->length += handler->recordSize;
+        runLength++;
+    }
+
+    for (index = 0; index < nreqs; index++)
+    {
+        queueRequest(handler, &handler->readReqs[index]);
+    }
+
+    /* Submits the path and waits for it with a single system call */
+    while (handler->nreads > 0)
+    {
+        enterRing(handler, handler->nreads);
+    }
+
+    for (index = 0; index < nblocks; index++)
+    {
+        if (handler->headers[index].blkno < 0)
+        {
+            continue;
+        }
+
+        if (handler->readBuffer != NULL)
+        {
+            record = handler->readBuffer + handler->recordSize * index;
+            decodeDiskHeader(blocks[index], (DiskHeader *) record, handler->blockSize);
+            memcpy(blocks[index]->block, record + sizeof(DiskHeader),
+                   handler->blockSize);
+        }
+        else
+        {
+            decodeDiskHeader(blocks[index], &handler->headers[index], handler->blockSize);
+        }
+    }
+}
+
+/*
+ * Copies the blocks to the write buffer and writes them. Asynchronous writes
+ * are submitted and not waited for.
+ */
+void
+writeRecords(FileHandler handler, const PLBList blocks,
+             const BlockNumber *ob_blknos, unsigned int nblocks,
+             unsigned int async)
+{
+    unsigned int index;
+    char *record;
+    DiskHeader *header;
+    PendingRun *run = NULL;
+    UringRequest *request;
+
+    /* The buffer of the previous path is reused once it is written */
+    drainWrites(handler);
+    handler->nruns = 0;
+
+    if (nblocks > handler->writeCapacity)
+    {
+        handler->writeCapacity = nblocks;
+        handler->writeReqs = (UringRequest *) allocFile(handler->writeReqs,
+                                                        sizeof(UringRequest) * nblocks);
+        handler->writeIov = (struct iovec *) allocFile(handler->writeIov,
+                                                       sizeof(struct iovec) * nblocks);
+        handler->runs = (PendingRun *) allocFile(handler->runs,
+                                                 sizeof(PendingRun) * nblocks);
+        handler->writeBuffer = allocBuffer(handler, handler->writeBuffer, nblocks);
+    }
+
+    for (index = 0; index < nblocks; index++)
+    {
+        record = handler->writeBuffer + handler->recordSize * index;
+        header = (DiskHeader *) record;
+
+        encodeDiskHeader(header, blocks[index]);
+        memcpy(record + sizeof(DiskHeader), blocks[index]->block,
+               blocks[index]->size);
+        memset(record + sizeof(DiskHeader) + blocks[index]->size, 0,
+               handler->recordSize - sizeof(DiskHeader) - blocks[index]->size);
+
+        if (run == NULL || ob_blknos[index] != ob_blknos[index - 1] + 1)
+        {
+            run = &handler->runs[handler->nruns++];
+            run->start = ob_blknos[index];
+            run->nblocks = 0;
+            run->data = record;
+        }
+        run->nblocks++;
+    }
+
+    for (index = 0; index < handler->nruns; index++)
+    {
+        run = &handler->runs[index];
+        request = &handler->writeReqs[index];
+
+        handler->writeIov[index].iov_base = run->data;
+        handler->writeIov[index].iov_len = handler->recordSize * run->nblocks;
+        request->iov = &handler->writeIov[index];
+        request->iovcnt = 1;
+        request->write = 1;
+        request->offset = (off_t) handler->recordSize * run->start;
+        request->length = handler->writeIov[index].iov_len;
+
+        if (async)
+            queueRequest(handler, request);
+        else
+            transferRest(handler, request, 0);
+    }
+
+    if (async)
+    {
+        /* Submits the writes without waiting for them */
+        enterRing(handler, 0);
+    }
+
+    handler->nwrites++;
+
+#if DISKFILE_SYNC_PERIOD > 0
+    if (handler->nwrites >= DISKFILE_SYNC_PERIOD)
+    {
+        drainWrites(handler);
+        if (fdatasync(handler->fd) != 0)
+        {
+            ioFailed("fdatasync");
+        }
+        handler->nwrites = 0;
+    }
+#endif
+}
+
+void
+fileWritePath(FileHandler handler, const PLBList blocks, const char *fileName,
+              const BlockNumber *ob_blknos, unsigned int nblocks, void* appData) {
+
+    writeRecords(handler, blocks, ob_blknos, nblocks, 1);
+}
+
+void
+fileRead(FileHandler handler, PLBlock block, const char *fileName,
+         const BlockNumber ob_blkno, void* appData) {
+
+    fileReadPath(handler, &block, fileName, &ob_blkno, 1, appData);
+}
+
+void
+fileWrite(FileHandler handler, const PLBlock block, const char *fileName,
+          const BlockNumber ob_blkno, void* appData) {
+
+    PLBlock aux = block;
+
+    /*
+     * Constructions that write a slot at a time, e.g., Ring ORAM, wait for
+     * each write, so it is not worth a round trip through the ring.
+     */
+    writeRecords(handler, &aux, &ob_blkno, 1, 0);
+}
+
+
+void
+fileClose(FileHandler handler, const char * filename, void* appData){
+
+    drainWrites(handler);
+
+    if (fdatasync(handler->fd) != 0)
+    {
+        ioFailed("fdatasync");
+    }
+    close(handler->fd);
+
+    munmap(handler->sqes, handler->sqesSize);
+    if (handler->cqRing != handler->sqRing)
+    {
+        munmap(handler->cqRing, handler->cqRingSize);
+    }
+    munmap(handler->sqRing, handler->sqRingSize);
+    close(handler->ringfd);
+
+    free(handler->readReqs);
+    free(handler->readIov);
+    free(handler->headers);
+    free(handler->readBuffer);
+    free(handler->writeReqs);
+    free(handler->writeIov);
+    free(handler->runs);
+    free(handler->writeBuffer);
+    free(handler);
+}
+
+AMOFile *OFILE_CREATE(void) {
+    AMOFile *file = (AMOFile *) malloc(sizeof(AMOFile));
+    file->ofileinit = &fileInit;
+    file->ofileread = &fileRead;
+    file->ofilewrite = &fileWrite;
+    file->ofileclose = &fileClose;
+    return file;
+}
+
+AMOFileExt *OFILE_EXT_CREATE(void) {
+    AMOFileExt *ext = (AMOFileExt *) malloc(sizeof(AMOFileExt));
+    ext->ofilereadpath = &fileReadPath;
+    ext->ofilewritepath = &fileWritePath;
+    return ext;
+}
@@ -0,0 +1,804 @@
+/*-------------------------------------------------------------------------
+ *
+ * circuitoram.c
+ *		  Implementation of non-recursive circuit-oram algorithm.
+ *
+ *		Original paper URL: https://eprint.iacr.org/2014/672.pdf
+ *
+ * Circuit ORAM keeps the tree and the position map of Path ORAM but replaces
+ * its eviction. An access reads the path of the requested block, removes the
+ * block from it and writes the path back. The block is then added to the
+ * stash and the stash is evicted along two paths, chosen in reverse
+ * lexicographic order.
+ *
+ * Each eviction treats the stash as the bucket above the root and moves at
+ * most one block per bucket towards the leaf. The blocks to move are chosen
+ * by two passes over the metadata of the path (PrepareDeepest and
+ * PrepareTarget) and then moved by a single pass from the stash to the leaf
+ * that holds at most one block at a time (EvictOnceFast). Since the stash
+ * only needs to hold a constant number of blocks, it is initialized with
+ * CIRCUITORAM_STASH_SIZE slots.
+ *
+ * As in pathoram.c, the only errors this library takes into account are out
+ * of memory errors, in which case the execution is aborted.
+ *
+ * Copyright (c) 2018-2020, HASLab
+ *
+ * IDENTIFICATION
+ *		  backend/oram/circuitoram.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "oram/oram.h"
+#include "oram/coram.h"
+#include "oram/logger.h"
+#include "oram/orandom.h"
+#include "oram/pmapdefs/pdeforam.h"
+
+/* Number of blocks the stash is initialized to hold */
+#ifndef CIRCUITORAM_STASH_SIZE
+#define CIRCUITORAM_STASH_SIZE 32
+#endif
+
+/* Number of evictions per access */
+#define CIRCUITORAM_EVICTIONS 2
+
+/* Empty value of the level arrays, as the stash is level -1 */
+#define NO_LEVEL -2
+
+
+typedef unsigned int TreeNode;
+
+typedef TreeNode *TreePath;
+
+struct ORAMState
+{
+	unsigned int blockSize;
+	/* Size of a single block in Bytes(B) */
+	unsigned int treeHeight;
+	/* Tree Height of the oblivious file(L) */
+	unsigned int bucketCapacity;
+	/* Number of buckets in a Tree node(Z) */
+
+	unsigned int nblocks;
+
+	char	   *file;
+	/* File name of the protected file. */
+
+	Amgr	   *amgr;
+
+	/* Set of external functions to handle ORAM states. */
+	AMOFileExt *ofileExt;
+	AMPMapExt  *pmapExt;
+	/* Optional operations of am_ofile and am_pmap, NULL until set */
+	Stash		stash;
+	PMap		pmap;
+	FileHandler fhandler;
+
+	unsigned int evictions;
+	/* Number of evictions, determines the next eviction path */
+
+	BlockPool	pool;
+	/* Blocks read from the oblivious file and stashed */
+	TreePath	path;
+	PLBList		pathBlocks;
+	/* Path being accessed, the slot k of level i is i*Z+k */
+
+	int		   *deepest;
+	int		   *target;
+	/*
+	 * Metadata of an eviction, indexed by level + 1 so that the stash is at
+	 * index 0.
+	 */
+	int		   *bucketDeepest;
+	/* Slot of the block of each bucket that can go deepest, or -1 */
+	int		   *bucketDeepestLevel;
+	/* Level that block can go to, or NO_LEVEL */
+
+	PLBlock		dummyBlock;
+	/* Block that fills the empty slots of a path */
+
+#ifdef STASH_COUNT
+	unsigned int max;
+	unsigned int nblocksStash;
+#endif
+};
+
+
+/* non-export function prototypes */
+
+static unsigned int calculateTreeHeight(unsigned int minimumNumberOfNodes);
+
+static void *allocate(size_t size);
+
+static TreePath getTreePath(ORAMState state, unsigned int leaf);
+
+static void readPath(ORAMState state, unsigned int leaf, void *appData);
+
+static void writePath(ORAMState state, void *appData);
+
+static void readAndRemove(ORAMState state, unsigned int leaf, BlockNumber blkno,
+                          void *appData);
+
+static PLBlock prepareDeepest(ORAMState state, unsigned int leaf, void *appData);
+
+static void prepareTarget(ORAMState state);
+
+static void evictOnceFast(ORAMState state, PLBlock stashDeepest, void *appData);
+
+static void evict(ORAMState state, void *appData);
+
+static void updateStashWithNewBlock(void *data, unsigned int blockSize,
+                                    BlockNumber blkno, ORAMState state,
+                                    Location location, void *appData);
+
+
+ORAMState
+init_oram(const char *file, unsigned int nblocks, unsigned int blockSize, unsigned int bucketCapacity, Amgr *amgr, void *appData)
+{
+	unsigned int treeHeight;
+	unsigned int totalNodes;
+	int			namelen;
+	ORAMState	state = NULL;
+
+	treeHeight = calculateTreeHeight(nblocks);
+	totalNodes = ((unsigned int) pow(2, treeHeight + 1)) - 1;
+
+	logger(DEBUG, "Init circuitoram for %d blocks with tree height %d and bucket capacity %d\n",
+           nblocks, treeHeight, bucketCapacity);
+
+	/*
+	 * With a single slot per bucket, blocks pile up in the stash faster than
+	 * two evictions per access move them out and CIRCUITORAM_STASH_SIZE is not
+	 * enough for a fixed-capacity stash.
+	 */
+	if (bucketCapacity < 2)
+	{
+		logger(DEBUG, "Circuit ORAM requires a bucket capacity of at least 2, got %d\n",
+               bucketCapacity);
+		abort();
+	}
+
+	state = (ORAMState) allocate(sizeof(struct ORAMState));
+	state->blockSize = blockSize;
+	state->treeHeight = treeHeight;
+	state->bucketCapacity = bucketCapacity;
+	state->nblocks = nblocks;
+	state->evictions = 0;
+	namelen = strlen(file) + 1;
+	state->file = (char *) allocate(namelen);
+	memcpy(state->file, file, namelen);
+	state->amgr = amgr;
+	state->ofileExt = NULL;
+	state->pmapExt = NULL;
+
+	struct TreeConfig config;
+
+	config.treeHeight = treeHeight;
+
+	state->stash = amgr->am_stash->stashinit(state->file, CIRCUITORAM_STASH_SIZE,
+                                             state->blockSize, appData);
+	state->pmap = amgr->am_pmap->pminit(state->file, nblocks, &config);
+
+	state->path = (TreePath) allocate(sizeof(TreeNode) * (treeHeight + 1));
+	state->pathBlocks = (PLBList) allocate(sizeof(PLBlock) * (treeHeight + 1) * bucketCapacity);
+	state->deepest = (int *) allocate(sizeof(int) * (treeHeight + 2));
+	state->target = (int *) allocate(sizeof(int) * (treeHeight + 2));
+	state->bucketDeepest = (int *) allocate(sizeof(int) * (treeHeight + 1));
+	state->bucketDeepestLevel = (int *) allocate(sizeof(int) * (treeHeight + 1));
+
+	state->pool = createBlockPool((treeHeight + 1) * bucketCapacity + CIRCUITORAM_STASH_SIZE,
+                                  blockSize);
+	state->dummyBlock = createRandomBlock(blockSize, sizeof(struct Location));
+
+#ifdef STASH_COUNT
+	state->max = 0;
+	state->nblocksStash = 0;
+#endif
+
+	state->fhandler = amgr->am_ofile->ofileinit(state->file,
+                                                totalNodes * bucketCapacity,
+                                                blockSize,
+                                                sizeof(struct Location),
+                                                appData);
+
+	return state;
+}
+
+void *
+allocate(size_t size)
+{
+	int			save_errno = 0;
+	void	   *ptr;
+
+	save_errno = errno;
+	errno = 0;
+	ptr = malloc(size);
+
+	if (ptr == NULL && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out Of Memory building circuitoram state\n");
+		errno = save_errno;
+		abort();
+	}
+	errno = save_errno;
+
+	return ptr;
+}
+
+/*
+ * Minimum tree height to store nblocks. See calculateTreeHeight in
+ * pathoram.c.
+ */
+unsigned int
+calculateTreeHeight(unsigned int nblocks)
+{
+	unsigned int height,
+				nNodes;
+
+	height = (unsigned int) ceil(log2(nblocks));
+	nNodes = (unsigned int) pow(2, height);
+
+	if (nNodes - 1 >= nblocks)
+	{
+		return height - 1;
+	}
+	else
+	{
+		return height;
+	}
+}
+
+/*
+ * Fills the path buffer of the state with the tree nodes from the root
+ * (level 0) to the input leaf. See getTreePath in pathoram.c.
+ */
+TreePath
+getTreePath(ORAMState state, unsigned int leaf)
+{
+	unsigned int currentPos = 0;
+	unsigned int currentHeight = state->treeHeight;
+	TreePath	path = state->path;
+
+	currentPos = leaf + (1 << (state->treeHeight));
+
+	while (currentPos > 0)
+	{
+		path[currentHeight] = currentPos - 1;
+		currentHeight--;
+		currentPos >>= 1;
+	}
+
+	return path;
+}
+
+/*
+ * Reads the path to leaf into the path buffer. Dummy blocks are replaced by
+ * the dummy block of the state, so empty slots are the ones with a dummy
+ * block number.
+ */
+void
+readPath(ORAMState state, unsigned int leaf, void *appData)
+{
+	unsigned int level;
+	unsigned int offset;
+	unsigned int index;
+	PLBlock		plblock;
+	void	   *payload;
+	TreePath	path = getTreePath(state, leaf);
+
+	for (level = 0; level <= state->treeHeight; level++)
+	{
+		for (offset = 0; offset < state->bucketCapacity; offset++)
+		{
+			index = level * state->bucketCapacity + offset;
+			plblock = createEmptyPooledBlock(state->pool);
+			payload = state->ofileExt == NULL ? detachPayload(plblock) : NULL;
+
+			state->amgr->am_ofile->ofileread(state->fhandler, plblock, state->file,
+                                             path[level] * state->bucketCapacity + offset,
+                                             appData);
+			if (payload != NULL)
+			{
+				attachPayload(plblock, payload);
+			}
+
+			if (plblock->blkno == DUMMY_BLOCK)
+			{
+				freeBlock(plblock);
+				plblock = state->dummyBlock;
+			}
+			state->pathBlocks[index] = plblock;
+		}
+	}
+}
+
+/*
+ * Writes the path buffer back to the path it was read from and releases its
+ * real blocks.
+ */
+void
+writePath(ORAMState state, void *appData)
+{
+	unsigned int level;
+	unsigned int offset;
+	PLBlock		plblock;
+
+	for (level = 0; level <= state->treeHeight; level++)
+	{
+		for (offset = 0; offset < state->bucketCapacity; offset++)
+		{
+			plblock = state->pathBlocks[level * state->bucketCapacity + offset];
+
+			state->amgr->am_ofile->ofilewrite(state->fhandler, plblock, state->file,
+                                              state->path[level] * state->bucketCapacity + offset,
+                                              appData);
+
+			if (plblock->blkno != DUMMY_BLOCK)
+			{
+				freeBlock(plblock);
+			}
+		}
+	}
+}
+
+/*
+ * Reads the path to leaf, moves the requested block from the path to the
+ * stash if it is there and writes the path back.
+ */
+void
+readAndRemove(ORAMState state, unsigned int leaf, BlockNumber blkno, void *appData)
+{
+	unsigned int index;
+	PLBlock		plblock;
+
+	readPath(state, leaf, appData);
+
+	for (index = 0; index < (state->treeHeight + 1) * state->bucketCapacity; index++)
+	{
+		plblock = state->pathBlocks[index];
+
+		if (plblock->blkno != DUMMY_BLOCK && (BlockNumber) plblock->blkno == blkno)
+		{
+#ifdef STASH_COUNT
+			state->nblocksStash += 1;
+			state->max = state->max < state->nblocksStash ? state->nblocksStash : state->max;
+#endif
+			state->amgr->am_stash->stashadd(state->stash, state->file, plblock, appData);
+			state->pathBlocks[index] = state->dummyBlock;
+		}
+	}
+
+	writePath(state, appData);
+}
+
+/*
+ * First metadata pass, from the stash to the leaf. deepest[i] is the highest
+ * level above i holding a block that can be moved to level i or below. Also
+ * records, for each bucket, the block that can go deepest in the eviction
+ * path and returns the one of the stash.
+ */
+PLBlock
+prepareDeepest(ORAMState state, unsigned int leaf, void *appData)
+{
+	int			level;
+	int			src = NO_LEVEL;
+	int			goal = NO_LEVEL;
+	int			blockLevel;
+	unsigned int offset;
+	PLBlock		plblock;
+	PLBlock		stashDeepest = NULL;
+	AMStash    *stash = state->amgr->am_stash;
+
+	stash->stashstartIt(state->stash, state->file, appData);
+
+	while (stash->stashnext(state->stash, state->file, &plblock, appData))
+	{
+		checkBlock(plblock, state->pool);
+		blockLevel = (int) getDeepestLevel(state->treeHeight, plblock->location[0], leaf);
+
+		if (blockLevel > goal)
+		{
+			goal = blockLevel;
+			stashDeepest = plblock;
+		}
+	}
+
+	stash->stashcloseIt(state->stash, state->file, appData);
+
+	if (stashDeepest != NULL)
+	{
+		src = -1;
+	}
+
+	state->deepest[0] = NO_LEVEL;
+
+	for (level = 0; level <= (int) state->treeHeight; level++)
+	{
+		state->deepest[level + 1] = goal >= level ? src : NO_LEVEL;
+		state->bucketDeepest[level] = -1;
+		state->bucketDeepestLevel[level] = NO_LEVEL;
+
+		for (offset = 0; offset < state->bucketCapacity; offset++)
+		{
+			plblock = state->pathBlocks[level * state->bucketCapacity + offset];
+
+			if (plblock->blkno == DUMMY_BLOCK)
+				continue;
+
+			blockLevel = (int) getDeepestLevel(state->treeHeight, plblock->location[0], leaf);
+
+			if (blockLevel > state->bucketDeepestLevel[level])
+			{
+				state->bucketDeepestLevel[level] = blockLevel;
+				state->bucketDeepest[level] = offset;
+			}
+		}
+
+		if (state->bucketDeepestLevel[level] > goal)
+		{
+			goal = state->bucketDeepestLevel[level];
+			src = level;
+		}
+	}
+
+	return stashDeepest;
+}
+
+/*
+ * Second metadata pass, from the leaf to the stash. target[i] is the level
+ * where the block picked up at level i is dropped, so that every dropped
+ * block lands on an empty slot or on a slot freed by a block picked up at
+ * the same level.
+ */
+void
+prepareTarget(ORAMState state)
+{
+	int			level;
+	int			dest = NO_LEVEL;
+	int			src = NO_LEVEL;
+	int			hasEmpty;
+	unsigned int offset;
+
+	for (level = (int) state->treeHeight; level >= -1; level--)
+	{
+		state->target[level + 1] = NO_LEVEL;
+
+		if (level == src)
+		{
+			state->target[level + 1] = dest;
+			dest = NO_LEVEL;
+			src = NO_LEVEL;
+		}
+
+		hasEmpty = 0;
+
+		if (level >= 0)
+		{
+			for (offset = 0; offset < state->bucketCapacity; offset++)
+			{
+				if (state->pathBlocks[level * state->bucketCapacity + offset]->blkno == DUMMY_BLOCK)
+					hasEmpty = 1;
+			}
+		}
+
+		if (((dest == NO_LEVEL && hasEmpty) || state->target[level + 1] != NO_LEVEL)
+			&& state->deepest[level + 1] != NO_LEVEL)
+		{
+			src = state->deepest[level + 1];
+			dest = level;
+		}
+	}
+}
+
+/*
+ * Single pass from the stash to the leaf that picks up the deepest block of
+ * every level with a target and drops it on its target level.
+ */
+void
+evictOnceFast(ORAMState state, PLBlock stashDeepest, void *appData)
+{
+	int			level;
+	int			dest = NO_LEVEL;
+	unsigned int offset;
+	PLBlock		hold = NULL;
+	PLBlock		towrite;
+	PLBList		bucket;
+
+	for (level = -1; level <= (int) state->treeHeight; level++)
+	{
+		towrite = NULL;
+
+		if (hold != NULL && level == dest)
+		{
+			towrite = hold;
+			hold = NULL;
+			dest = NO_LEVEL;
+		}
+
+		if (state->target[level + 1] != NO_LEVEL)
+		{
+			if (level == -1)
+			{
+				hold = stashDeepest;
+#ifdef STASH_COUNT
+				state->nblocksStash -= 1;
+#endif
+				state->amgr->am_stash->stashremove(state->stash, state->file,
+                                                   hold, appData);
+			}
+			else
+			{
+				bucket = &state->pathBlocks[level * state->bucketCapacity];
+				hold = bucket[state->bucketDeepest[level]];
+				bucket[state->bucketDeepest[level]] = state->dummyBlock;
+			}
+			dest = state->target[level + 1];
+		}
+
+		if (towrite != NULL)
+		{
+			bucket = &state->pathBlocks[level * state->bucketCapacity];
+
+			for (offset = 0; offset < state->bucketCapacity; offset++)
+			{
+				if (bucket[offset]->blkno == DUMMY_BLOCK)
+				{
+					bucket[offset] = towrite;
+					break;
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Evicts the stash along the next path in reverse lexicographic order.
+ */
+void
+evict(ORAMState state, void *appData)
+{
+	unsigned int leaf = 0;
+	unsigned int counter;
+	unsigned int bit;
+	PLBlock		stashDeepest;
+
+	counter = state->evictions % (1 << state->treeHeight);
+
+	for (bit = 0; bit < state->treeHeight; bit++)
+	{
+		leaf = (leaf << 1) | ((counter >> bit) & 1);
+	}
+	state->evictions++;
+
+	readPath(state, leaf, appData);
+	stashDeepest = prepareDeepest(state, leaf, appData);
+	prepareTarget(state);
+	evictOnceFast(state, stashDeepest, appData);
+	writePath(state, appData);
+}
+
+void
+updateStashWithNewBlock(void *data, unsigned int blkSize, BlockNumber blkno,
+                        ORAMState state, Location location, void *appData)
+{
+	PLBlock		plblock;
+	int			found = 0;
+
+	if (blkno == DUMMY_BLOCK)
+		return;
+
+	plblock = createPooledBlock(state->pool, (int) blkno, blkSize, data);
+	plblock->location[0] = location->leaf;
+
+	found = state->amgr->am_stash->stashupdate(state->stash, state->file,
+                                               plblock, appData);
+
+#ifdef STASH_COUNT
+	if (!found)
+	{
+		state->nblocksStash += 1;
+		state->max = state->max < state->nblocksStash ? state->nblocksStash : state->max;
+	}
+#endif
+}
+
+
+int
+read_oram(char **ptr, BlockNumber blkno, ORAMState state, void *appData)
+{
+	unsigned int leaf = 0;
+	unsigned int index;
+	int			result = 0;
+	struct Location nLocation;
+	struct PLBlock plblock;
+
+	AMPMap	   *pmap = state->amgr->am_pmap;
+	AMStash    *stash = state->amgr->am_stash;
+
+	if (blkno < 0 || blkno > state->nblocks)
+	{
+		logger(DEBUG, "Requested read_oram on invalid address %d", blkno);
+		abort();
+	}
+
+	memset(&plblock, 0, sizeof(struct PLBlock));
+	plblock.blkno = DUMMY_BLOCK;
+	plblock.size = -1;
+
+	leaf = pmap->pmget(state->pmap, state->file, blkno)->leaf;
+	pmap->pmupdate(state->pmap, state->file, blkno);
+	nLocation.leaf = pmap->pmget(state->pmap, state->file, blkno)->leaf;
+
+	readAndRemove(state, leaf, blkno, appData);
+
+	stash->stashget(state->stash, &plblock, blkno, state->file, appData);
+	updateStashWithNewBlock(plblock.block, plblock.size, plblock.blkno,
+                            state, &nLocation, appData);
+
+	for (index = 0; index < CIRCUITORAM_EVICTIONS; index++)
+	{
+		evict(state, appData);
+	}
+
+	*ptr = plblock.block;
+
+	/* No block has been inserted yet */
+	if (plblock.blkno == DUMMY_BLOCK)
+	{
+		result = DUMMY_BLOCK;
+	}
+	else
+	{
+		result = plblock.size;
+	}
+	return result;
+}
+
+int
+write_oram(char *data, unsigned int blkSize, BlockNumber blkno, ORAMState state, void *appData)
+{
+	unsigned int leaf = 0;
+	unsigned int index;
+	struct Location nLocation;
+
+	AMPMap	   *pmap = state->amgr->am_pmap;
+
+	if (blkno < 0 || blkno > state->nblocks)
+	{
+		logger(DEBUG, "Requested write_oram on invalid address %d", blkno);
+		abort();
+	}
+
+	leaf = pmap->pmget(state->pmap, state->file, blkno)->leaf;
+	pmap->pmupdate(state->pmap, state->file, blkno);
+	nLocation.leaf = pmap->pmget(state->pmap, state->file, blkno)->leaf;
+
+	readAndRemove(state, leaf, blkno, appData);
+	updateStashWithNewBlock(data, blkSize, blkno, state, &nLocation, appData);
+
+	for (index = 0; index < CIRCUITORAM_EVICTIONS; index++)
+	{
+		evict(state, appData);
+	}
+
+	return blkSize;
+}
+
+/*
+ * Evictions in Circuit ORAM are per access, batches are served one request
+ * at a time.
+ */
+int
+read_oram_batch(char **ptrs, int *results, const BlockNumber *blknos,
+                unsigned int nrequests, ORAMState state, void *appData)
+{
+	unsigned int index;
+
+	for (index = 0; index < nrequests; index++)
+	{
+		results[index] = read_oram(&ptrs[index], blknos[index], state, appData);
+	}
+	return nrequests;
+}
+
+int
+write_oram_batch(char **data, const unsigned int *blkSizes, int *results,
+                 const BlockNumber *blknos, unsigned int nrequests,
+                 ORAMState state, void *appData)
+{
+	unsigned int index;
+
+	for (index = 0; index < nrequests; index++)
+	{
+		results[index] = write_oram(data[index], blkSizes[index], blknos[index],
+                                    state, appData);
+	}
+	return nrequests;
+}
+
+void
+close_oram(ORAMState state, void *appData)
+{
+
+#ifdef STASH_COUNT
+	logStashes(state);
+#endif
+	state->amgr->am_stash->stashclose(state->stash, state->file, appData);
+	state->amgr->am_pmap->pmclose(state->pmap, state->file);
+	state->amgr->am_ofile->ofileclose(state->fhandler, state->file, appData);
+	freeBlockPool(state->pool);
+	freeBlock(state->dummyBlock);
+	free(state->path);
+	free(state->pathBlocks);
+	free(state->deepest);
+	free(state->target);
+	free(state->bucketDeepest);
+	free(state->bucketDeepestLevel);
+	free(state->file);
+	free(state->amgr->am_stash);
+	free(state->amgr->am_pmap);
+	free(state->amgr->am_ofile);
+	free(state->ofileExt);
+	free(state->pmapExt);
+	free(state);
+}
+
+void
+setToken(ORAMState state, const unsigned int *token)
+{
+	if (state->amgr->am_pmap->pmstoken != NULL)
+	{
+		state->amgr->am_pmap->pmstoken(state->pmap, token);
+	}
+	else
+	{
+		logger(DEBUG, "Set Token function is not available in PMAP!");
+	}
+}
+
+void
+setTokens(ORAMState state, const unsigned int *tokens, unsigned int ntokens)
+{
+	if (state->pmapExt != NULL && state->pmapExt->pmstokens != NULL)
+	{
+		state->pmapExt->pmstokens(state->pmap, tokens, ntokens);
+	}
+	else
+	{
+		logger(DEBUG, "Set Tokens function is not available in PMAP!");
+	}
+}
+
+/*
+ * The file extension is kept only to be released by close_oram, buckets are
+ * read and written one slot at a time.
+ */
+void
+setOFileExt(ORAMState state, AMOFileExt *ext)
+{
+	free(state->ofileExt);
+	state->ofileExt = ext;
+}
+
+void
+setPMapExt(ORAMState state, AMPMapExt *ext)
+{
+	free(state->pmapExt);
+	state->pmapExt = ext;
+}
+
+#ifdef STASH_COUNT
+void
+logStashes(ORAMState state)
+{
+	logger(DEBUG, "Stash has %d blocks and max is %d\n", state->nblocksStash, state->max);
+}
+#endif
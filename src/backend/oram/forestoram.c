@@ -38,6 +38,27 @@
 #include "oram/orandom.h"
 #include "oram/pmapdefs/fdeforam.h"
 
+/*
+ * Maximum size in bytes of the payload of the partition tree nodes kept in
+ * client memory. The same number of levels, counting from the root, is
+ * cached for every partition.
+ */
+#ifndef TREE_CACHE_BUDGET
+#define TREE_CACHE_BUDGET 0
+#endif
+
+/*
+ * Number of partition tree levels packed together in the oblivious file, as
+ * in pathoram.c. The default of 1 is the plain breadth-first layout.
+ */
+#ifndef SUBTREE_LEVELS
+#define SUBTREE_LEVELS 1
+#endif
+
+
+typedef unsigned int TreeNode;
+
+typedef TreeNode *TreePath;
 
 struct ORAMState
 {
@@ -60,10 +81,44 @@ struct ORAMState
 
 	Amgr	   *amgr;
 	/* Set of external functions to handle ORAM states */
+	AMOFileExt *ofileExt;
+	AMPMapExt  *pmapExt;
+	/* Optional operations of am_ofile and am_pmap, NULL until set */
 	Stash	   *stashes;
 	PMap		pmap;
     FileHandler fhandler;
 
+	unsigned int *levelTotals;
+	/* Number of blocks selected for each tree level during an eviction */
+
+	BlockPool	pool;
+	/* Blocks read from the oblivious file and stashed */
+	TreePath	path;
+	PLBList		pathBlocks;
+	PLBList		evictBlocks;
+	/* Buffers of the partition path being accessed */
+
+	unsigned int cacheLevels;
+	/* Number of levels of each partition tree kept in client memory */
+	unsigned int cacheNodes;
+	PLBList		cache;
+	/*
+	 * Blocks of the cached levels, the slot k of node n of partition p is
+	 * (p*cacheNodes + n)*Z + k
+	 */
+
+	PLBList		ioBlocks;
+	BlockNumber *ioBlknos;
+	unsigned int nio;
+	/* Slots of the partition path read or written in a single call */
+
+	PLBlock		dummyBlock;
+	/*
+	 * Block written to the empty slots of a path. Each state keeps its own,
+	 * as ORAMs with different block sizes can coexist, e.g., to store a
+	 * recursive position map.
+	 */
+
     unsigned int nblocks;
     
     #ifdef STASH_COUNT
@@ -73,10 +128,6 @@ struct ORAMState
     #endif
 };
 
-typedef unsigned int TreeNode;
-
-typedef TreeNode *TreePath;
-
 
 /* non-export function prototypes */
 
@@ -102,6 +153,12 @@ static TreePath getTreePath(ORAMState state, Location leaf);
 
 static void initBlockList(ORAMState state, PLBList *list);
 
+static void initTreeCache(ORAMState state);
+
+static void readSlots(ORAMState state, void *appData);
+
+static void writeSlots(ORAMState state, void *appData);
+
 static PLBList getTreeNodes(ORAMState state, TreePath path, Location location,
                             void *appData);
 
@@ -176,6 +233,43 @@ init_oram(const char *file, unsigned int nblocks, unsigned int blockSize, unsign
                            amgr);
     state->nblocks = nblocks;
 
+	state->levelTotals = (unsigned int *) malloc(sizeof(unsigned int) * (partitionTreeHeight + 1));
+
+	if (state->levelTotals == NULL)
+	{
+		logger(OUT_OF_MEMORY, "Out Of Memory allocating eviction totals\n");
+		abort();
+	}
+
+	/*
+	 * The pool starts with room for a partition path and the expected size of
+	 * the stashes and grows if they hold more blocks.
+	 */
+	state->pool = createBlockPool((partitionTreeHeight + 1) * bucketCapacity + nPartitions * 4,
+                                  blockSize);
+	state->path = (TreePath) malloc(sizeof(TreeNode) * (partitionTreeHeight + 1));
+
+	if (state->path == NULL)
+	{
+		logger(OUT_OF_MEMORY, "Out Of Memory allocating tree path\n");
+		abort();
+	}
+
+	initBlockList(state, &state->pathBlocks);
+	initBlockList(state, &state->evictBlocks);
+	state->dummyBlock = createRandomBlock(blockSize, sizeof(struct Location));
+	initTreeCache(state);
+
+	initBlockList(state, &state->ioBlocks);
+	state->ioBlknos = (BlockNumber *) malloc(sizeof(BlockNumber) * (partitionTreeHeight + 1) * bucketCapacity);
+	state->nio = 0;
+
+	if (state->ioBlknos == NULL)
+	{
+		logger(OUT_OF_MEMORY, "Out Of Memory allocating path I/O buffers\n");
+		abort();
+	}
+
     #ifdef STASH_COUNT
         state->max = 0;
         state->nblocksStash = 0;
@@ -252,6 +346,8 @@ buildORAMState(const char *filename, unsigned int blockSize,
 	memcpy(state->file, filename, namelen);
 	/* state->file = filename; */
 	state->amgr = amgr;
+	state->ofileExt = NULL;
+	state->pmapExt = NULL;
 
 	return state;
 }
@@ -373,21 +469,10 @@ getTreePath(ORAMState state, Location location)
 	unsigned int leaf = location->leaf;
 	unsigned int currentPos = 0;
 	unsigned int currentHeight = state->partitionsHeight;
-	TreePath	path = NULL;
+	TreePath	path = state->path;
 	TreeNode	node = 0;
-	int			save_errno = 0;
 
 	currentPos = leaf + (1 << (state->partitionsHeight));
-	save_errno = errno;
-	errno = 0;
-	path = (TreePath) malloc(sizeof(TreeNode) * (currentHeight + 1));
-
-	if (path == NULL && errno == ENOMEM)
-	{
-		logger(OUT_OF_MEMORY, "Out Of Memory getTreePath");
-		errno = save_errno;
-		abort();
-	}
 
 	while (currentPos > 0)
 	{
@@ -396,7 +481,6 @@ getTreePath(ORAMState state, Location location)
 		currentHeight--;
 		currentPos >>= 1;
 	}
-	errno = save_errno;
 
 	return path;
 }
@@ -420,6 +504,210 @@ initBlockList(ORAMState state, PLBList *list)
 	errno = save_errno;
 }
 
+/*
+ * Keeps the top levels of every partition tree that fit TREE_CACHE_BUDGET in
+ * client memory. See initTreeCache in pathoram.c.
+ */
+void
+initTreeCache(ORAMState state)
+{
+	unsigned int index;
+	unsigned int nslots;
+	size_t		levelSize;
+	size_t		cacheSize = 0;
+	int			save_errno = errno;
+
+	state->cacheLevels = 0;
+	state->cacheNodes = 0;
+	state->cache = NULL;
+
+	while (state->cacheLevels < state->partitionsHeight + 1)
+	{
+		levelSize = ((size_t) 1 << state->cacheLevels) * state->nPartitions
+			* state->bucketCapacity * state->blockSize;
+
+		if (cacheSize + levelSize > TREE_CACHE_BUDGET)
+			break;
+
+		cacheSize += levelSize;
+		state->cacheLevels++;
+	}
+
+	if (state->cacheLevels == 0)
+		return;
+
+	state->cacheNodes = (1 << state->cacheLevels) - 1;
+	nslots = state->nPartitions * state->cacheNodes * state->bucketCapacity;
+
+	errno = 0;
+	state->cache = (PLBList) malloc(sizeof(PLBlock) * nslots);
+
+	if (state->cache == NULL && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory allocating tree cache");
+		errno = save_errno;
+		abort();
+	}
+	errno = save_errno;
+
+	for (index = 0; index < nslots; index++)
+	{
+		state->cache[index] = state->dummyBlock;
+	}
+
+	logger(DEBUG, "Caching %d levels of each partition in client memory\n",
+           state->cacheLevels);
+}
+
+/*
+ * Returns the first slot, relative to the start of its partition, that stores
+ * the bucket of the given partition tree node.
+ */
+static inline BlockNumber
+nodeSlot(ORAMState state, TreeNode node)
+{
+#if SUBTREE_LEVELS > 1
+	unsigned int level;
+	unsigned int top;
+	unsigned int depth;
+	unsigned int position;
+	unsigned int levels;
+
+#if defined(__GNUC__) || defined(__clang__)
+	level = sizeof(unsigned int) * 8 - 1 - __builtin_clz(node + 1);
+#else
+	level = 0;
+	while ((node + 1) >> (level + 1))
+	{
+		level++;
+	}
+#endif
+	top = level - level % SUBTREE_LEVELS;
+	depth = level - top;
+	position = node + 1 - (1U << level);
+
+	levels = state->partitionsHeight + 1 - top;
+	if (levels > SUBTREE_LEVELS)
+	{
+		levels = SUBTREE_LEVELS;
+	}
+
+	node = ((1U << top) - 1)
+		+ (position >> depth) * ((1U << levels) - 1)
+		+ ((1U << depth) - 1) + (position & ((1U << depth) - 1));
+#endif
+	return node * state->bucketCapacity;
+}
+
+/*
+ * Tree-top cache aware accessors of a slot of a partition. Blocks read from
+ * the cache leave it until they are written back. The remaining slots are
+ * queued and transferred by readSlots and writeSlots.
+ */
+static inline void
+readSlot(ORAMState state, PLBList list, unsigned int index, unsigned int partition,
+         TreeNode node, unsigned int offset, BlockNumber ob_blkno)
+{
+	unsigned int cidx;
+
+	if (node < state->cacheNodes)
+	{
+		cidx = (partition * state->cacheNodes + node) * state->bucketCapacity + offset;
+		list[index] = state->cache[cidx];
+		state->cache[cidx] = state->dummyBlock;
+		return;
+	}
+
+	list[index] = createEmptyPooledBlock(state->pool);
+	state->ioBlocks[state->nio] = list[index];
+	state->ioBlknos[state->nio] = ob_blkno;
+	state->nio++;
+}
+
+static inline void
+writeSlot(ORAMState state, PLBlock block, unsigned int partition, TreeNode node,
+          unsigned int offset, BlockNumber ob_blkno)
+{
+	if (node < state->cacheNodes)
+	{
+		state->cache[(partition * state->cacheNodes + node) * state->bucketCapacity + offset] = block;
+		return;
+	}
+
+	state->ioBlocks[state->nio] = block;
+	state->ioBlknos[state->nio] = ob_blkno;
+	state->nio++;
+}
+
+/*
+ * Reads the queued slots with a single call to ofilereadpath, or with a call
+ * to ofileread per slot if no file extension implementing it was set.
+ * Without an extension, the payloads malloc'ed by ofileread are moved to the
+ * pooled blocks.
+ */
+void
+readSlots(ORAMState state, void *appData)
+{
+	unsigned int index;
+	void	   *payload;
+	AMOFile    *ofile = state->amgr->am_ofile;
+
+	if (state->nio > 0 && state->ofileExt != NULL
+		&& state->ofileExt->ofilereadpath != NULL)
+	{
+		state->ofileExt->ofilereadpath(state->fhandler, state->ioBlocks, state->file,
+                             state->ioBlknos, state->nio, appData);
+	}
+	else
+	{
+		for (index = 0; index < state->nio; index++)
+		{
+			payload = state->ofileExt == NULL ? detachPayload(state->ioBlocks[index]) : NULL;
+			ofile->ofileread(state->fhandler, state->ioBlocks[index],
+                             state->file, state->ioBlknos[index], appData);
+			if (payload != NULL)
+			{
+				attachPayload(state->ioBlocks[index], payload);
+			}
+		}
+	}
+	state->nio = 0;
+}
+
+/*
+ * Writes the queued slots and releases their real blocks.
+ */
+void
+writeSlots(ORAMState state, void *appData)
+{
+	unsigned int index;
+	AMOFile    *ofile = state->amgr->am_ofile;
+
+	if (state->nio > 0 && state->ofileExt != NULL
+		&& state->ofileExt->ofilewritepath != NULL)
+	{
+		state->ofileExt->ofilewritepath(state->fhandler, state->ioBlocks, state->file,
+                              state->ioBlknos, state->nio, appData);
+	}
+	else
+	{
+		for (index = 0; index < state->nio; index++)
+		{
+			ofile->ofilewrite(state->fhandler, state->ioBlocks[index],
+                              state->file, state->ioBlknos[index], appData);
+		}
+	}
+
+	for (index = 0; index < state->nio; index++)
+	{
+		if (state->ioBlocks[index]->blkno != DUMMY_BLOCK)
+		{
+			freeBlock(state->ioBlocks[index]);
+		}
+	}
+	state->nio = 0;
+}
+
 PLBList
 getTreeNodes(ORAMState state, TreePath path, Location location, void *appData)
 {
@@ -429,9 +717,7 @@ getTreeNodes(ORAMState state, TreePath path, Location location, void *appData)
 
 	/* Oblivious file Block Number */
 	PLBList		list = NULL;
-	PLBlock		plblock = NULL;
 	int			index = 0;
-	int			prev = 0;
 	int			lcapacity;
 	int			lob_blkno;
 	unsigned int pOffset = 0;
@@ -439,29 +725,24 @@ getTreeNodes(ORAMState state, TreePath path, Location location, void *appData)
 	/* partition offset; */
 
 	pOffset = location->partition * state->partitionCapacity*state->bucketCapacity;
-	initBlockList(state, &list);
+	list = state->pathBlocks;
 
 	for (level = 0; level < state->partitionsHeight + 1; level++)
 	{
 
 		lcapacity = level * state->bucketCapacity;
-		lob_blkno = path[level] * state->bucketCapacity + pOffset;
+		lob_blkno = nodeSlot(state, path[level]) + pOffset;
 
 		for (offset = 0; offset < state->bucketCapacity; offset++)
 		{
 			ob_blkno = lob_blkno + offset;
 			index = lcapacity + offset;
 
-			plblock = createEmptyBlock();
-            
-			state->amgr->am_ofile->ofileread(state->fhandler, 
-                                             plblock, 
-                                             state->file, 
-                                             (BlockNumber) ob_blkno,
-                                             appData);
-			list[index] = plblock;
+			readSlot(state, list, index, location->partition, path[level],
+                     offset, ob_blkno);
 		}
 	}
+	readSlots(state, appData);
 
 	return list;
 }
@@ -488,87 +769,94 @@ addBlocksToStash(ORAMState state, PLBList list, Location location, void *appData
 		else
 		{
 			/*
-			 * If it's a dummy block, a PLBlock had to be allocated and a
-			 * block. This memory needs to be freed or is leaked as its is not
-			 * added to the stash and there are no more references to it
+			 * If it's a dummy block, it is not added to the stash and there
+			 * are no more references to it, so it goes back to the pool.
+			 * Empty slots of the tree cache share the state dummy block.
 			 */
-			free(list[index]->block);
-			free(list[index]);
+			if (list[index] != state->dummyBlock)
+			{
+				freeBlock(list[index]);
+			}
 		}
 	}
 }
 
 
+/*
+ * Plans the eviction along the accessed path with a single pass over the
+ * partition stash. Each block is placed on the deepest level of the path it
+ * can occupy or, if that bucket is full, on the closest level above it with a
+ * free slot.
+ */
 void
 getBlocksToWrite(PLBList *blocksToWrite, Location a_location, ORAMState state, void *appData)
 {
 
-	unsigned int total = 0;
-
-	/* Index to keep track of current tree level */
-	unsigned int level = state->partitionsHeight + 1;
+	/* Number of free slots left in the path */
+	unsigned int freeSlots = (state->partitionsHeight + 1) * state->bucketCapacity;
+	unsigned int level;
+	int			s_level;
 
 	/* Leaf number of accessed node */
 	unsigned int a_leaf = a_location->leaf;
 
-	unsigned int a_leaf_node = a_leaf + (1 << (state->partitionsHeight));
-	unsigned int s_leaf_node = 1 << state->partitionsHeight;
-	unsigned int aux_leaf_node = 0;
 	unsigned int index;
 	unsigned int loffset;
-	unsigned int level_offset = 0;
-	unsigned int a_leaf_level = 0;
 	unsigned int bucket_offset = 0;
+	unsigned int *totals = state->levelTotals;
 
 	/* Location of  a stashed node */
 
 	PLBlock		pl_block;
 	PLBList		selectedBlocks;
-    int         condition = 0;
     unsigned int s_leaf = 0;
     unsigned int s_partition = 0;
 
 
     AMStash* stash = state->amgr->am_stash;
 
-	initBlockList(state, &selectedBlocks);
+	selectedBlocks = state->evictBlocks;
 
-	for (; level > 0; level--)
-	{
+	memset(totals, 0, sizeof(unsigned int) * (state->partitionsHeight + 1));
 
-		stash->stashstartIt(state->stashes[a_location->partition], state->file, appData);
+	stash->stashstartIt(state->stashes[a_location->partition], state->file, appData);
 
-		level_offset = (state->partitionsHeight + 1) - level;
-		a_leaf_level = a_leaf_node >> level_offset;
-		bucket_offset = (level - 1) * state->bucketCapacity;
+	while (freeSlots > 0
+           && stash->stashnext(state->stashes[a_location->partition],
+                               state->file, &pl_block, appData))
+	{
+		checkBlock(pl_block, state->pool);
+        s_leaf = pl_block->location[0];
+        s_partition = pl_block->location[1];
 
-		while (stash->stashnext(state->stashes[a_location->partition],
-                                        state->file, &pl_block, appData)
-			   && total < state->bucketCapacity)
+        //the partition test is only relevant if the blocks are being read
+        //from a single stash.
+		if (a_location->partition != s_partition)
 		{
+			continue;
+		}
 
-			//s_location = state->amgr->am_pmap->pmget(state->pmap, state->file, (BlockNumber) pl_block->blkno);
-            //s_location = pl_block->location;
-            s_leaf = pl_block->location[0];
-            s_partition = pl_block->location[1];
+		s_level = (int) getDeepestLevel(state->partitionsHeight, s_leaf, a_leaf);
 
-            condition = a_leaf_level == ((s_leaf + s_leaf_node) >> level_offset);
-            //the partition test is only relevant if the blocks are being read
-            //from a single stash.
-            condition = condition && a_location->partition == s_partition;
-			if (condition)
-			{
-				index = bucket_offset + total;
-				selectedBlocks[index] = pl_block;
-				total++;
-			}
+		while (s_level >= 0 && totals[s_level] == state->bucketCapacity)
+		{
+			s_level--;
+		}
+
+		if (s_level >= 0)
+		{
+			index = s_level * state->bucketCapacity + totals[s_level];
+			selectedBlocks[index] = pl_block;
+			totals[s_level]++;
+			freeSlots--;
 		}
+	}
+
+	for (level = 0; level < state->partitionsHeight + 1; level++)
+	{
+		bucket_offset = level * state->bucketCapacity;
 
-		/*
-		 * state->amgr->am_stash->stashcloseIt(state->stash, state->file,
-		 * appData);
-		 */
-		for (loffset = 0; loffset < total; loffset++)
+		for (loffset = 0; loffset < totals[level]; loffset++)
 		{
 			index = bucket_offset + loffset;
 
@@ -583,15 +871,11 @@ getBlocksToWrite(PLBList *blocksToWrite, Location a_location, ORAMState state, v
 		}
 
 
-		for (loffset = total; loffset < state->bucketCapacity; loffset++)
+		for (loffset = totals[level]; loffset < state->bucketCapacity; loffset++)
 		{
 			index = bucket_offset + loffset;
-			selectedBlocks[index] = createDummyBlock(state->blockSize, sizeof(struct Location));
-
-            //logger(DEBUG, "Adding dummy block of size %d with data %x", state->blockSize, selectedBlocks[index]->block);
+			selectedBlocks[index] = state->dummyBlock;
 		}
-
-		total = 0;
 	}
 
 	*blocksToWrite = selectedBlocks;
@@ -618,7 +902,7 @@ writeBlocksToStorage(PLBList list, Location location, ORAMState state, void *app
 	while (currentPos > 0)
 	{
 
-		lob_blkno = (currentPos - 1) * state->bucketCapacity + pOffset;
+		lob_blkno = nodeSlot(state, currentPos - 1) + pOffset;
 
 		for (index = 0; index < state->bucketCapacity; index++)
 		{
@@ -626,22 +910,14 @@ writeBlocksToStorage(PLBList list, Location location, ORAMState state, void *app
 			list_idx = list_offset - index;
 			block = list[list_idx];
 
-			state->amgr->am_ofile->ofilewrite(state->fhandler, 
-                                              block, 
-                                              state->file, 
-                                              ob_blkno, 
-                                              appData);
-
-           	if (block->blkno != DUMMY_BLOCK)
-			{
-				free(block->block);
-				free(block);
-			}
+			writeSlot(state, block, location->partition, currentPos - 1,
+                      index, ob_blkno);
 		}
 		list_offset -= state->bucketCapacity;
 		currentPos >>= 1;
 
 	}
+	writeSlots(state, appData);
 }
 
 
@@ -653,7 +929,7 @@ updateStashWithNewBlock(void *data,
 {
     int         found = 0;
     AMStash*    stash = state->amgr->am_stash;
-	PLBlock     plblock = createBlock((int) blkno, blkSize, data);
+	PLBlock     plblock = createPooledBlock(state->pool, (int) blkno, blkSize, data);
     plblock->location[0] = nLocation->leaf;
     plblock->location[1] = nLocation->partition;
     //setLocation(plblock, nLocation, sizeof(struct Location));
@@ -689,11 +965,20 @@ read_foram(char **ptr, BlockNumber blkno, ORAMState state, void *appData)
 	unsigned int result = 0;
 	TreePath	path = NULL;
 	PLBList		list = NULL;
-	PLBlock		plblock = createEmptyBlock();
 
     AMPMap*      pmap = state->amgr->am_pmap;  
     AMStash*     stash = state->amgr->am_stash;
 
+	/*
+	 * The requested block is copied from the stash to a buffer that is
+	 * returned to the caller.
+	 */
+	struct PLBlock plblock;
+
+	memset(&plblock, 0, sizeof(struct PLBlock));
+	plblock.blkno = DUMMY_BLOCK;
+	plblock.size = -1;
+
 	/* line 1 and 2 of original paper */
 	location = pmap->pmget(state->pmap, state->file, blkno);
 
@@ -704,28 +989,21 @@ read_foram(char **ptr, BlockNumber blkno, ORAMState state, void *appData)
 	addBlocksToStash(state, list, location, appData);
 
 	/* Line 6 of original paper */
-	stash->stashget(state->stashes[location->partition], plblock, blkno, 
+	stash->stashget(state->stashes[location->partition], &plblock, blkno, 
                     state->file, appData);
 
-	/* Free Resources */
-	free(path);
-	/* The plblocks of the list cannot be freed as they may be in the stash */
-	free(list);
-	/* free(blocks_to_write); */
-
-	*ptr = plblock->block;
+	*ptr = plblock.block;
 
 	/* No block has been inserted yet */
-	if (plblock->blkno == DUMMY_BLOCK)
+	if (plblock.blkno == DUMMY_BLOCK)
 	{
 		result = DUMMY_BLOCK;
 	}
 	else
 	{
-		result = plblock->size;
+		result = plblock.size;
 	}
 
-	free(plblock);
 	return result;
 
 }
@@ -760,7 +1038,6 @@ evict_foram(char *data, unsigned int blkSize, BlockNumber blkno, ORAMState state
 	/* line 10 to 15 of original paper */
 	getBlocksToWrite(&blocks_to_write, &oldLocation, state, appData);
 	writeBlocksToStorage(blocks_to_write, &oldLocation, state, appData);
-	free(blocks_to_write);
 
 	return blkSize;
 }
@@ -787,13 +1064,23 @@ close_oram(ORAMState state, void *appData)
 	state->amgr->am_pmap->pmclose(state->pmap, state->file);
 	state->amgr->am_ofile->ofileclose(state->fhandler, state->file, appData);
 
+	freeBlockPool(state->pool);
+	freeBlock(state->dummyBlock);
+	free(state->path);
+	free(state->pathBlocks);
+	free(state->evictBlocks);
 	free(state->stashes);
+	free(state->levelTotals);
+	free(state->cache);
+	free(state->ioBlocks);
+	free(state->ioBlknos);
 	free(state->file);
 	free(state->amgr->am_stash);
 	free(state->amgr->am_pmap);
 	free(state->amgr->am_ofile);
+	free(state->ofileExt);
+	free(state->pmapExt);
 	free(state);
-    freeDummyBlock();
 }
 
 int
@@ -828,6 +1115,39 @@ write_oram(char *data, unsigned int blkSize, BlockNumber blkno, ORAMState state,
     return blkSize;
 }
 
+/*
+ * Forest ORAM spreads consecutive accesses over independent partitions, so
+ * the paths of a batch rarely overlap. Batches are served one request at a
+ * time.
+ */
+int
+read_oram_batch(char **ptrs, int *results, const BlockNumber *blknos,
+                unsigned int nrequests, ORAMState state, void *appData)
+{
+	unsigned int index;
+
+	for (index = 0; index < nrequests; index++)
+	{
+		results[index] = read_oram(&ptrs[index], blknos[index], state, appData);
+	}
+	return nrequests;
+}
+
+int
+write_oram_batch(char **data, const unsigned int *blkSizes, int *results,
+                 const BlockNumber *blknos, unsigned int nrequests,
+                 ORAMState state, void *appData)
+{
+	unsigned int index;
+
+	for (index = 0; index < nrequests; index++)
+	{
+		results[index] = write_oram(data[index], blkSizes[index], blknos[index],
+                                    state, appData);
+	}
+	return nrequests;
+}
+
 void full_eviction(ORAMState state){
     
     int partition = 0;
@@ -845,12 +1165,9 @@ void full_eviction(ORAMState state){
         path = getTreePath(state, &location);
         list = getTreeNodes(state, path, &location, NULL);
         addBlocksToStash(state, list, &location, NULL);
-        free(path);
-        free(list);
 
         getBlocksToWrite(&blocks_to_write, &location, state, NULL);
         writeBlocksToStorage(blocks_to_write, &location, state, NULL);
-        free(blocks_to_write);
     } 
 
 }
@@ -863,6 +1180,24 @@ void setToken(ORAMState state, const unsigned int* token){
     }
 }
 
+void setTokens(ORAMState state, const unsigned int* tokens, unsigned int ntokens){
+    if (state->pmapExt != NULL && state->pmapExt->pmstokens != NULL){
+        state->pmapExt->pmstokens(state->pmap, tokens, ntokens);
+    }else{
+        logger(DEBUG, "Set Tokens function is not available in PMAP!");
+    }
+}
+
+void setOFileExt(ORAMState state, AMOFileExt *ext){
+    free(state->ofileExt);
+    state->ofileExt = ext;
+}
+
+void setPMapExt(ORAMState state, AMPMapExt *ext){
+    free(state->pmapExt);
+    state->pmapExt = ext;
+}
+
 
 #ifdef STASH_COUNT
 void 
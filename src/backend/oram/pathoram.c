@@ -28,16 +28,109 @@
 
 #include <errno.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
 
-#include "oram/oram.h"
+#include "oram/poram.h"
 #include "oram/coram.h"
 #include "oram/logger.h"
 #include "oram/orandom.h"
 #include "oram/pmapdefs/pdeforam.h"
 
+#ifdef MERKLE_INTEGRITY
+#include <sys/random.h>
+#include "oram/aes.h"
+#endif
+
+/*
+ * Maximum size in bytes of the payload of the tree nodes kept in client
+ * memory. The deepest number of levels, counting from the root, whose blocks
+ * fit the budget are never read from or written to the oblivious file.
+ */
+#ifndef TREE_CACHE_BUDGET
+#define TREE_CACHE_BUDGET 0
+#endif
+
+/*
+ * Number of tree levels packed together in the oblivious file. The tree is
+ * cut into groups of SUBTREE_LEVELS levels, counting from the root, and the
+ * buckets of each subtree of a group are stored contiguously in breadth-first
+ * order, so that a path touches about L/SUBTREE_LEVELS contiguous regions
+ * instead of L. The default of 1 is the plain breadth-first (heap) layout.
+ */
+#ifndef SUBTREE_LEVELS
+#define SUBTREE_LEVELS 1
+#endif
+
+/*
+ * Maximum number of requests of read_oram_batch and write_oram_batch served
+ * with a single fetch of the union of their paths. Larger batches are split
+ * in passes of at most BATCH_PASS_SIZE requests. The first batch grows the
+ * stash with room for the real blocks of the extra paths of a pass, so ORAMs
+ * that never batch keep a stash sized for a single path.
+ */
+#ifndef BATCH_PASS_SIZE
+#define BATCH_PASS_SIZE 16
+#endif
+
+/*
+ * If MERKLE_INTEGRITY is defined, the tree is also a Merkle tree. Every bucket
+ * has a few extra slots that hold a MerkleRecord: a MAC of the blocks of the
+ * bucket and the hashes of its two children. The hash of a node is a MAC of
+ * its record, so the hashes of a path are checked against the root hash, kept
+ * in client memory, with the records read together with the path, and the
+ * records written with the path update it. MACs are AES-CBC-MACs with a key
+ * drawn when the ORAM is initialized (see aes.c). A failed check aborts.
+ */
+#ifdef MERKLE_INTEGRITY
+
+#define MERKLE_HASH_SIZE AES_BLOCK_SIZE
+
+/* Marks a record that has been written, never written records are zeros */
+#define MERKLE_MAGIC 0x4d524b4c
+
+typedef struct MerkleRecord
+{
+	uint32_t	magic;
+	uint32_t	node;
+	uint8_t		padding[MERKLE_HASH_SIZE - 2 * sizeof(uint32_t)];
+	uint8_t		digest[MERKLE_HASH_SIZE];
+	/* MAC of the blocks of the bucket */
+	uint8_t		children[2][MERKLE_HASH_SIZE];
+	/* Hashes of the left and right children */
+} MerkleRecord;
+
+#endif
+
+/*
+ * If OBLIVIOUS_EVICTION is defined, the blocks evicted along a path are
+ * selected with a fixed sequence of branch-free operations that does not
+ * depend on the leaves of the stashed blocks (see getBlocksToWrite). It is
+ * meant to be used with an oblivious stash, e.g., dstash.c. The loop over
+ * the stash always runs over its capacity, so its length does not depend on
+ * the number of stashed blocks either.
+ *
+ * The batched eviction of evictBatchNodes places blocks with a data-dependent
+ * search, so read_oram_batch and write_oram_batch serve their requests one at
+ * a time in these builds, each evicted by the oblivious getBlocksToWrite.
+ */
+
+
+typedef unsigned int TreeNode;
+
+typedef TreeNode *TreePath;
+
+/* Path read by read_poram that has not been evicted yet */
+typedef struct PendingEviction
+{
+	BlockNumber blkno;
+	unsigned int leaf;
+	/* Leaf of the path read */
+	unsigned int newLeaf;
+	/* Leaf the block is mapped to */
+} PendingEviction;
 
 struct ORAMState
 {
@@ -47,18 +140,100 @@ struct ORAMState
 	/* Tree Height of the oblivious file(L) */
 	unsigned int bucketCapacity;
 	/* Number of buckets in a Tree node(Z) */
+	unsigned int slotsPerNode;
+	/* Slots of the oblivious file per tree node, Z plus the Merkle record */
 
     unsigned int nblocks;
 
+	unsigned int stashSize;
+	/* Number of blocks the stash was initialized to hold */
+
 	char	   *file;
 	/* File name of the protected file. */
 
 	Amgr	   *amgr;
 
 	/* Set of external functions to handle ORAM states. */
+	AMOFileExt *ofileExt;
+	AMPMapExt  *pmapExt;
+	/* Optional operations of am_ofile and am_pmap, NULL until set */
 	Stash		stash;
 	PMap		pmap;
     FileHandler fhandler;
+
+	unsigned int *levelTotals;
+	/* Number of blocks selected for each tree level during an eviction */
+
+	BlockPool	pool;
+	/* Blocks read from the oblivious file and stashed */
+	TreePath	path;
+	PLBList		pathBlocks;
+	PLBList		evictBlocks;
+	/* Buffers of the path accessed by read_oram and write_oram */
+
+	unsigned int *batchLeaves;
+	/* Old and new leaves of the requests of a batch pass */
+	unsigned int *batchPaths;
+	/* Old leaves of a pass from the largest to the smallest */
+	TreePath	batchNodes;
+	unsigned int *batchIndexes;
+	/* Union of the paths of a pass and the index in it of each path node */
+	PLBList		batchBlocks;
+	PLBList		batchSelected;
+	unsigned int *batchTotals;
+	/* Blocks read from and evicted to the union, NULL until the first batch */
+
+	unsigned int cacheLevels;
+	/* Number of tree levels, from the root, kept in client memory */
+	unsigned int cacheNodes;
+	PLBList		cache;
+	/* Blocks of the cached levels, the slot k of node n is n*Z+k */
+
+	PLBList		ioBlocks;
+	BlockNumber *ioBlknos;
+	unsigned int ioCapacity;
+	unsigned int nio;
+	/* Slots of the oblivious file read or written in a single call */
+
+	PendingEviction *pending;
+	unsigned int npending;
+	unsigned int pendingCapacity;
+
+#ifdef OBLIVIOUS_EVICTION
+	PLBList		sortBlocks;
+	int		   *sortKeys;
+	int		   *sortSlots;
+	unsigned int sortCapacity;
+	/* Stashed blocks sorted by the oblivious eviction, 2^n entries */
+#endif
+
+#ifdef MERKLE_INTEGRITY
+	AESKey		macKey;
+	uint8_t		rootHash[MERKLE_HASH_SIZE];
+	/* Hash of the root, zeros while the root has never been written */
+	unsigned int hashSlots;
+	/* Slots of a node that store its MerkleRecord */
+	MerkleRecord *records;
+	TreeNode   *recordNodes;
+	unsigned int nrecords;
+	unsigned int recordCapacity;
+	/*
+	 * Verified records of the nodes last read or written, which an eviction
+	 * of the same nodes reuses instead of reading them again.
+	 */
+	PLBList		hashBlocks;
+	char	   *hashArena;
+	/* hashSlots blocks per record, exchanged with the oblivious file */
+	PLBList		bucketBlocks;
+	/* Blocks of the bucket being evicted, in slot order */
+#endif
+
+	PLBlock		dummyBlock;
+	/*
+	 * Block written to the empty slots of a path. Each state keeps its own,
+	 * as ORAMs with different block sizes can coexist, e.g., to store a
+	 * recursive position map.
+	 */
     
     #ifdef STASH_COUNT
     unsigned int max;
@@ -66,10 +241,6 @@ struct ORAMState
     #endif
 };
 
-typedef unsigned int TreeNode;
-
-typedef TreeNode *TreePath;
-
 
 /* non-export function prototypes */
 
@@ -83,11 +254,42 @@ static TreePath getTreePath(ORAMState state, unsigned int leaf);
 
 static void initBlockList(ORAMState state, PLBList *list);
 
+static void initTreeCache(ORAMState state);
+
+static void reserveIOSlots(ORAMState state, unsigned int nslots);
+
+static void readSlots(ORAMState state, void *appData);
+
+static void writeSlots(ORAMState state, void *appData);
+
+#ifdef MERKLE_INTEGRITY
+static void merkleInit(ORAMState state);
+
+static void reserveRecords(ORAMState state, unsigned int nrecords);
+
+static void queueRecordReads(ORAMState state, const TreeNode *nodes,
+                             unsigned int nnodes);
+
+static void verifyRecords(ORAMState state);
+
+static void verifyBuckets(ORAMState state, PLBList list);
+
+static void fetchRecords(ORAMState state, const TreeNode *nodes,
+                         unsigned int nnodes, void *appData);
+
+static void setBucketDigest(ORAMState state, unsigned int index);
+
+static void queueRecordWrites(ORAMState state);
+#endif
+
 static PLBList getTreeNodes(ORAMState state, TreePath path, void *appData);
 
-static void addBlocksToStash(ORAMState state, PLBList list, void *appData);
+static void addBlocksToStash(ORAMState state, PLBList list, 
+                             unsigned int nblocks, void *appData);
 
-static void getBlocksToWrite(PLBList *blocksToWrite, unsigned int a_leaf, ORAMState state, void *appData);
+static void getBlocksToWrite(PLBList *blocksToWrite, unsigned int a_leaf,
+                             unsigned int sharedLevels, ORAMState state,
+                             void *appData);
 
 static void writeBlocksToStorage(PLBList list, unsigned int leaf, ORAMState state, void *appData);
 
@@ -96,6 +298,42 @@ static void updateStashWithNewBlock(void *data, unsigned int blockSize,
                                     BlockNumber blkno, ORAMState state,
                                     Location location, void *appData);
 
+static unsigned int getSharedLevels(ORAMState state, unsigned int leaf);
+
+static unsigned int isPending(ORAMState state, BlockNumber blkno);
+
+#ifdef OBLIVIOUS_EVICTION
+static void reserveSortSlots(ORAMState state, unsigned int nslots);
+
+static void bitonicSort(int *keys, PLBList blocks, unsigned int n);
+#endif
+
+static unsigned int fetchPath(ORAMState state, BlockNumber blkno,
+                              Location nLocation, void *appData);
+
+static void evictPath(ORAMState state, unsigned int leaf, void *appData);
+
+static void addPendingEviction(ORAMState state, BlockNumber blkno,
+                               unsigned int leaf, unsigned int newLeaf);
+
+#ifndef OBLIVIOUS_EVICTION
+static void initBatch(ORAMState state, void *appData);
+
+static unsigned int getBatchNodes(ORAMState state, const unsigned int *leaves,
+                                  unsigned int nleaves);
+
+static PLBList getBatchTreeNodes(ORAMState state, unsigned int nnodes,
+                                 void *appData);
+
+static void evictBatchNodes(ORAMState state, unsigned int nnodes,
+                            unsigned int nleaves, void *appData);
+
+static void accessBatch(ORAMState state, const BlockNumber *blknos,
+                        unsigned int nrequests, char **data,
+                        const unsigned int *blkSizes, int *results,
+                        void *appData);
+#endif
+
 
 ORAMState
 init_oram(const char *file, unsigned int nblocks, unsigned int blockSize, unsigned int bucketCapacity, Amgr *amgr, void *appData)
@@ -103,6 +341,7 @@ init_oram(const char *file, unsigned int nblocks, unsigned int blockSize, unsign
 
 	unsigned int treeHeight;
 	unsigned int totalNodes;
+	unsigned int stashSize;
 
 	int			result;
 	ORAMState	state = NULL;
@@ -119,17 +358,83 @@ init_oram(const char *file, unsigned int nblocks, unsigned int blockSize, unsign
     struct TreeConfig config;
 	config.treeHeight = treeHeight;
 
+	/*
+	 * Besides the blocks of the expected size of the stash, a stash with a
+	 * fixed capacity (e.g., dstash.c) must hold every real block of the path
+	 * read before its eviction and the block written for the first time. The
+	 * extra paths of a batch pass are only added by initBatch.
+	 */
+	stashSize = treeHeight * 4 + (treeHeight + 1) * bucketCapacity + 1;
+	state->stashSize = stashSize;
+
 	/* Initialize external files (oblivious file, stash, possitionMap) */
-	state->stash = amgr->am_stash->stashinit(state->file, treeHeight*4, 
+	state->stash = amgr->am_stash->stashinit(state->file, stashSize, 
                                              state->blockSize, appData);
 	state->pmap = amgr->am_pmap->pminit(state->file, nblocks, &config);
     
+	state->levelTotals = (unsigned int *) malloc(sizeof(unsigned int) * (treeHeight + 1));
+
+	if (state->levelTotals == NULL)
+	{
+		logger(OUT_OF_MEMORY, "Out Of Memory allocating eviction totals\n");
+		abort();
+	}
+
+	/*
+	 * The pool starts with room for a full path and a stash of the expected
+	 * size and grows if the stash holds more blocks.
+	 */
+	state->pool = createBlockPool((treeHeight + 1) * bucketCapacity + stashSize,
+                                  blockSize);
+	state->path = (TreePath) malloc(sizeof(TreeNode) * (treeHeight + 1));
+
+	if (state->path == NULL)
+	{
+		logger(OUT_OF_MEMORY, "Out Of Memory allocating tree path\n");
+		abort();
+	}
+
+	initBlockList(state, &state->pathBlocks);
+	initBlockList(state, &state->evictBlocks);
+	state->batchLeaves = NULL;
+	state->batchPaths = NULL;
+	state->batchNodes = NULL;
+	state->batchIndexes = NULL;
+	state->batchBlocks = NULL;
+	state->batchSelected = NULL;
+	state->batchTotals = NULL;
+	state->dummyBlock = createRandomBlock(blockSize, sizeof(struct Location));
+	initTreeCache(state);
+
+	state->slotsPerNode = bucketCapacity;
+#ifdef MERKLE_INTEGRITY
+	merkleInit(state);
+#endif
+
+	state->ioBlocks = NULL;
+	state->ioBlknos = NULL;
+	state->ioCapacity = 0;
+	state->nio = 0;
+	reserveIOSlots(state, (treeHeight + 1) * state->slotsPerNode);
+
+	state->pending = NULL;
+	state->npending = 0;
+	state->pendingCapacity = 0;
+
+#ifdef OBLIVIOUS_EVICTION
+	state->sortBlocks = NULL;
+	state->sortKeys = NULL;
+	state->sortSlots = NULL;
+	state->sortCapacity = 0;
+	reserveSortSlots(state, stashSize);
+#endif
+
     #ifdef  STASH_COUNT
     state->max = 0;
     state->nblocksStash = 0;
     #endif
     
-    totalNodes = totalNodes * bucketCapacity;
+    totalNodes = totalNodes * state->slotsPerNode;
 
 	state->fhandler = amgr->am_ofile->ofileinit(state->file, totalNodes, 
                                                 blockSize, 
@@ -171,6 +476,8 @@ buildORAMState(const char *filename, unsigned int blockSize, unsigned int treeHe
 	memcpy(state->file, filename, namelen);
 	/* state->file = filename; */
 	state->amgr = amgr;
+	state->ofileExt = NULL;
+	state->pmapExt = NULL;
 
 	return state;
 }
@@ -252,27 +559,18 @@ calculateTreeHeight(unsigned int nblocks)
  * applying the same algorithm. This works for any tree height and any target
  * leaf.
  *
+ * The path is stored in a buffer of the ORAM state that is reused by every
+ * access.
  */
 TreePath
 getTreePath(ORAMState state, unsigned int leaf)
 {
 	unsigned int currentPos = 0;
 	unsigned int currentHeight = state->treeHeight;
-	TreePath	path = NULL;
+	TreePath	path = state->path;
 	TreeNode	node = 0;
-	int			save_errno = 0;
 
 	currentPos = leaf + (1 << (state->treeHeight));
-	save_errno = errno;
-	errno = 0;
-	path = (TreePath) malloc(sizeof(TreeNode) * (currentHeight + 1));
-
-	if (path == NULL && errno == ENOMEM)
-	{
-		logger(OUT_OF_MEMORY, "Out Of Memory getTreePath");
-		errno = save_errno;
-		abort();
-	}
 
 	while (currentPos > 0)
 	{
@@ -281,7 +579,6 @@ getTreePath(ORAMState state, unsigned int leaf)
 		currentHeight--;
 		currentPos >>= 1;
 	}
-	errno = save_errno;
 
 	return path;
 }
@@ -305,217 +602,1165 @@ initBlockList(ORAMState state, PLBList *list)
 	errno = save_errno;
 }
 
-PLBList
-getTreeNodes(ORAMState state, TreePath path, void *appData)
+/*
+ * Keeps the top levels of the tree that fit TREE_CACHE_BUDGET in client
+ * memory. As nodes are numbered in breadth-first order, the first K levels
+ * are the nodes 0 to 2^K-2. Every slot starts empty, as in a new oblivious
+ * file.
+ */
+void
+initTreeCache(ORAMState state)
 {
-	int			level;
-	int			offset;
-	BlockNumber ob_blkno = 0;
-
-	/* Oblivious file Block Number */
-	PLBList		list = NULL;
-	PLBlock		plblock = NULL;
-	int			index = 0;
-	int			prev = 0;
-
-	int			lcapacity;
-	BlockNumber lob_blkno;
+	unsigned int index;
+	unsigned int nslots;
+	size_t		levelSize;
+	size_t		cacheSize = 0;
+	int			save_errno = errno;
 
-	initBlockList(state, &list);
+	state->cacheLevels = 0;
+	state->cacheNodes = 0;
+	state->cache = NULL;
 
-	for (level = 0; level < state->treeHeight + 1; level++)
+	while (state->cacheLevels < state->treeHeight + 1)
 	{
+		levelSize = ((size_t) 1 << state->cacheLevels) * state->bucketCapacity
+			* state->blockSize;
 
-		lcapacity = level * state->bucketCapacity;
-		lob_blkno = path[level] * state->bucketCapacity;
+		if (cacheSize + levelSize > TREE_CACHE_BUDGET)
+			break;
 
-		for (offset = 0; offset < state->bucketCapacity; offset++)
-		{
-			ob_blkno = lob_blkno + offset;
-			index = lcapacity + offset;
+		cacheSize += levelSize;
+		state->cacheLevels++;
+	}
 
-			plblock = createEmptyBlock();
+	if (state->cacheLevels == 0)
+		return;
 
-			state->amgr->am_ofile->ofileread(state->fhandler,
-                                             plblock, 
-                                             state->file, 
-                                             (BlockNumber) ob_blkno, 
-                                             appData);
+	state->cacheNodes = (1 << state->cacheLevels) - 1;
+	nslots = state->cacheNodes * state->bucketCapacity;
 
-			list[index] = plblock;
+	errno = 0;
+	state->cache = (PLBList) malloc(sizeof(PLBlock) * nslots);
 
-		}
+	if (state->cache == NULL && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory allocating tree cache");
+		errno = save_errno;
+		abort();
 	}
+	errno = save_errno;
 
-	return list;
+	for (index = 0; index < nslots; index++)
+	{
+		state->cache[index] = state->dummyBlock;
+	}
+
+	logger(DEBUG, "Caching %d tree levels in client memory\n", state->cacheLevels);
 }
 
+/*
+ * Makes room for nslots slots in the buffers of the slots read or written in
+ * a single call to the oblivious file.
+ */
 void
-addBlocksToStash(ORAMState state, PLBList list, void *appData)
+reserveIOSlots(ORAMState state, unsigned int nslots)
 {
+	int			save_errno = errno;
 
-	int			index, blkno = 0;
-	for (index = 0; index < (state->treeHeight + 1) * state->bucketCapacity; index++)
-	{
-        blkno = list[index]->blkno;
-        //logger(DEBUG, "block no %d", blkno);
-		if (blkno != DUMMY_BLOCK && blkno >= 0 && blkno <= state->nblocks)
-		{
+	if (nslots <= state->ioCapacity)
+		return;
 
-            #ifdef STASH_COUNT
-            state->nblocksStash += 1;
-            state->max = state->max < state->nblocksStash? state->nblocksStash: state->max;
-            #endif
-			state->amgr->am_stash->stashadd(state->stash, state->file, list[index], appData);
-		}
-		else if(blkno == DUMMY_BLOCK)
-		{
-			/*
-			 * If it's a dummy block, a PLBlock had to be allocated and a
-			 * block. This memory needs to be freed or is leaked as its is not
-			 * added to the stash and there are no more references to it
-			 */
-			free(list[index]->block);
-			free(list[index]);
-		}else{
-            logger(DEBUG, "Invalid block %d", blkno);
-            abort();
-        }
+	errno = 0;
+	state->ioBlocks = (PLBList) realloc(state->ioBlocks, sizeof(PLBlock) * nslots);
+	state->ioBlknos = (BlockNumber *) realloc(state->ioBlknos, sizeof(BlockNumber) * nslots);
+
+	if ((state->ioBlocks == NULL || state->ioBlknos == NULL) && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory allocating path I/O buffers");
+		errno = save_errno;
+		abort();
 	}
+	errno = save_errno;
+	state->ioCapacity = nslots;
 }
 
-/***
- *
- * a_leaf -> leaf of accessed offset
- *
+/*
+ * Returns the first slot of the oblivious file that stores the bucket of the
+ * given tree node, following the SUBTREE_LEVELS layout.
  */
-void
-getBlocksToWrite(PLBList *blocksToWrite, unsigned int a_leaf, ORAMState state, void *appData)
+static inline BlockNumber
+nodeSlot(ORAMState state, TreeNode node)
 {
+#if SUBTREE_LEVELS > 1
+	unsigned int level;
+	unsigned int top;
+	unsigned int depth;
+	unsigned int position;
+	unsigned int levels;
+
+#if defined(__GNUC__) || defined(__clang__)
+	level = sizeof(unsigned int) * 8 - 1 - __builtin_clz(node + 1);
+#else
+	level = 0;
+	while ((node + 1) >> (level + 1))
+	{
+		level++;
+	}
+#endif
+	top = level - level % SUBTREE_LEVELS;
+	depth = level - top;
+	position = node + 1 - (1U << level);
+
+	/* The group of the leaves may be shallower than SUBTREE_LEVELS */
+	levels = state->treeHeight + 1 - top;
+	if (levels > SUBTREE_LEVELS)
+	{
+		levels = SUBTREE_LEVELS;
+	}
 
-	unsigned int total = 0;
+	node = ((1U << top) - 1)
+		+ (position >> depth) * ((1U << levels) - 1)
+		+ ((1U << depth) - 1) + (position & ((1U << depth) - 1));
+#endif
+	return node * state->slotsPerNode;
+}
 
-	/* Index to keep track of current tree level */
-	unsigned int level = state->treeHeight + 1;
-	unsigned int s_leaf = 0;
-    //unsigned int s_leaf2 = 0;
-	unsigned int a_leaf_node = a_leaf + (1 << (state->treeHeight));
-	unsigned int s_leaf_node = 1 << state->treeHeight;
-	unsigned int index = 0;
-	unsigned int level_offset = 0;
-	int			a_leaf_level = 0;
-	unsigned int loffset;
-	unsigned int bucket_offset = 0;
+/*
+ * Tree-top cache aware accessors of a slot of the oblivious file. Blocks read
+ * from the cache leave it until they are written back, so a slot is owned
+ * either by the cache or by the caller. The remaining slots are queued and
+ * transferred by readSlots and writeSlots.
+ */
+static inline void
+readSlot(ORAMState state, PLBList list, unsigned int index, TreeNode node,
+         unsigned int offset, BlockNumber ob_blkno)
+{
+	unsigned int cidx;
 
-	PLBlock		pl_block;
-	PLBList		selectedBlocks;
+	if (node < state->cacheNodes)
+	{
+		cidx = node * state->bucketCapacity + offset;
+		list[index] = state->cache[cidx];
+		state->cache[cidx] = state->dummyBlock;
+		return;
+	}
 
-	initBlockList(state, &selectedBlocks);
-    AMStash* stash = state->amgr->am_stash;
+	list[index] = createEmptyPooledBlock(state->pool);
+	state->ioBlocks[state->nio] = list[index];
+	state->ioBlknos[state->nio] = ob_blkno;
+	state->nio++;
+}
 
-	for (; level > 0; level--)
+static inline void
+writeSlot(ORAMState state, PLBlock block, TreeNode node, unsigned int offset,
+          BlockNumber ob_blkno)
+{
+	if (node < state->cacheNodes)
 	{
+		state->cache[node * state->bucketCapacity + offset] = block;
+		return;
+	}
 
-		stash->stashstartIt(state->stash, state->file, appData);
-		level_offset = ((state->treeHeight + 1) - level);
-		a_leaf_level = a_leaf_node >> level_offset;
-		bucket_offset = (level - 1) * state->bucketCapacity;
-		/* Get blocks that satisfy current level */
-		while (stash->stashnext(state->stash, state->file, &pl_block, appData)
-               && total < state->bucketCapacity)
-		{
+	state->ioBlocks[state->nio] = block;
+	state->ioBlknos[state->nio] = ob_blkno;
+	state->nio++;
+}
 
-			//s_leaf = state->amgr->am_pmap->pmget(state->pmap, state->file, (BlockNumber) pl_block->blkno)->leaf;
-            s_leaf = pl_block->location[0];
+/*
+ * Reads the queued slots with a single call to ofilereadpath or, if no file
+ * extension implementing it was set, with a call to ofileread per slot.
+ * Without an extension, the payloads malloc'ed by ofileread are moved to the
+ * pooled blocks.
+ */
+void
+readSlots(ORAMState state, void *appData)
+{
+	unsigned int index;
+	void	   *payload;
+	AMOFile    *ofile = state->amgr->am_ofile;
 
-            //logger(DEBUG, "Found block with leaf %d", s_leaf);
-            //logger(DEBUG, "leaf values are %d %d\n", s_leaf, s_leaf2);
-			if (a_leaf_level == ((s_leaf + s_leaf_node) >> level_offset))
+	if (state->nio > 0 && state->ofileExt != NULL
+		&& state->ofileExt->ofilereadpath != NULL)
+	{
+		state->ofileExt->ofilereadpath(state->fhandler, state->ioBlocks, state->file,
+                             state->ioBlknos, state->nio, appData);
+	}
+	else
+	{
+		for (index = 0; index < state->nio; index++)
+		{
+			payload = state->ofileExt == NULL ? detachPayload(state->ioBlocks[index]) : NULL;
+			ofile->ofileread(state->fhandler, state->ioBlocks[index],
+                             state->file, state->ioBlknos[index], appData);
+			if (payload != NULL)
 			{
-				index = bucket_offset + total;
-				selectedBlocks[index] = pl_block;
-				total++;
+				attachPayload(state->ioBlocks[index], payload);
 			}
-
 		}
+	}
+	state->nio = 0;
+}
 
-		/*
-		 * state->amgr->am_stash->stashcloseIt(state->stash, state->file,
-		 * appData);
-		 */
+/*
+ * Writes the queued slots, see readSlots, and releases their real blocks.
+ */
+void
+writeSlots(ORAMState state, void *appData)
+{
+	unsigned int index;
+	AMOFile    *ofile = state->amgr->am_ofile;
 
-		/* remove from the stash selected blocks */
-		for (loffset = 0; loffset < total; loffset++)
+	if (state->nio > 0 && state->ofileExt != NULL
+		&& state->ofileExt->ofilewritepath != NULL)
+	{
+		state->ofileExt->ofilewritepath(state->fhandler, state->ioBlocks, state->file,
+                              state->ioBlknos, state->nio, appData);
+	}
+	else
+	{
+		for (index = 0; index < state->nio; index++)
 		{
-			#ifdef STASH_COUNT            
-            state->nblocksStash -=1;
-            #endif
-            index = bucket_offset + loffset;
-			stash->stashremove(state->stash, state->file, 
-                               selectedBlocks[index], appData);
+			ofile->ofilewrite(state->fhandler, state->ioBlocks[index],
+                              state->file, state->ioBlknos[index], appData);
 		}
+	}
 
-		/*
-		 * add padding to a tree node if there werent sufficient blocks in the
-		 * stash
-		 */
-		loffset = total;
-
-		for (; loffset < state->bucketCapacity; loffset++)
+	for (index = 0; index < state->nio; index++)
+	{
+		if (state->ioBlocks[index]->blkno != DUMMY_BLOCK)
 		{
-
-            index = bucket_offset + loffset;
-			selectedBlocks[index] = createDummyBlock(state->blockSize, sizeof(struct Location));
+			freeBlock(state->ioBlocks[index]);
 		}
-
-		total = 0;
 	}
-
-	*blocksToWrite = selectedBlocks;
+	state->nio = 0;
 }
 
+#ifdef MERKLE_INTEGRITY
 
+/*
+ * Draws the MAC key and sizes the Merkle records. The root hash starts as
+ * zeros, the hash of a node that was never written.
+ */
 void
-writeBlocksToStorage(PLBList list, unsigned int leaf, ORAMState state, void *appData)
+merkleInit(ORAMState state)
 {
-	unsigned int list_offset = (state->treeHeight + 1) * state->bucketCapacity - 1;
-	unsigned int currentPos = 0;
-	unsigned int index;
-	BlockNumber ob_blkno = 0;
-	BlockNumber lob_blkno = 0;
-	PLBlock		block = NULL;
-	unsigned int list_idx = 0;
-
-	currentPos = leaf + (1 << state->treeHeight);
+	uint8_t		raw[AES_KEY_SIZE];
+	size_t		filled = 0;
+	ssize_t		result;
+	int			save_errno = errno;
 
-	while (currentPos > 0)
+	while (filled < AES_KEY_SIZE)
 	{
+		result = getrandom(raw + filled, AES_KEY_SIZE - filled, 0);
+		if (result < 0 && errno != EINTR)
+		{
+			logger(DEBUG, "Merkle tree key generation failed\n");
+			abort();
+		}
+		if (result > 0)
+		{
+			filled += (size_t) result;
+		}
+	}
+	errno = save_errno;
 
-		lob_blkno = (currentPos - 1) * state->bucketCapacity;
+	aesSetKey(&state->macKey, raw);
+	memset(raw, 0, AES_KEY_SIZE);
+	memset(state->rootHash, 0, MERKLE_HASH_SIZE);
 
-		for (index = 0; index < state->bucketCapacity; index++)
-		{
-			ob_blkno = lob_blkno + index;
-			list_idx = list_offset - index;
-			block = list[list_idx];
+	state->hashSlots = (sizeof(MerkleRecord) + state->blockSize - 1) / state->blockSize;
+	state->slotsPerNode = state->bucketCapacity + state->hashSlots;
 
-			state->amgr->am_ofile->ofilewrite(state->fhandler, 
-                                              block,
-                                              state->file,
-                                              ob_blkno,
-                                              appData);
+	state->records = NULL;
+	state->recordNodes = NULL;
+	state->nrecords = 0;
+	state->recordCapacity = 0;
+	state->hashBlocks = NULL;
+	state->hashArena = NULL;
 
-			if (block->blkno != DUMMY_BLOCK)
-			{
-				free(block->block);
-				free(block);
-			}
-		}
-		list_offset -= state->bucketCapacity;
-		currentPos >>= 1;
+	errno = 0;
+	state->bucketBlocks = (PLBList) malloc(sizeof(PLBlock) * state->bucketCapacity);
 
+	if (state->bucketBlocks == NULL && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory allocating Merkle tree buffers");
+		errno = save_errno;
+		abort();
 	}
-}
+	errno = save_errno;
+
+	reserveRecords(state, state->treeHeight + 1);
+}
+
+/*
+ * Makes room for the records of nrecords nodes. The records kept are not
+ * preserved.
+ */
+void
+reserveRecords(ORAMState state, unsigned int nrecords)
+{
+	unsigned int index;
+	unsigned int nblocks;
+	int			save_errno = errno;
+
+	if (nrecords <= state->recordCapacity)
+		return;
+
+	for (index = 0; index < state->recordCapacity * state->hashSlots; index++)
+	{
+		free(state->hashBlocks[index]);
+	}
+	free(state->hashBlocks);
+	free(state->hashArena);
+	free(state->records);
+	free(state->recordNodes);
+
+	nblocks = nrecords * state->hashSlots;
+
+	errno = 0;
+	state->records = (MerkleRecord *) malloc(sizeof(MerkleRecord) * nrecords);
+	state->recordNodes = (TreeNode *) malloc(sizeof(TreeNode) * nrecords);
+	state->hashBlocks = (PLBList) malloc(sizeof(PLBlock) * nblocks);
+	state->hashArena = (char *) malloc((size_t) state->blockSize * nblocks);
+
+	if ((state->records == NULL || state->recordNodes == NULL
+         || state->hashBlocks == NULL || state->hashArena == NULL) && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory allocating Merkle tree records");
+		errno = save_errno;
+		abort();
+	}
+	errno = save_errno;
+
+	for (index = 0; index < nblocks; index++)
+	{
+		state->hashBlocks[index] = createEmptyBlock();
+		state->hashBlocks[index]->block = state->hashArena
+			+ (size_t) state->blockSize * index;
+	}
+
+	state->recordCapacity = nrecords;
+	state->nrecords = 0;
+}
+
+/*
+ * Queues the reads of the records of the given nodes, which become the kept
+ * records once read and verified.
+ */
+void
+queueRecordReads(ORAMState state, const TreeNode *nodes, unsigned int nnodes)
+{
+	unsigned int index;
+	unsigned int slot;
+	BlockNumber lob_blkno;
+
+	reserveRecords(state, nnodes);
+	memcpy(state->recordNodes, nodes, sizeof(TreeNode) * nnodes);
+	state->nrecords = nnodes;
+
+	for (index = 0; index < nnodes; index++)
+	{
+		lob_blkno = nodeSlot(state, nodes[index]) + state->bucketCapacity;
+
+		for (slot = 0; slot < state->hashSlots; slot++)
+		{
+			state->ioBlocks[state->nio] = state->hashBlocks[index * state->hashSlots + slot];
+			state->ioBlknos[state->nio] = lob_blkno + slot;
+			state->nio++;
+		}
+	}
+}
+
+static void
+integrityFailure(TreeNode node)
+{
+	logger(DEBUG, "Integrity check of tree node %u failed\n", node);
+	abort();
+}
+
+/*
+ * Hash of a node, the MAC of its record. A node that was never written hashes
+ * to zeros.
+ */
+static inline void
+nodeHash(ORAMState state, const MerkleRecord *record, uint8_t *hash)
+{
+	memset(hash, 0, MERKLE_HASH_SIZE);
+
+	if (record->magic == MERKLE_MAGIC)
+	{
+		aesCbcMac(&state->macKey, hash, (const uint8_t *) record,
+                  sizeof(MerkleRecord) / AES_BLOCK_SIZE);
+	}
+}
+
+/*
+ * MAC of the blocks of a bucket, given in slot order. Dummy blocks only
+ * contribute a marker. The message starts with its length in AES blocks, as
+ * CBC-MAC is only secure for prefix-free messages.
+ */
+static void
+bucketDigest(ORAMState state, TreeNode node, PLBList blocks, uint8_t *digest)
+{
+	uint8_t		chunk[AES_BLOCK_SIZE];
+	uint32_t	header[AES_BLOCK_SIZE / sizeof(uint32_t)];
+	uint32_t	nchunks = 0;
+	unsigned int offset;
+	size_t		full;
+	size_t		tail;
+	PLBlock		block;
+
+	for (offset = 0; offset < state->bucketCapacity; offset++)
+	{
+		block = blocks[offset];
+		nchunks += 1;
+		if (block->blkno != DUMMY_BLOCK)
+		{
+			nchunks += (block->size + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE;
+		}
+	}
+
+	memset(digest, 0, MERKLE_HASH_SIZE);
+	header[0] = nchunks;
+	header[1] = node;
+	header[2] = state->bucketCapacity;
+	header[3] = 0;
+	aesCbcMac(&state->macKey, digest, (const uint8_t *) header, 1);
+
+	for (offset = 0; offset < state->bucketCapacity; offset++)
+	{
+		block = blocks[offset];
+
+		if (block->blkno == DUMMY_BLOCK)
+		{
+			header[0] = (uint32_t) DUMMY_BLOCK;
+			header[1] = header[2] = header[3] = 0;
+			aesCbcMac(&state->macKey, digest, (const uint8_t *) header, 1);
+			continue;
+		}
+
+		header[0] = (uint32_t) block->blkno;
+		header[1] = (uint32_t) block->size;
+		header[2] = block->location[0];
+		header[3] = block->location[1];
+		aesCbcMac(&state->macKey, digest, (const uint8_t *) header, 1);
+
+		full = block->size / AES_BLOCK_SIZE;
+		tail = block->size % AES_BLOCK_SIZE;
+		aesCbcMac(&state->macKey, digest, (const uint8_t *) block->block, full);
+
+		if (tail > 0)
+		{
+			memset(chunk, 0, AES_BLOCK_SIZE);
+			memcpy(chunk, (const char *) block->block + full * AES_BLOCK_SIZE, tail);
+			aesCbcMac(&state->macKey, digest, chunk, 1);
+		}
+	}
+}
+
+/*
+ * Returns the position of node in the kept records or -1. The nodes of a path
+ * are sorted from the root, those of a batch from the deepest level.
+ */
+static int
+findRecord(ORAMState state, TreeNode node)
+{
+	TreeNode   *nodes = state->recordNodes;
+	int			low = 0;
+	int			high = (int) state->nrecords - 1;
+	int			middle;
+	int			ascending = state->nrecords < 2 || nodes[0] < nodes[1];
+
+	while (low <= high)
+	{
+		middle = (low + high) / 2;
+		if (nodes[middle] == node)
+			return middle;
+		if ((nodes[middle] < node) == ascending)
+			low = middle + 1;
+		else
+			high = middle - 1;
+	}
+
+	return -1;
+}
+
+/*
+ * Decodes the records read by queueRecordReads and checks that the hash of
+ * each node matches the one kept by its parent, or the root hash. The nodes
+ * are a union of paths, so the parent of every node but the root is there.
+ */
+void
+verifyRecords(ORAMState state)
+{
+	unsigned int index;
+	unsigned int slot;
+	size_t		offset;
+	size_t		length;
+	int			parent;
+	uint8_t		hash[MERKLE_HASH_SIZE];
+	uint8_t		expected[MERKLE_HASH_SIZE];
+	MerkleRecord *record;
+	TreeNode	node;
+
+	for (index = 0; index < state->nrecords; index++)
+	{
+		record = &state->records[index];
+
+		for (slot = 0, offset = 0; offset < sizeof(MerkleRecord); slot++, offset += length)
+		{
+			length = sizeof(MerkleRecord) - offset;
+			length = length < state->blockSize ? length : state->blockSize;
+			memcpy((char *) record + offset,
+                   state->hashBlocks[index * state->hashSlots + slot]->block, length);
+		}
+
+		if (record->magic == MERKLE_MAGIC && record->node != state->recordNodes[index])
+		{
+			integrityFailure(state->recordNodes[index]);
+		}
+	}
+
+	for (index = 0; index < state->nrecords; index++)
+	{
+		node = state->recordNodes[index];
+		nodeHash(state, &state->records[index], hash);
+
+		if (node == 0)
+		{
+			memcpy(expected, state->rootHash, MERKLE_HASH_SIZE);
+		}
+		else
+		{
+			parent = findRecord(state, (node - 1) / 2);
+			if (parent < 0)
+			{
+				integrityFailure(node);
+			}
+
+			if (state->records[parent].magic == MERKLE_MAGIC)
+			{
+				memcpy(expected, state->records[parent].children[(node - 1) % 2],
+                       MERKLE_HASH_SIZE);
+			}
+			else
+			{
+				memset(expected, 0, MERKLE_HASH_SIZE);
+			}
+		}
+
+		if (memcmp(hash, expected, MERKLE_HASH_SIZE) != 0)
+		{
+			integrityFailure(node);
+		}
+	}
+}
+
+/*
+ * Checks the blocks read for the kept records, list holding the slots of each
+ * node in the order of the records. Buckets that were never written must only
+ * have dummy blocks. Cached buckets are in client memory and are not checked,
+ * their blocks may have been taken by a pending read.
+ */
+void
+verifyBuckets(ORAMState state, PLBList list)
+{
+	unsigned int index;
+	unsigned int offset;
+	uint8_t		digest[MERKLE_HASH_SIZE];
+	PLBList		blocks;
+
+	for (index = 0; index < state->nrecords; index++)
+	{
+		if (state->recordNodes[index] < state->cacheNodes)
+			continue;
+
+		blocks = list + index * state->bucketCapacity;
+
+		if (state->records[index].magic != MERKLE_MAGIC)
+		{
+			for (offset = 0; offset < state->bucketCapacity; offset++)
+			{
+				if (blocks[offset]->blkno != DUMMY_BLOCK)
+				{
+					integrityFailure(state->recordNodes[index]);
+				}
+			}
+			continue;
+		}
+
+		bucketDigest(state, state->recordNodes[index], blocks, digest);
+		if (memcmp(digest, state->records[index].digest, MERKLE_HASH_SIZE) != 0)
+		{
+			integrityFailure(state->recordNodes[index]);
+		}
+	}
+}
+
+/*
+ * Makes the records of the given nodes the kept records before they are
+ * evicted. They are only read and verified again if other nodes were read or
+ * written since, e.g., by a pending eviction.
+ */
+void
+fetchRecords(ORAMState state, const TreeNode *nodes, unsigned int nnodes,
+             void *appData)
+{
+	if (state->nrecords == nnodes
+        && memcmp(state->recordNodes, nodes, sizeof(TreeNode) * nnodes) == 0)
+	{
+		return;
+	}
+
+	queueRecordReads(state, nodes, nnodes);
+	readSlots(state, appData);
+	verifyRecords(state);
+}
+
+/*
+ * Sets the digest of the kept record index to the blocks in bucketBlocks.
+ */
+void
+setBucketDigest(ORAMState state, unsigned int index)
+{
+	MerkleRecord *record = &state->records[index];
+
+	if (record->magic != MERKLE_MAGIC)
+	{
+		memset(record, 0, sizeof(MerkleRecord));
+		record->magic = MERKLE_MAGIC;
+		record->node = state->recordNodes[index];
+	}
+
+	bucketDigest(state, record->node, state->bucketBlocks, record->digest);
+}
+
+/*
+ * Updates the hashes of the kept records from the deepest node to the root,
+ * which is always among them, and queues their writes.
+ */
+void
+queueRecordWrites(ORAMState state)
+{
+	unsigned int step;
+	unsigned int index;
+	unsigned int slot;
+	size_t		offset;
+	size_t		length;
+	int			parent;
+	int			ascending = state->nrecords < 2
+		|| state->recordNodes[0] < state->recordNodes[1];
+	uint8_t		hash[MERKLE_HASH_SIZE];
+	BlockNumber lob_blkno;
+	TreeNode	node;
+	PLBlock		block;
+
+	for (step = 0; step < state->nrecords; step++)
+	{
+		index = ascending ? state->nrecords - 1 - step : step;
+		node = state->recordNodes[index];
+		nodeHash(state, &state->records[index], hash);
+
+		if (node == 0)
+		{
+			memcpy(state->rootHash, hash, MERKLE_HASH_SIZE);
+		}
+		else
+		{
+			parent = findRecord(state, (node - 1) / 2);
+			memcpy(state->records[parent].children[(node - 1) % 2], hash,
+                   MERKLE_HASH_SIZE);
+		}
+
+		lob_blkno = nodeSlot(state, node) + state->bucketCapacity;
+
+		for (slot = 0, offset = 0; slot < state->hashSlots; slot++, offset += length)
+		{
+			length = sizeof(MerkleRecord) - offset;
+			length = length < state->blockSize ? length : state->blockSize;
+
+			block = state->hashBlocks[index * state->hashSlots + slot];
+			memset(block->block, 0, state->blockSize);
+			memcpy(block->block, (char *) &state->records[index] + offset, length);
+			block->blkno = DUMMY_BLOCK;
+			block->size = state->blockSize;
+			block->location[0] = 0;
+			block->location[1] = 0;
+
+			state->ioBlocks[state->nio] = block;
+			state->ioBlknos[state->nio] = lob_blkno + slot;
+			state->nio++;
+		}
+	}
+}
+
+#endif
+
+PLBList
+getTreeNodes(ORAMState state, TreePath path, void *appData)
+{
+	int			level;
+	int			offset;
+	BlockNumber ob_blkno = 0;
+
+	/* Oblivious file Block Number */
+	PLBList		list = NULL;
+	int			index = 0;
+
+	int			lcapacity;
+	BlockNumber lob_blkno;
+
+	list = state->pathBlocks;
+
+	for (level = 0; level < state->treeHeight + 1; level++)
+	{
+
+		lcapacity = level * state->bucketCapacity;
+		lob_blkno = nodeSlot(state, path[level]);
+
+		for (offset = 0; offset < state->bucketCapacity; offset++)
+		{
+			ob_blkno = lob_blkno + offset;
+			index = lcapacity + offset;
+
+			readSlot(state, list, index, path[level], offset, ob_blkno);
+		}
+	}
+#ifdef MERKLE_INTEGRITY
+	queueRecordReads(state, path, state->treeHeight + 1);
+#endif
+	readSlots(state, appData);
+#ifdef MERKLE_INTEGRITY
+	verifyRecords(state);
+	verifyBuckets(state, list);
+#endif
+
+	return list;
+}
+
+void
+addBlocksToStash(ORAMState state, PLBList list, unsigned int nblocks, 
+                 void *appData)
+{
+
+	int			index, blkno = 0;
+	for (index = 0; index < nblocks; index++)
+	{
+        blkno = list[index]->blkno;
+        //logger(DEBUG, "block no %d", blkno);
+		if (blkno != DUMMY_BLOCK && blkno >= 0 && blkno <= state->nblocks)
+		{
+
+            #ifdef STASH_COUNT
+            state->nblocksStash += 1;
+            state->max = state->max < state->nblocksStash? state->nblocksStash: state->max;
+            #endif
+			state->amgr->am_stash->stashadd(state->stash, state->file, list[index], appData);
+		}
+		else if(blkno == DUMMY_BLOCK)
+		{
+			/*
+			 * If it's a dummy block, it is not added to the stash and there
+			 * are no more references to it, so it goes back to the pool.
+			 * Empty slots of the tree cache share the state dummy block.
+			 */
+			if (list[index] != state->dummyBlock)
+			{
+				freeBlock(list[index]);
+			}
+		}else{
+            logger(DEBUG, "Invalid block %d", blkno);
+            abort();
+        }
+	}
+}
+
+#ifndef OBLIVIOUS_EVICTION
+
+/***
+ *
+ * a_leaf -> leaf of accessed offset
+ *
+ * Plans the eviction along the path to a_leaf with a single pass over the
+ * stash. Each block is placed on the deepest level of the path it can occupy
+ * (see getDeepestLevel) or, if that bucket is already full, on the closest
+ * level above it with a free slot. Since a block that fits on a level also fits
+ * on every level above it, filling the buckets from the leaf upward selects
+ * as many blocks as the level by level greedy algorithm of the original paper.
+ *
+ * The first sharedLevels levels of the path are also part of the path of a
+ * read that waits for its eviction (see read_poram). They are left empty and
+ * filled by the last eviction along them. The blocks of those reads stay in
+ * the stash as well, since evict_poram may still write a new version of them.
+ */
+void
+getBlocksToWrite(PLBList *blocksToWrite, unsigned int a_leaf,
+                 unsigned int sharedLevels, ORAMState state, void *appData)
+{
+
+	/* Number of free slots left in the path */
+	unsigned int freeSlots = (state->treeHeight + 1 - sharedLevels) * state->bucketCapacity;
+	unsigned int level;
+	int			s_level;
+	unsigned int s_leaf = 0;
+	unsigned int index = 0;
+	unsigned int loffset;
+	unsigned int bucket_offset = 0;
+	unsigned int *totals = state->levelTotals;
+
+	PLBlock		pl_block;
+	PLBList		selectedBlocks;
+
+	selectedBlocks = state->evictBlocks;
+    AMStash* stash = state->amgr->am_stash;
+
+	memset(totals, 0, sizeof(unsigned int) * (state->treeHeight + 1));
+
+	stash->stashstartIt(state->stash, state->file, appData);
+
+	while (freeSlots > 0
+           && stash->stashnext(state->stash, state->file, &pl_block, appData))
+	{
+		checkBlock(pl_block, state->pool);
+		if (state->npending > 0 && isPending(state, pl_block->blkno))
+		{
+			continue;
+		}
+
+		s_leaf = pl_block->location[0];
+		s_level = (int) getDeepestLevel(state->treeHeight, s_leaf, a_leaf);
+
+		while (s_level >= (int) sharedLevels && totals[s_level] == state->bucketCapacity)
+		{
+			s_level--;
+		}
+
+		if (s_level >= (int) sharedLevels)
+		{
+			index = s_level * state->bucketCapacity + totals[s_level];
+			selectedBlocks[index] = pl_block;
+			totals[s_level]++;
+			freeSlots--;
+		}
+	}
+
+	for (level = 0; level < state->treeHeight + 1; level++)
+	{
+		bucket_offset = level * state->bucketCapacity;
+
+		/* remove from the stash selected blocks */
+		for (loffset = 0; loffset < totals[level]; loffset++)
+		{
+			#ifdef STASH_COUNT            
+            state->nblocksStash -=1;
+            #endif
+            index = bucket_offset + loffset;
+			stash->stashremove(state->stash, state->file, 
+                               selectedBlocks[index], appData);
+		}
+
+		/*
+		 * add padding to a tree node if there werent sufficient blocks in the
+		 * stash
+		 */
+		for (loffset = totals[level]; loffset < state->bucketCapacity; loffset++)
+		{
+            index = bucket_offset + loffset;
+			selectedBlocks[index] = state->dummyBlock;
+		}
+	}
+
+	*blocksToWrite = selectedBlocks;
+}
+
+#else							/* OBLIVIOUS_EVICTION */
+
+/*
+ * Makes room for nslots blocks, rounded up to a power of two, in the buffers
+ * of the oblivious eviction. The sorting network of an eviction has as many
+ * entries as the buffers, which are sized for the capacity of the stash when
+ * the ORAM is initialized. Only a stash without a fixed capacity can outgrow
+ * them.
+ */
+void
+reserveSortSlots(ORAMState state, unsigned int nslots)
+{
+	int			save_errno = errno;
+	unsigned int capacity = state->sortCapacity == 0 ? 1 : state->sortCapacity;
+
+	if (nslots <= state->sortCapacity)
+		return;
+
+	while (capacity < nslots)
+	{
+		capacity <<= 1;
+	}
+
+	errno = 0;
+	state->sortBlocks = (PLBList) realloc(state->sortBlocks, sizeof(PLBlock) * capacity);
+	state->sortKeys = (int *) realloc(state->sortKeys, sizeof(int) * capacity);
+	state->sortSlots = (int *) realloc(state->sortSlots, sizeof(int) * capacity);
+
+	if ((state->sortBlocks == NULL || state->sortKeys == NULL || state->sortSlots == NULL)
+		&& errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory allocating oblivious eviction buffers");
+		errno = save_errno;
+		abort();
+	}
+	errno = save_errno;
+	state->sortCapacity = capacity;
+}
+
+/*
+ * getDeepestLevel without branches. diff | 1 has the same highest bit as
+ * diff, unless diff is 0, which the last term corrects.
+ */
+static inline int
+obliviousDeepestLevel(ORAMState state, unsigned int s_leaf, unsigned int a_leaf)
+{
+	unsigned int diff = s_leaf ^ a_leaf;
+	unsigned int bits;
+
+#if defined(__GNUC__) || defined(__clang__)
+	bits = sizeof(unsigned int) * 8 - __builtin_clz(diff | 1) - (diff == 0);
+#else
+	unsigned int bit;
+
+	bits = 0;
+	for (bit = 0; bit < sizeof(unsigned int) * 8; bit++)
+	{
+		bits = (diff >> bit) != 0 ? bit + 1 : bits;
+	}
+#endif
+	return (int) state->treeHeight - (int) bits;
+}
+
+/*
+ * Sorts the n keys, a power of two, in ascending order, together with their
+ * blocks, with a bitonic sorting network. The compare-exchange of each pair
+ * is done with masks, and the pairs of a stage are contiguous runs of j
+ * entries, which the compiler can vectorize.
+ */
+void
+bitonicSort(int *keys, PLBList blocks, unsigned int n)
+{
+	unsigned int k;
+	unsigned int j;
+	unsigned int base;
+	unsigned int i;
+	int			a;
+	int			b;
+	int			mask;
+	uintptr_t	pa;
+	uintptr_t	pb;
+	uintptr_t	pmask;
+
+	for (k = 2; k <= n; k <<= 1)
+	{
+		for (j = k >> 1; j > 0; j >>= 1)
+		{
+			for (base = 0; base < n; base += j << 1)
+			{
+				for (i = base; i < base + j; i++)
+				{
+					a = keys[i];
+					b = keys[i + j];
+					/* Ascending runs where bit k of the index is clear */
+					mask = -(int) ((a > b) == ((i & k) == 0));
+					keys[i] = a ^ ((a ^ b) & mask);
+					keys[i + j] = b ^ ((a ^ b) & mask);
+
+					pa = (uintptr_t) blocks[i];
+					pb = (uintptr_t) blocks[i + j];
+					pmask = (uintptr_t) (intptr_t) mask;
+					blocks[i] = (PLBlock) (pa ^ ((pa ^ pb) & pmask));
+					blocks[i + j] = (PLBlock) (pb ^ ((pa ^ pb) & pmask));
+				}
+			}
+		}
+	}
+}
+
+/*
+ * Oblivious version of getBlocksToWrite, line 10 to 15 of original paper.
+ *
+ * The stash is read with a call to stashnext per slot of its capacity, the
+ * calls past the last stashed block filling the buffers with dummies, and
+ * the blocks, padded with dummies to the size of the sorting buffers, are
+ * sorted by the deepest level of the path they can be written to, from
+ * the leaf up. Blocks that cannot be evicted (dummies and blocks with a read
+ * waiting for its eviction) go last. A single scan of the sorted blocks then
+ * assigns each block to the deepest level not above it that still has a free
+ * slot, the same greedy choice of the non-oblivious version, and the slots of
+ * the path are filled by scanning every sorted block for each of them.
+ *
+ * Every step runs over all the entries with masks and conditional moves, so
+ * the instructions executed and the memory accessed only depend on the size
+ * of the buffers and on the tree geometry. The blocks evicted are removed
+ * from the stash by a call per slot of the path, dummies included, which the
+ * stash implementations ignore.
+ */
+void
+getBlocksToWrite(PLBList *blocksToWrite, unsigned int a_leaf,
+                 unsigned int sharedLevels, ORAMState state, void *appData)
+{
+	unsigned int n = 0;
+	unsigned int index;
+	unsigned int slot;
+	unsigned int nslots = (state->treeHeight + 1) * state->bucketCapacity;
+	int			height = (int) state->treeHeight;
+	int			capacity = (int) state->bucketCapacity;
+	int			shared = (int) sharedLevels;
+	int			level;
+	int			current;
+	int			count;
+	int			evict;
+	int			full;
+	int			found;
+	int		   *keys;
+	int		   *slots;
+	uintptr_t	pick;
+	uintptr_t	mask;
+
+	PLBlock		pl_block;
+	PLBList		blocks;
+	PLBList		selectedBlocks = state->evictBlocks;
+	AMStash    *stash = state->amgr->am_stash;
+
+	stash->stashstartIt(state->stash, state->file, appData);
+
+	for (;;)
+	{
+		pl_block = state->dummyBlock;
+		found = stash->stashnext(state->stash, state->file, &pl_block, appData);
+
+		/* Blocks past the capacity are only held by stashes that grow */
+		if (!found && n >= state->stashSize)
+			break;
+
+		checkBlock(pl_block, state->pool);
+		reserveSortSlots(state, n + 1);
+		state->sortBlocks[n] = pl_block;
+		level = obliviousDeepestLevel(state, pl_block->location[0], a_leaf);
+		level = state->npending > 0 && isPending(state, pl_block->blkno) ? -1 : level;
+		state->sortKeys[n] = found ? height - level : height + 1;
+		n++;
+	}
+
+	stash->stashcloseIt(state->stash, state->file, appData);
+
+	blocks = state->sortBlocks;
+	keys = state->sortKeys;
+	slots = state->sortSlots;
+
+	for (index = n; index < state->sortCapacity; index++)
+	{
+		blocks[index] = state->dummyBlock;
+		keys[index] = height + 1;
+	}
+	n = state->sortCapacity;
+
+	bitonicSort(keys, blocks, n);
+
+	/* Slot of the path of each sorted block or -1 if it stays in the stash */
+	current = height;
+	count = 0;
+
+	for (index = 0; index < n; index++)
+	{
+		level = height - keys[index];
+		level = level < current ? level : current;
+		count = level == current ? count : 0;
+		current = level;
+
+		evict = level >= shared;
+		slots[index] = evict ? level * capacity + count : -1;
+		count += evict;
+
+		full = count == capacity;
+		current -= full;
+		count = full ? 0 : count;
+	}
+
+	/*
+	 * A slot is assigned to at most one block, so the blocks can be combined
+	 * with a reduction that the compiler can vectorize. Slots without a block
+	 * get the dummy block.
+	 */
+	for (slot = 0; slot < nslots; slot++)
+	{
+		pick = 0;
+
+		for (index = 0; index < n; index++)
+		{
+			mask = (uintptr_t) 0 - (uintptr_t) (slots[index] == (int) slot);
+			pick |= (uintptr_t) blocks[index] & mask;
+		}
+
+		mask = (uintptr_t) 0 - (uintptr_t) (pick == 0);
+		selectedBlocks[slot] = (PLBlock) (pick | ((uintptr_t) state->dummyBlock & mask));
+	}
+
+	for (slot = 0; slot < nslots; slot++)
+	{
+		#ifdef STASH_COUNT
+		state->nblocksStash -= selectedBlocks[slot]->blkno != DUMMY_BLOCK;
+		#endif
+		stash->stashremove(state->stash, state->file, selectedBlocks[slot], appData);
+	}
+
+	*blocksToWrite = selectedBlocks;
+}
+
+#endif							/* OBLIVIOUS_EVICTION */
+
+void
+writeBlocksToStorage(PLBList list, unsigned int leaf, ORAMState state, void *appData)
+{
+	unsigned int list_offset = (state->treeHeight + 1) * state->bucketCapacity - 1;
+	unsigned int currentPos = 0;
+	unsigned int index;
+	BlockNumber ob_blkno = 0;
+	BlockNumber lob_blkno = 0;
+	PLBlock		block = NULL;
+	unsigned int list_idx = 0;
+#ifdef MERKLE_INTEGRITY
+	unsigned int level = state->treeHeight;
+
+	fetchRecords(state, getTreePath(state, leaf), state->treeHeight + 1, appData);
+#endif
+
+	currentPos = leaf + (1 << state->treeHeight);
+
+	while (currentPos > 0)
+	{
+
+		lob_blkno = nodeSlot(state, currentPos - 1);
+
+		for (index = 0; index < state->bucketCapacity; index++)
+		{
+			ob_blkno = lob_blkno + index;
+			list_idx = list_offset - index;
+			block = list[list_idx];
+
+#ifdef MERKLE_INTEGRITY
+			state->bucketBlocks[index] = block;
+#endif
+			writeSlot(state, block, currentPos - 1, index, ob_blkno);
+		}
+#ifdef MERKLE_INTEGRITY
+		setBucketDigest(state, level--);
+#endif
+		list_offset -= state->bucketCapacity;
+		currentPos >>= 1;
+
+	}
+#ifdef MERKLE_INTEGRITY
+	queueRecordWrites(state);
+#endif
+	writeSlots(state, appData);
+}
 
 
 
@@ -528,7 +1773,7 @@ updateStashWithNewBlock(void *data, unsigned int blkSize, BlockNumber blkno,
         return;
 
 
-	PLBlock		plblock = createBlock((int) blkno, blkSize, data);
+	PLBlock		plblock = createPooledBlock(state->pool, (int) blkno, blkSize, data);
     //setLocation(plblock, location, sizeof(struct Location));
     plblock->location[0] = location->leaf;
     int         found = 0;
@@ -546,81 +1791,240 @@ updateStashWithNewBlock(void *data, unsigned int blkSize, BlockNumber blkno,
 }
 
 
+/*
+ * Number of levels, from the root, of the path to leaf that are also part of
+ * the path of a read waiting for its eviction. The blocks of those levels
+ * were moved to the stash by the first read and the copies in the oblivious
+ * file are stale until the last of those reads is evicted.
+ */
+unsigned int
+getSharedLevels(ORAMState state, unsigned int leaf)
+{
+	unsigned int index;
+	unsigned int levels;
+	unsigned int shared = 0;
+
+	for (index = 0; index < state->npending; index++)
+	{
+		levels = getDeepestLevel(state->treeHeight, leaf, state->pending[index].leaf) + 1;
+		shared = levels > shared ? levels : shared;
+	}
+
+	return shared;
+}
+
+/*
+ * Returns 1 if a read of blkno waits for its eviction, 0 otherwise.
+ */
+unsigned int
+isPending(ORAMState state, BlockNumber blkno)
+{
+	unsigned int index;
+
+	for (index = 0; index < state->npending; index++)
+	{
+		if (state->pending[index].blkno == blkno)
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Line 1 to 5 of original paper. Maps blkno to a new leaf, returned in
+ * nLocation, and moves the blocks of the path to its previous leaf to the
+ * stash. Returns the previous leaf.
+ */
+unsigned int
+fetchPath(ORAMState state, BlockNumber blkno, Location nLocation, void *appData)
+{
+	unsigned int leaf;
+	unsigned int shared;
+	unsigned int index;
+	TreePath	path = NULL;
+	PLBList		list = NULL;
+	AMPMap	   *pmap = state->amgr->am_pmap;
+
+	leaf = pmap->pmget(state->pmap, state->file, blkno)->leaf;
+	pmap->pmupdate(state->pmap, state->file, blkno);
+
+	shared = getSharedLevels(state, leaf) * state->bucketCapacity;
+
+	path = getTreePath(state, leaf);
+	list = getTreeNodes(state, path, appData);
+
+	/* Stale copies of the blocks already in the stash */
+	for (index = 0; index < shared; index++)
+	{
+		if (list[index] != state->dummyBlock)
+		{
+			freeBlock(list[index]);
+		}
+	}
+
+	addBlocksToStash(state, list + shared,
+                     (state->treeHeight + 1) * state->bucketCapacity - shared,
+                     appData);
+
+	nLocation->leaf = pmap->pmget(state->pmap, state->file, blkno)->leaf;
+
+	/* Reads of blkno waiting for their eviction must use the new leaf */
+	for (index = 0; index < state->npending; index++)
+	{
+		if (state->pending[index].blkno == blkno)
+		{
+			state->pending[index].newLeaf = nLocation->leaf;
+		}
+	}
+
+	return leaf;
+}
+
+/*
+ * Line 10 to 15 of original paper.
+ */
+void
+evictPath(ORAMState state, unsigned int leaf, void *appData)
+{
+	PLBList		blocks_to_write = NULL;
+
+	getBlocksToWrite(&blocks_to_write, leaf, getSharedLevels(state, leaf),
+                     state, appData);
+	writeBlocksToStorage(blocks_to_write, leaf, state, appData);
+}
+
+/*
+ * Registers that the path to leaf was read for blkno and must be evicted by
+ * evict_poram.
+ */
+void
+addPendingEviction(ORAMState state, BlockNumber blkno, unsigned int leaf,
+                   unsigned int newLeaf)
+{
+	int			save_errno = errno;
+
+	if (state->npending == state->pendingCapacity)
+	{
+		state->pendingCapacity = state->pendingCapacity == 0 ? 4 : state->pendingCapacity * 2;
+
+		errno = 0;
+		state->pending = (PendingEviction *) realloc(state->pending,
+                                                     sizeof(PendingEviction) * state->pendingCapacity);
+
+		if (state->pending == NULL && errno == ENOMEM)
+		{
+			logger(OUT_OF_MEMORY, "Out of memory registering pending eviction");
+			errno = save_errno;
+			abort();
+		}
+		errno = save_errno;
+	}
+
+	state->pending[state->npending].blkno = blkno;
+	state->pending[state->npending].leaf = leaf;
+	state->pending[state->npending].newLeaf = newLeaf;
+	state->npending++;
+}
+
 int
-read_oram(char **ptr, BlockNumber blkno, ORAMState state, void *appData)
+read_poram(char **ptr, BlockNumber blkno, ORAMState state, void *appData)
 {
-
     if(blkno < 0 || blkno > state->nblocks){
-        logger(DEBUG, "Requested read_oram on invalid address %d", blkno);
+        logger(DEBUG, "Requested read_poram on invalid address %d", blkno);
         abort();
     }
 
-	Location	    location;
     struct Location nLocation;
 	unsigned int    leaf = 0;
 	unsigned int    result = 0;
-	TreePath	    path = NULL;
-	PLBList		    list = NULL;
-	PLBList		    blocks_to_write = NULL;
     
-    AMPMap*      pmap = state->amgr->am_pmap;  
     AMStash*     stash = state->amgr->am_stash;
 
-	/* printf("Creating empty block\n"); */
-	PLBlock		plblock = createEmptyBlock();
-
-	/* printf("getting possition map\n"); */
-	/* line 1 and 2 of original paper */
-	location = pmap->pmget(state->pmap, state->file, blkno);
-	leaf = location->leaf;
+	/*
+	 * The requested block is copied from the stash to a buffer that is
+	 * returned to the caller.
+	 */
+	struct PLBlock plblock;
 
-	/* printf("getting updateBlockLeaf\n"); */
-	pmap->pmupdate(state->pmap, state->file, blkno);
+	memset(&plblock, 0, sizeof(struct PLBlock));
+	plblock.blkno = DUMMY_BLOCK;
+	plblock.size = -1;
 
-	/* line 3 to 5 of original paper */
-	path = getTreePath(state, leaf);
-	list = getTreeNodes(state, path, appData);
-	/* printf("Add blocks to stash\n"); */
-	addBlocksToStash(state, list, appData);
-	/* printf("Getting block to stash\n"); */
+	/* line 1 to 5 of original paper */
+	leaf = fetchPath(state, blkno, &nLocation, appData);
 	
     /* Line 6 of original paper */
-	stash->stashget(state->stash, plblock, blkno, state->file, appData);
+	stash->stashget(state->stash, &plblock, blkno, state->file, appData);
     
     //Updat the block location in the stash if its stored there.
-    nLocation.leaf = pmap->pmget(state->pmap, state->file, blkno)->leaf;
-
-    //logger(DEBUG, "read ORAM offset %d from leaf %d to leaf %d\n", blkno, leaf, nLocation.leaf); 
-    updateStashWithNewBlock(plblock->block, plblock->size, plblock->blkno, 
+    updateStashWithNewBlock(plblock.block, plblock.size, plblock.blkno, 
                             state, &nLocation, appData);
-	/* printf("get blocks to write\n"); */
-	/* line 10 to 15 of original paper */
-	getBlocksToWrite(&blocks_to_write, leaf, state, appData);
-	/* printf("Write blocks to storage\n"); */
-	writeBlocksToStorage(blocks_to_write, leaf, state, appData);
 
-	/* Free Resources */
-	free(path);
-	/* The plblocks of the list cannot be freed as they may be in the stash */
-	free(list);
-	free(blocks_to_write);
-	*ptr = plblock->block;
+	addPendingEviction(state, blkno, leaf, nLocation.leaf);
+
+	*ptr = plblock.block;
 
 	/* No block has been inserted yet */
-	if (plblock->blkno == DUMMY_BLOCK)
+	if (plblock.blkno == DUMMY_BLOCK)
 	{
 		result = DUMMY_BLOCK;
 	}
 	else
 	{
-		result = plblock->size;
+		result = plblock.size;
 	}
-    //free(plblock->location);
-	free(plblock);
 	return result;
 
 }
 
+int
+evict_poram(char *data, unsigned int blkSize, BlockNumber blkno, ORAMState state, void *appData)
+{
+	int			index;
+	unsigned int leaf = 0;
+	struct Location nLocation;
+
+	for (index = (int) state->npending - 1; index >= 0; index--)
+	{
+		if (state->pending[index].blkno == blkno)
+			break;
+	}
+
+	if (index < 0)
+	{
+		logger(DEBUG, "Requested evict_poram of block %d without a pending read", blkno);
+		abort();
+	}
+
+	leaf = state->pending[index].leaf;
+	nLocation.leaf = state->pending[index].newLeaf;
+	state->npending--;
+	state->pending[index] = state->pending[state->npending];
+
+	/* line 7 to 9 of original paper */
+	if (blkSize != DUMMY_BLOCK)
+	{
+		updateStashWithNewBlock(data, blkSize, blkno, state, &nLocation, appData);
+	}
+
+	evictPath(state, leaf, appData);
+
+	return blkSize;
+}
+
+int
+read_oram(char **ptr, BlockNumber blkno, ORAMState state, void *appData)
+{
+	int			result;
+
+	result = read_poram(ptr, blkno, state, appData);
+	evict_poram(NULL, DUMMY_BLOCK, blkno, state, appData);
+
+	return result;
+}
+
 int
 write_oram(char *data, unsigned int blkSize, BlockNumber blkno, ORAMState state, void *appData)
 {
@@ -630,48 +2034,450 @@ write_oram(char *data, unsigned int blkSize, BlockNumber blkno, ORAMState state,
         abort();
     }
     
-   	Location	location;
-    /*current location*/
     struct Location nLocation;
-
 	unsigned int leaf = 0;
-	TreePath	path = NULL;
-	PLBList		list = NULL;
-	PLBList		blocks_to_write = NULL;
-    AMPMap*     pmap = state->amgr->am_pmap;  
-    //logger(DEBUG, "write_oram blocknumber %d\n", blkno);
-	/* line 1 and 2 of original paper */
-	location = pmap->pmget(state->pmap, state->file, blkno);
-	leaf = location->leaf;
 
-    pmap->pmupdate(state->pmap, state->file, blkno);
-	
-    /* line 3 to 5 of original paper */
-	path = getTreePath(state, leaf);
-	list = getTreeNodes(state, path, appData);
-	addBlocksToStash(state, list, appData);
+	/* line 1 to 5 of original paper */
+	leaf = fetchPath(state, blkno, &nLocation, appData);
 
-    nLocation.leaf = pmap->pmget(state->pmap, state->file, blkno)->leaf;
-    //logger(DEBUG, "Write ORAM offset %d from leaf %d to leaf %d\n", blkno, leaf, nLocation.leaf); 
 	/* line 7 to 9 of original paper */
 	updateStashWithNewBlock(data, blkSize, blkno, state, &nLocation, appData);
 
 	/* line 10 to 15 of original paper */
-	getBlocksToWrite(&blocks_to_write, leaf, state, appData);
-	writeBlocksToStorage(blocks_to_write, leaf, state, appData);
-
-	/* Free Resources */
-	free(path);
-	/* The plblocks of the list cannot be freed as they may be in the stash */
-	free(list);
-	free(blocks_to_write);
+	evictPath(state, leaf, appData);
 
 	return blkSize;
 }
 
+#ifndef OBLIVIOUS_EVICTION
+
+/*
+ * Prepares the state for its first batch. The stash is recreated with room
+ * for the real blocks of BATCH_PASS_SIZE paths, moving the blocks it holds,
+ * and the buffers of a pass are allocated for the union of BATCH_PASS_SIZE
+ * paths.
+ */
+void
+initBatch(ORAMState state, void *appData)
+{
+	unsigned int index;
+	unsigned int nblocks = 0;
+	unsigned int capacity = 0;
+	unsigned int stashSize;
+	unsigned int pathNodes = BATCH_PASS_SIZE * (state->treeHeight + 1);
+	unsigned int pathSlots = pathNodes * state->bucketCapacity;
+	PLBlock		pl_block;
+	PLBList		blocks = NULL;
+	Stash		stash;
+	int			save_errno = errno;
+
+	AMStash    *amstash = state->amgr->am_stash;
+
+	if (state->batchLeaves != NULL)
+		return;
+
+	errno = 0;
+	amstash->stashstartIt(state->stash, state->file, appData);
+
+	while (amstash->stashnext(state->stash, state->file, &pl_block, appData))
+	{
+		if (nblocks == capacity)
+		{
+			capacity = capacity == 0 ? state->stashSize : capacity * 2;
+			blocks = (PLBList) realloc(blocks, sizeof(PLBlock) * capacity);
+
+			if (blocks == NULL && errno == ENOMEM)
+			{
+				logger(OUT_OF_MEMORY, "Out of memory growing the stash");
+				errno = save_errno;
+				abort();
+			}
+		}
+		blocks[nblocks++] = pl_block;
+	}
+
+	amstash->stashcloseIt(state->stash, state->file, appData);
+
+	stashSize = state->stashSize
+		+ (BATCH_PASS_SIZE - 1) * ((state->treeHeight + 1) * state->bucketCapacity + 1);
+	stash = amstash->stashinit(state->file, stashSize, state->blockSize, appData);
+
+	for (index = 0; index < nblocks; index++)
+	{
+		amstash->stashremove(state->stash, state->file, blocks[index], appData);
+		amstash->stashadd(stash, state->file, blocks[index], appData);
+	}
+
+	amstash->stashclose(state->stash, state->file, appData);
+	state->stash = stash;
+	state->stashSize = stashSize;
+	free(blocks);
+
+	state->batchLeaves = (unsigned int *) malloc(sizeof(unsigned int) * BATCH_PASS_SIZE * 2);
+	state->batchPaths = (unsigned int *) malloc(sizeof(unsigned int) * BATCH_PASS_SIZE);
+	state->batchNodes = (TreePath) malloc(sizeof(TreeNode) * pathNodes);
+	state->batchIndexes = (unsigned int *) malloc(sizeof(unsigned int) * pathNodes);
+	state->batchBlocks = (PLBList) malloc(sizeof(PLBlock) * pathSlots);
+	state->batchSelected = (PLBList) malloc(sizeof(PLBlock) * pathSlots);
+	state->batchTotals = (unsigned int *) malloc(sizeof(unsigned int) * pathNodes);
+
+	if ((state->batchLeaves == NULL || state->batchPaths == NULL
+		 || state->batchNodes == NULL || state->batchIndexes == NULL
+		 || state->batchBlocks == NULL || state->batchSelected == NULL
+		 || state->batchTotals == NULL) && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory allocating batch buffers");
+		errno = save_errno;
+		abort();
+	}
+	errno = save_errno;
+}
+
+/*
+ * Orders leaves from the largest to the smallest.
+ */
+static int
+compareLeaves(const void *a, const void *b)
+{
+	unsigned int la = *((const unsigned int *) a);
+	unsigned int lb = *((const unsigned int *) b);
+
+	return (la < lb) - (la > lb);
+}
+
+/**
+ * Computes the union of the tree paths to the input leaves in batchNodes. The
+ * paths of different leaves always share the root and usually a few upper
+ * levels, which are only kept once. The resulting nodes are sorted from the
+ * deepest level to the root, the order in which evictBatchNodes fills them.
+ *
+ * The leaves are sorted in batchPaths from the largest to the smallest, so
+ * the nodes of each level are visited in descending order and repeated nodes
+ * are next to each other. The index in batchNodes of the node of the path to
+ * batchPaths[i] at level l is kept in batchIndexes[i * (L + 1) + l].
+ */
+unsigned int
+getBatchNodes(ORAMState state, const unsigned int *leaves, unsigned int nleaves)
+{
+	unsigned int index;
+	unsigned int nnodes = 0;
+	int			level;
+	TreeNode	node;
+	TreePath	nodes = state->batchNodes;
+	unsigned int *paths = state->batchPaths;
+
+	memcpy(paths, leaves, sizeof(unsigned int) * nleaves);
+	qsort(paths, nleaves, sizeof(unsigned int), &compareLeaves);
+
+	for (level = state->treeHeight; level >= 0; level--)
+	{
+		for (index = 0; index < nleaves; index++)
+		{
+			node = ((paths[index] + (1 << state->treeHeight))
+					>> (state->treeHeight - level)) - 1;
+
+			if (index == 0 || nodes[nnodes - 1] != node)
+			{
+				nodes[nnodes++] = node;
+			}
+			state->batchIndexes[index * (state->treeHeight + 1) + level] = nnodes - 1;
+		}
+	}
+
+	return nnodes;
+}
+
+PLBList
+getBatchTreeNodes(ORAMState state, unsigned int nnodes, void *appData)
+{
+	unsigned int index;
+	unsigned int offset;
+	BlockNumber lob_blkno;
+	TreePath	nodes = state->batchNodes;
+	PLBList		list = state->batchBlocks;
+
+	reserveIOSlots(state, nnodes * state->slotsPerNode);
+
+	for (index = 0; index < nnodes; index++)
+	{
+		lob_blkno = nodeSlot(state, nodes[index]);
+
+		for (offset = 0; offset < state->bucketCapacity; offset++)
+		{
+			readSlot(state, list, index * state->bucketCapacity + offset,
+                     nodes[index], offset, lob_blkno + offset);
+		}
+	}
+#ifdef MERKLE_INTEGRITY
+	queueRecordReads(state, nodes, nnodes);
+#endif
+	readSlots(state, appData);
+#ifdef MERKLE_INTEGRITY
+	verifyRecords(state);
+	verifyBuckets(state, list);
+#endif
+
+	return list;
+}
+
+/**
+ * Evicts the stash along the union of the paths of a batch with a single pass
+ * over the stash. Each block is placed on the deepest node of its own path
+ * that is part of the union and still has a free slot. Afterwards, each node is
+ * written to storage exactly once.
+ *
+ * The nodes of the path of a block that are part of the union are those down
+ * to the deepest level it shares with one of the paths of the batch, and
+ * their indexes are those of that path (see getBatchNodes).
+ */
+void
+evictBatchNodes(ORAMState state, unsigned int nnodes, unsigned int nleaves,
+                void *appData)
+{
+	unsigned int index;
+	unsigned int offset;
+	unsigned int freeSlots = nnodes * state->bucketCapacity;
+	unsigned int path;
+	unsigned int shared;
+	int			s_level;
+	int			deepest;
+	unsigned int *indexes;
+	unsigned int *totals = state->batchTotals;
+	TreePath	nodes = state->batchNodes;
+	BlockNumber lob_blkno;
+	PLBlock		pl_block;
+	PLBList		selectedBlocks = state->batchSelected;
+
+	AMStash    *stash = state->amgr->am_stash;
+
+	memset(totals, 0, sizeof(unsigned int) * nnodes);
+
+	stash->stashstartIt(state->stash, state->file, appData);
+
+	while (freeSlots > 0
+           && stash->stashnext(state->stash, state->file, &pl_block, appData))
+	{
+		checkBlock(pl_block, state->pool);
+
+		deepest = -1;
+		indexes = NULL;
+
+		for (path = 0; path < nleaves; path++)
+		{
+			shared = getDeepestLevel(state->treeHeight, pl_block->location[0],
+                                     state->batchPaths[path]);
+			if ((int) shared > deepest)
+			{
+				deepest = (int) shared;
+				indexes = &state->batchIndexes[path * (state->treeHeight + 1)];
+			}
+		}
+
+		for (s_level = deepest; s_level >= 0; s_level--)
+		{
+			index = indexes[s_level];
+
+			if (totals[index] < state->bucketCapacity)
+			{
+				selectedBlocks[index * state->bucketCapacity + totals[index]] = pl_block;
+				totals[index]++;
+				freeSlots--;
+				break;
+			}
+		}
+	}
+
+#ifdef MERKLE_INTEGRITY
+	fetchRecords(state, nodes, nnodes, appData);
+#endif
+
+	for (index = 0; index < nnodes; index++)
+	{
+		lob_blkno = nodeSlot(state, nodes[index]);
+
+		for (offset = 0; offset < state->bucketCapacity; offset++)
+		{
+			if (offset < totals[index])
+			{
+				#ifdef STASH_COUNT
+                state->nblocksStash -= 1;
+                #endif
+				pl_block = selectedBlocks[index * state->bucketCapacity + offset];
+				stash->stashremove(state->stash, state->file, pl_block, appData);
+			}
+			else
+			{
+				pl_block = state->dummyBlock;
+			}
+
+#ifdef MERKLE_INTEGRITY
+			state->bucketBlocks[offset] = pl_block;
+#endif
+			writeSlot(state, pl_block, nodes[index], offset, lob_blkno + offset);
+		}
+#ifdef MERKLE_INTEGRITY
+		setBucketDigest(state, index);
+#endif
+	}
+#ifdef MERKLE_INTEGRITY
+	queueRecordWrites(state);
+#endif
+	writeSlots(state, appData);
+}
+
+/**
+ * Serves a batch of at most BATCH_PASS_SIZE requests with a single fetch of
+ * the union of their paths. The position map is consulted and updated for
+ * every request before any path is read, the requests are then served from
+ * the stash in order and the stash is finally evicted along all of the
+ * fetched paths.
+ *
+ * If blkSizes is NULL the batch is a read batch and the requested blocks are
+ * returned in data and their sizes in results. Otherwise, data holds the
+ * blocks to write and results gets what write_oram returns for each of them.
+ */
+void
+accessBatch(ORAMState state, const BlockNumber *blknos, unsigned int nrequests,
+            char **data, const unsigned int *blkSizes, int *results,
+            void *appData)
+{
+	unsigned int index;
+	unsigned int nnodes = 0;
+	unsigned int *leaves = state->batchLeaves;
+	unsigned int *newLeaves = state->batchLeaves + BATCH_PASS_SIZE;
+	BlockNumber blkno;
+	PLBList		list = NULL;
+	struct PLBlock plblock;
+	struct Location nLocation;
+
+	AMPMap	   *pmap = state->amgr->am_pmap;
+	AMStash    *stash = state->amgr->am_stash;
+
+	/* The union of the paths is read and written as a whole */
+	if (state->npending > 0)
+	{
+		logger(DEBUG, "Batched access with %d reads waiting for eviction", state->npending);
+		abort();
+	}
+
+	/* line 1 and 2 of original paper for every request */
+	for (index = 0; index < nrequests; index++)
+	{
+		blkno = blknos[index];
+
+		if (blkno < 0 || blkno > state->nblocks)
+		{
+			logger(DEBUG, "Requested batch access on invalid address %d", blkno);
+			abort();
+		}
+
+		leaves[index] = pmap->pmget(state->pmap, state->file, blkno)->leaf;
+		pmap->pmupdate(state->pmap, state->file, blkno);
+		newLeaves[index] = pmap->pmget(state->pmap, state->file, blkno)->leaf;
+	}
+
+	/* line 3 to 5 of original paper over the union of the paths */
+	nnodes = getBatchNodes(state, leaves, nrequests);
+	list = getBatchTreeNodes(state, nnodes, appData);
+	addBlocksToStash(state, list, nnodes * state->bucketCapacity, appData);
+
+	/* line 6 to 9 of original paper for every request */
+	for (index = 0; index < nrequests; index++)
+	{
+		nLocation.leaf = newLeaves[index];
+
+		if (blkSizes == NULL)
+		{
+			memset(&plblock, 0, sizeof(struct PLBlock));
+			plblock.blkno = DUMMY_BLOCK;
+			plblock.size = -1;
+			stash->stashget(state->stash, &plblock, blknos[index], state->file,
+                            appData);
+			updateStashWithNewBlock(plblock.block, plblock.size,
+                                    plblock.blkno, state, &nLocation, appData);
+			data[index] = plblock.block;
+			results[index] = plblock.blkno == DUMMY_BLOCK ? DUMMY_BLOCK : plblock.size;
+		}
+		else
+		{
+			updateStashWithNewBlock(data[index], blkSizes[index], blknos[index],
+                                    state, &nLocation, appData);
+			results[index] = blkSizes[index];
+		}
+	}
+
+	/* line 10 to 15 of original paper over the union of the paths */
+	evictBatchNodes(state, nnodes, nrequests, appData);
+}
+
+#endif							/* OBLIVIOUS_EVICTION */
+
+/*
+ * Batches are served in passes of at most BATCH_PASS_SIZE requests, in order,
+ * so that the stash never holds more than the paths of a pass on top of the
+ * room it had for a single path before the first batch. Oblivious
+ * evictions serve a request at a time, see OBLIVIOUS_EVICTION.
+ */
+int
+read_oram_batch(char **ptrs, int *results, const BlockNumber *blknos,
+                unsigned int nrequests, ORAMState state, void *appData)
+{
+	unsigned int index;
+#ifdef OBLIVIOUS_EVICTION
+
+	for (index = 0; index < nrequests; index++)
+	{
+		results[index] = read_oram(&ptrs[index], blknos[index], state, appData);
+	}
+#else
+	unsigned int npass;
+
+	initBatch(state, appData);
+
+	for (index = 0; index < nrequests; index += npass)
+	{
+		npass = nrequests - index < BATCH_PASS_SIZE ? nrequests - index : BATCH_PASS_SIZE;
+		accessBatch(state, blknos + index, npass, ptrs + index, NULL,
+                    results + index, appData);
+	}
+#endif
+	return nrequests;
+}
+
+int
+write_oram_batch(char **data, const unsigned int *blkSizes, int *results,
+                 const BlockNumber *blknos, unsigned int nrequests,
+                 ORAMState state, void *appData)
+{
+	unsigned int index;
+#ifdef OBLIVIOUS_EVICTION
+
+	for (index = 0; index < nrequests; index++)
+	{
+		results[index] = write_oram(data[index], blkSizes[index], blknos[index],
+                                    state, appData);
+	}
+#else
+	unsigned int npass;
+
+	initBatch(state, appData);
+
+	for (index = 0; index < nrequests; index += npass)
+	{
+		npass = nrequests - index < BATCH_PASS_SIZE ? nrequests - index : BATCH_PASS_SIZE;
+		accessBatch(state, blknos + index, npass, data + index,
+                    blkSizes + index, results + index, appData);
+	}
+#endif
+	return nrequests;
+}
+
 void
 close_oram(ORAMState state, void *appData)
 {
+#ifdef MERKLE_INTEGRITY
+	unsigned int index;
+#endif
 
     #ifdef STASH_COUNT
     logStashes(state);
@@ -679,12 +2485,47 @@ close_oram(ORAMState state, void *appData)
 	state->amgr->am_stash->stashclose(state->stash, state->file, appData);
 	state->amgr->am_pmap->pmclose(state->pmap, state->file);
 	state->amgr->am_ofile->ofileclose(state->fhandler, state->file, appData);
+	freeBlockPool(state->pool);
+	freeBlock(state->dummyBlock);
+	free(state->path);
+	free(state->pathBlocks);
+	free(state->evictBlocks);
+	free(state->batchLeaves);
+	free(state->batchPaths);
+	free(state->batchNodes);
+	free(state->batchIndexes);
+	free(state->batchBlocks);
+	free(state->batchSelected);
+	free(state->batchTotals);
+	free(state->levelTotals);
+	free(state->cache);
+	free(state->ioBlocks);
+	free(state->ioBlknos);
+	free(state->pending);
+#ifdef OBLIVIOUS_EVICTION
+	free(state->sortBlocks);
+	free(state->sortKeys);
+	free(state->sortSlots);
+#endif
+#ifdef MERKLE_INTEGRITY
+	for (index = 0; index < state->recordCapacity * state->hashSlots; index++)
+	{
+		free(state->hashBlocks[index]);
+	}
+	free(state->hashBlocks);
+	free(state->hashArena);
+	free(state->records);
+	free(state->recordNodes);
+	free(state->bucketBlocks);
+	memset(&state->macKey, 0, sizeof(AESKey));
+#endif
 	free(state->file);
 	free(state->amgr->am_stash);
 	free(state->amgr->am_pmap);
 	free(state->amgr->am_ofile);
+	free(state->ofileExt);
+	free(state->pmapExt);
 	free(state);
-    freeDummyBlock();
 }
 
 
@@ -696,6 +2537,24 @@ void setToken(ORAMState state, const unsigned int* token){
     }
 }
 
+void setTokens(ORAMState state, const unsigned int* tokens, unsigned int ntokens){
+    if (state->pmapExt != NULL && state->pmapExt->pmstokens != NULL){
+        state->pmapExt->pmstokens(state->pmap, tokens, ntokens);
+    }else{
+        logger(DEBUG, "Set Tokens function is not available in PMAP!");
+    }
+}
+
+void setOFileExt(ORAMState state, AMOFileExt *ext){
+    free(state->ofileExt);
+    state->ofileExt = ext;
+}
+
+void setPMapExt(ORAMState state, AMPMapExt *ext){
+    free(state->pmapExt);
+    state->pmapExt = ext;
+}
+
 #ifdef STASH_COUNT
 void
 logStashes(ORAMState state){
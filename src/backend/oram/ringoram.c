@@ -0,0 +1,1038 @@
+/*-------------------------------------------------------------------------
+ *
+ * ringoram.c
+ *		  Implementation of non-recursive ring-oram algorithm.
+ *
+ *		Original paper URL: https://eprint.iacr.org/2014/997.pdf
+ *
+ * Ring ORAM keeps the tree of Path ORAM but each bucket has, besides the Z
+ * slots for real blocks, S slots that only hold dummy blocks. The slots of a
+ * bucket are randomly permuted every time the bucket is written, so an access
+ * reads a single slot per bucket of the path: the requested block if it is
+ * in the bucket or a dummy that has not been read yet otherwise. A bucket is
+ * reshuffled once its S dummies may have been consumed, and every A accesses
+ * the stash is evicted along a path chosen in reverse lexicographic order.
+ *
+ * The metadata of a bucket (which block each slot holds, whether it has been
+ * read and how many slots have been read) is a header stored in the oblivious
+ * file after the Z+S slots of the bucket. Headers are read with the buckets
+ * of the path and written back with them, so the client only keeps the
+ * headers of a path.
+ *
+ * As in pathoram.c, the only errors this library takes into account are out
+ * of memory errors, in which case the execution is aborted.
+ *
+ * Copyright (c) 2018-2020, HASLab
+ *
+ * IDENTIFICATION
+ *		  backend/oram/ringoram.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#include "oram/oram.h"
+#include "oram/coram.h"
+#include "oram/logger.h"
+#include "oram/orandom.h"
+#include "oram/pmapdefs/pdeforam.h"
+
+/*
+ * Number of accesses between evictions (A). If 0 it is derived from the
+ * bucket capacity.
+ */
+#ifndef RINGORAM_EVICTION_RATE
+#define RINGORAM_EVICTION_RATE 0
+#endif
+
+/*
+ * Number of dummy slots per bucket (S). If 0 it is derived from the eviction
+ * rate.
+ */
+#ifndef RINGORAM_DUMMY_SLOTS
+#define RINGORAM_DUMMY_SLOTS 0
+#endif
+
+/*
+ * A bucket header is an array of bucketSize + 1 words. The first one counts
+ * the slots read since the bucket was written and the others describe each
+ * slot: the block number plus one, or zero for a dummy block, with
+ * HEADER_SLOT_READ set once the slot has been read. A header that was never
+ * written reads as zeros, a bucket of dummies that has not been read.
+ */
+#define HEADER_SLOT_READ 0x80000000u
+
+
+typedef unsigned int TreeNode;
+
+typedef TreeNode *TreePath;
+
+struct ORAMState
+{
+	unsigned int blockSize;
+	/* Size of a single block in Bytes(B) */
+	unsigned int treeHeight;
+	/* Tree Height of the oblivious file(L) */
+	unsigned int bucketCapacity;
+	/* Number of real blocks in a Tree node(Z) */
+	unsigned int dummySlots;
+	/* Number of dummy blocks in a Tree node(S) */
+	unsigned int bucketSize;
+	/* Number of slots in a Tree node (Z+S) */
+	unsigned int headerSlots;
+	/* Slots of the oblivious file that hold the header of a Tree node */
+	unsigned int slotsPerNode;
+	/* Slots of the oblivious file per Tree node (Z+S plus the header) */
+	unsigned int evictionRate;
+	/* Number of accesses between evictions(A) */
+
+	unsigned int nblocks;
+
+	char	   *file;
+	/* File name of the protected file. */
+
+	Amgr	   *amgr;
+
+	/* Set of external functions to handle ORAM states. */
+	AMOFileExt *ofileExt;
+	AMPMapExt  *pmapExt;
+	/* Optional operations of am_ofile and am_pmap, NULL until set */
+	Stash		stash;
+	PMap		pmap;
+	FileHandler fhandler;
+
+	uint32_t   *headers;
+	/* Header of the bucket last read or written at each tree level */
+	TreeNode   *headerNodes;
+	/* Tree node of each header, the number of tree nodes if none */
+	PLBList		headerBlocks;
+	char	   *headerArena;
+	/* headerSlots blocks exchanged with the oblivious file */
+
+	unsigned int round;
+	/* Number of accesses since the last eviction */
+	unsigned int evictions;
+	/* Number of evictions, determines the next eviction path */
+
+	unsigned int *levelTotals;
+	/* Number of blocks selected for each tree level during an eviction */
+
+	BlockPool	pool;
+	/* Blocks read from the oblivious file and stashed */
+	TreePath	path;
+	PLBList		evictBlocks;
+	PLBList		bucketBlocks;
+	unsigned int *permutation;
+	/* Buffers of the path and bucket being accessed */
+
+	PLBlock		dummyBlock;
+	/* Block written to the dummy slots of a bucket */
+
+#ifdef STASH_COUNT
+	unsigned int max;
+	unsigned int nblocksStash;
+#endif
+};
+
+
+/* non-export function prototypes */
+
+static unsigned int calculateTreeHeight(unsigned int minimumNumberOfNodes);
+
+static ORAMState buildORAMState(const char *filename, unsigned int blockSize,
+                                unsigned int treeHeight,
+                                unsigned int bucketCapacity, Amgr *amgr);
+
+static void *allocate(size_t size);
+
+static TreePath getTreePath(ORAMState state, unsigned int leaf);
+
+static uint32_t *getHeader(ORAMState state, unsigned int level);
+
+static void readHeader(ORAMState state, TreeNode node, unsigned int level,
+                       void *appData);
+
+static void writeHeader(ORAMState state, unsigned int level, void *appData);
+
+static PLBlock readSlot(ORAMState state, unsigned int level, unsigned int slot,
+                        void *appData);
+
+static unsigned int getRandomDummySlot(ORAMState state, unsigned int level);
+
+static void readPath(ORAMState state, unsigned int leaf, BlockNumber blkno,
+                     void *appData);
+
+static void readBucket(ORAMState state, unsigned int level, void *appData);
+
+static void writeBucket(ORAMState state, TreeNode node, unsigned int level,
+                        PLBList blocks, unsigned int nblocks, void *appData);
+
+static void evictPath(ORAMState state, void *appData);
+
+static void earlyReshuffle(ORAMState state, unsigned int leaf, void *appData);
+
+static void finishAccess(ORAMState state, unsigned int leaf, void *appData);
+
+static void updateStashWithNewBlock(void *data, unsigned int blockSize,
+                                    BlockNumber blkno, ORAMState state,
+                                    Location location, void *appData);
+
+
+ORAMState
+init_oram(const char *file, unsigned int nblocks, unsigned int blockSize, unsigned int bucketCapacity, Amgr *amgr, void *appData)
+{
+
+	unsigned int treeHeight;
+	unsigned int totalNodes;
+	unsigned int stashSize;
+	unsigned int index;
+	ORAMState	state = NULL;
+
+	treeHeight = calculateTreeHeight(nblocks);
+	totalNodes = ((unsigned int) pow(2, treeHeight + 1)) - 1;
+
+	state = buildORAMState(file, blockSize, treeHeight, bucketCapacity, amgr);
+	state->nblocks = nblocks;
+
+	if (RINGORAM_EVICTION_RATE > 0)
+		state->evictionRate = RINGORAM_EVICTION_RATE;
+	else
+		state->evictionRate = bucketCapacity > 1 ? bucketCapacity - 1 : 1;
+
+	if (RINGORAM_DUMMY_SLOTS > 0)
+		state->dummySlots = RINGORAM_DUMMY_SLOTS;
+	else
+		state->dummySlots = state->evictionRate + 2;
+
+	state->bucketSize = bucketCapacity + state->dummySlots;
+	state->headerSlots = (sizeof(uint32_t) * (state->bucketSize + 1) + blockSize - 1)
+		/ blockSize;
+	state->slotsPerNode = state->bucketSize + state->headerSlots;
+	state->round = 0;
+	state->evictions = 0;
+
+	logger(DEBUG, "Init ringoram for %d blocks with tree height %d, Z=%d, S=%d and A=%d\n",
+           nblocks, treeHeight, bucketCapacity, state->dummySlots,
+           state->evictionRate);
+
+	struct TreeConfig config;
+
+	config.treeHeight = treeHeight;
+
+	/*
+	 * The stash has to hold the blocks read from a whole path during an
+	 * eviction besides the blocks waiting to be evicted.
+	 */
+	stashSize = (treeHeight + 1) * bucketCapacity + treeHeight * 4
+		+ state->evictionRate;
+
+	state->stash = amgr->am_stash->stashinit(state->file, stashSize,
+                                             state->blockSize, appData);
+	state->pmap = amgr->am_pmap->pminit(state->file, nblocks, &config);
+
+	state->headers = (uint32_t *) allocate(sizeof(uint32_t) * (treeHeight + 1)
+                                           * (state->bucketSize + 1));
+	state->headerNodes = (TreeNode *) allocate(sizeof(TreeNode) * (treeHeight + 1));
+	state->headerBlocks = (PLBList) allocate(sizeof(PLBlock) * state->headerSlots);
+	state->headerArena = (char *) allocate((size_t) blockSize * state->headerSlots);
+	state->levelTotals = (unsigned int *) allocate(sizeof(unsigned int) * (treeHeight + 1));
+	state->path = (TreePath) allocate(sizeof(TreeNode) * (treeHeight + 1));
+	state->evictBlocks = (PLBList) allocate(sizeof(PLBlock) * (treeHeight + 1) * bucketCapacity);
+	state->bucketBlocks = (PLBList) allocate(sizeof(PLBlock) * state->bucketSize);
+	state->permutation = (unsigned int *) allocate(sizeof(unsigned int) * state->bucketSize);
+
+	for (index = 0; index <= treeHeight; index++)
+	{
+		state->headerNodes[index] = totalNodes;
+	}
+
+	for (index = 0; index < state->headerSlots; index++)
+	{
+		state->headerBlocks[index] = createEmptyBlock();
+		state->headerBlocks[index]->block = state->headerArena
+			+ (size_t) blockSize * index;
+	}
+
+	state->pool = createBlockPool((treeHeight + 1) * bucketCapacity + stashSize,
+                                  blockSize);
+	state->dummyBlock = createRandomBlock(blockSize, sizeof(struct Location));
+
+#ifdef STASH_COUNT
+	state->max = 0;
+	state->nblocksStash = 0;
+#endif
+
+	state->fhandler = amgr->am_ofile->ofileinit(state->file,
+                                                totalNodes * state->slotsPerNode,
+                                                blockSize,
+                                                sizeof(struct Location),
+                                                appData);
+
+	return state;
+}
+
+ORAMState
+buildORAMState(const char *filename, unsigned int blockSize, unsigned int treeHeight,
+               unsigned int bucketCapacity, Amgr *amgr)
+{
+
+	ORAMState	state = NULL;
+	int			namelen = 0;
+
+	/* Construct ORAM state */
+	state = (ORAMState) allocate(sizeof(struct ORAMState));
+
+	state->blockSize = blockSize;
+	state->treeHeight = treeHeight;
+	state->bucketCapacity = bucketCapacity;
+	namelen = strlen(filename) + 1;
+	state->file = (char *) allocate(namelen);
+	memcpy(state->file, filename, namelen);
+	state->amgr = amgr;
+	state->ofileExt = NULL;
+	state->pmapExt = NULL;
+
+	return state;
+}
+
+void *
+allocate(size_t size)
+{
+	int			save_errno = 0;
+	void	   *ptr;
+
+	save_errno = errno;
+	errno = 0;
+	ptr = malloc(size);
+
+	if (ptr == NULL && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out Of Memory building ringoram state\n");
+		errno = save_errno;
+		abort();
+	}
+	errno = save_errno;
+
+	return ptr;
+}
+
+/*
+ * Minimum tree height to store nblocks. See calculateTreeHeight in
+ * pathoram.c.
+ */
+unsigned int
+calculateTreeHeight(unsigned int nblocks)
+{
+	unsigned int height,
+				nNodes;
+
+	height = (unsigned int) ceil(log2(nblocks));
+	nNodes = (unsigned int) pow(2, height);
+
+	if (nNodes - 1 >= nblocks)
+	{
+		return height - 1;
+	}
+	else
+	{
+		return height;
+	}
+}
+
+/*
+ * Fills the path buffer of the state with the tree nodes from the root
+ * (level 0) to the input leaf. See getTreePath in pathoram.c.
+ */
+TreePath
+getTreePath(ORAMState state, unsigned int leaf)
+{
+	unsigned int currentPos = 0;
+	unsigned int currentHeight = state->treeHeight;
+	TreePath	path = state->path;
+
+	currentPos = leaf + (1 << (state->treeHeight));
+
+	while (currentPos > 0)
+	{
+		path[currentHeight] = currentPos - 1;
+		currentHeight--;
+		currentPos >>= 1;
+	}
+
+	return path;
+}
+
+static inline uint32_t *
+getHeader(ORAMState state, unsigned int level)
+{
+	return state->headers + level * (state->bucketSize + 1);
+}
+
+/*
+ * Reads the header of node into the header of level.
+ */
+void
+readHeader(ORAMState state, TreeNode node, unsigned int level, void *appData)
+{
+	unsigned int slot;
+	size_t		offset;
+	size_t		length;
+	size_t		size = sizeof(uint32_t) * (state->bucketSize + 1);
+	char	   *header = (char *) getHeader(state, level);
+	void	   *payload;
+	PLBlock		block;
+
+	for (slot = 0, offset = 0; slot < state->headerSlots; slot++, offset += length)
+	{
+		length = size - offset < state->blockSize ? size - offset : state->blockSize;
+		block = state->headerBlocks[slot];
+		payload = state->ofileExt == NULL ? detachPayload(block) : NULL;
+
+		state->amgr->am_ofile->ofileread(state->fhandler, block, state->file,
+                                         (BlockNumber) (node * state->slotsPerNode
+                                                        + state->bucketSize + slot),
+                                         appData);
+		if (payload != NULL)
+		{
+			attachPayload(block, payload);
+		}
+
+		/* Never written, reported by the file as a dummy block */
+		if (block->blkno == DUMMY_BLOCK)
+			memset(header + offset, 0, length);
+		else
+			memcpy(header + offset, block->block, length);
+	}
+
+	state->headerNodes[level] = node;
+}
+
+/*
+ * Writes the header of level to its tree node. The header slots are written
+ * as real blocks, as some files only keep the payload of those (e.g.,
+ * encfile.c).
+ */
+void
+writeHeader(ORAMState state, unsigned int level, void *appData)
+{
+	unsigned int slot;
+	size_t		offset;
+	size_t		length;
+	size_t		size = sizeof(uint32_t) * (state->bucketSize + 1);
+	char	   *header = (char *) getHeader(state, level);
+	TreeNode	node = state->headerNodes[level];
+	PLBlock		block;
+
+	for (slot = 0, offset = 0; slot < state->headerSlots; slot++, offset += length)
+	{
+		length = size - offset < state->blockSize ? size - offset : state->blockSize;
+		block = state->headerBlocks[slot];
+
+		memset(block->block, 0, state->blockSize);
+		memcpy(block->block, header + offset, length);
+		block->blkno = (int) node;
+		block->size = state->blockSize;
+		block->location[0] = 0;
+		block->location[1] = 0;
+
+		state->amgr->am_ofile->ofilewrite(state->fhandler, block, state->file,
+                                          (BlockNumber) (node * state->slotsPerNode
+                                                         + state->bucketSize + slot),
+                                          appData);
+	}
+}
+
+/*
+ * Reads a slot of the bucket whose header is the one of level and marks it
+ * as read.
+ */
+PLBlock
+readSlot(ORAMState state, unsigned int level, unsigned int slot, void *appData)
+{
+	TreeNode	node = state->headerNodes[level];
+	PLBlock		plblock = createEmptyPooledBlock(state->pool);
+	void	   *payload = state->ofileExt == NULL ? detachPayload(plblock) : NULL;
+
+	state->amgr->am_ofile->ofileread(state->fhandler, plblock, state->file,
+                                     (BlockNumber) (node * state->slotsPerNode + slot),
+                                     appData);
+	if (payload != NULL)
+	{
+		attachPayload(plblock, payload);
+	}
+	getHeader(state, level)[slot + 1] |= HEADER_SLOT_READ;
+
+	return plblock;
+}
+
+/*
+ * Returns a random dummy slot of the bucket of level that has not been read
+ * since the bucket was written. Buckets are reshuffled before their dummies
+ * run out.
+ */
+unsigned int
+getRandomDummySlot(ORAMState state, unsigned int level)
+{
+	uint32_t   *header = getHeader(state, level);
+	unsigned int slot;
+	unsigned int ndummies = 0;
+	unsigned int target;
+
+	for (slot = 0; slot < state->bucketSize; slot++)
+	{
+		if (header[slot + 1] == 0)
+			ndummies++;
+	}
+
+	if (ndummies == 0)
+	{
+		logger(DEBUG, "Bucket %d has no valid dummy slots\n", state->headerNodes[level]);
+		abort();
+	}
+
+	target = ((unsigned int) getRandomInt()) % ndummies;
+
+	for (slot = 0; slot < state->bucketSize; slot++)
+	{
+		if (header[slot + 1] == 0)
+		{
+			if (target == 0)
+				break;
+			target--;
+		}
+	}
+
+	return slot;
+}
+
+/*
+ * Reads one slot from each bucket of the path to leaf: the slot of the
+ * requested block if the bucket has it or a valid dummy otherwise. The
+ * requested block is moved to the stash.
+ */
+void
+readPath(ORAMState state, unsigned int leaf, BlockNumber blkno, void *appData)
+{
+	int			level;
+	unsigned int slot;
+	uint32_t   *header;
+	TreePath	path;
+	PLBlock		plblock;
+
+	path = getTreePath(state, leaf);
+
+	for (level = 0; level <= state->treeHeight; level++)
+	{
+		readHeader(state, path[level], level, appData);
+		header = getHeader(state, level);
+
+		for (slot = 0; slot < state->bucketSize; slot++)
+		{
+			if (header[slot + 1] == (uint32_t) blkno + 1)
+				break;
+		}
+
+		if (slot == state->bucketSize)
+		{
+			slot = getRandomDummySlot(state, level);
+		}
+
+		plblock = readSlot(state, level, slot, appData);
+		header[0]++;
+		writeHeader(state, level, appData);
+
+		if (plblock->blkno != DUMMY_BLOCK)
+		{
+#ifdef STASH_COUNT
+			state->nblocksStash += 1;
+			state->max = state->max < state->nblocksStash ? state->nblocksStash : state->max;
+#endif
+			state->amgr->am_stash->stashadd(state->stash, state->file, plblock, appData);
+		}
+		else
+		{
+			freeBlock(plblock);
+		}
+	}
+}
+
+/*
+ * Moves the real blocks left in the bucket whose header is the one of level
+ * to the stash. Exactly Z valid slots are read, the remaining real blocks and
+ * random valid dummies.
+ */
+void
+readBucket(ORAMState state, unsigned int level, void *appData)
+{
+	uint32_t   *header = getHeader(state, level);
+	unsigned int slot;
+	unsigned int start;
+	unsigned int index;
+	unsigned int nread = 0;
+	PLBlock		plblock;
+
+	for (slot = 0; slot < state->bucketSize; slot++)
+	{
+		if (header[slot + 1] != 0 && !(header[slot + 1] & HEADER_SLOT_READ))
+		{
+			plblock = readSlot(state, level, slot, appData);
+#ifdef STASH_COUNT
+			state->nblocksStash += 1;
+			state->max = state->max < state->nblocksStash ? state->nblocksStash : state->max;
+#endif
+			state->amgr->am_stash->stashadd(state->stash, state->file, plblock, appData);
+			nread++;
+		}
+	}
+
+	start = ((unsigned int) getRandomInt()) % state->bucketSize;
+
+	for (index = 0; index < state->bucketSize && nread < state->bucketCapacity; index++)
+	{
+		slot = (start + index) % state->bucketSize;
+
+		if (header[slot + 1] == 0)
+		{
+			freeBlock(readSlot(state, level, slot, appData));
+			nread++;
+		}
+	}
+}
+
+/*
+ * Writes a bucket with the input real blocks, at most Z, and dummies on
+ * randomly permuted slots, followed by its header, which becomes the one of
+ * level. The real blocks must already be removed from the stash and are
+ * released once written.
+ */
+void
+writeBucket(ORAMState state, TreeNode node, unsigned int level, PLBList blocks,
+            unsigned int nblocks, void *appData)
+{
+	unsigned int base = node * state->slotsPerNode;
+	uint32_t   *header = getHeader(state, level);
+	unsigned int slot;
+	unsigned int swap;
+	unsigned int tmp;
+	PLBlock		plblock;
+
+	for (slot = 0; slot < state->bucketSize; slot++)
+	{
+		state->permutation[slot] = slot;
+		state->bucketBlocks[slot] = state->dummyBlock;
+	}
+
+	/* Fisher-Yates shuffle of the slots that receive the real blocks */
+	for (slot = 0; slot < nblocks; slot++)
+	{
+		swap = slot + ((unsigned int) getRandomInt()) % (state->bucketSize - slot);
+		tmp = state->permutation[slot];
+		state->permutation[slot] = state->permutation[swap];
+		state->permutation[swap] = tmp;
+		state->bucketBlocks[state->permutation[slot]] = blocks[slot];
+	}
+
+	for (slot = 0; slot < state->bucketSize; slot++)
+	{
+		plblock = state->bucketBlocks[slot];
+
+		state->amgr->am_ofile->ofilewrite(state->fhandler, plblock, state->file,
+                                          (BlockNumber) (base + slot), appData);
+		header[slot + 1] = plblock->blkno == DUMMY_BLOCK ? 0 : (uint32_t) plblock->blkno + 1;
+
+		if (plblock->blkno != DUMMY_BLOCK)
+		{
+			freeBlock(plblock);
+		}
+	}
+
+	header[0] = 0;
+	state->headerNodes[level] = node;
+	writeHeader(state, level, appData);
+}
+
+/*
+ * Evicts the stash along the next path in reverse lexicographic order. Each
+ * bucket of the path is read and every block in the stash is then placed on
+ * the deepest bucket of the path it can reside in that still has room, with
+ * a single pass over the stash as in the getBlocksToWrite of pathoram.c.
+ */
+void
+evictPath(ORAMState state, void *appData)
+{
+	unsigned int leaf = 0;
+	unsigned int counter;
+	unsigned int bit;
+	unsigned int freeSlots = (state->treeHeight + 1) * state->bucketCapacity;
+	unsigned int level;
+	unsigned int loffset;
+	int			s_level;
+	unsigned int *totals = state->levelTotals;
+	TreePath	path;
+	PLBlock		pl_block;
+	PLBList		selectedBlocks = state->evictBlocks;
+	AMStash    *stash = state->amgr->am_stash;
+
+	/* Reverse the bits of the eviction counter to get the next leaf */
+	counter = state->evictions % (1 << state->treeHeight);
+
+	for (bit = 0; bit < state->treeHeight; bit++)
+	{
+		leaf = (leaf << 1) | ((counter >> bit) & 1);
+	}
+	state->evictions++;
+
+	path = getTreePath(state, leaf);
+
+	for (level = 0; level <= state->treeHeight; level++)
+	{
+		readHeader(state, path[level], level, appData);
+		readBucket(state, level, appData);
+	}
+
+	memset(totals, 0, sizeof(unsigned int) * (state->treeHeight + 1));
+
+	stash->stashstartIt(state->stash, state->file, appData);
+
+	while (freeSlots > 0
+           && stash->stashnext(state->stash, state->file, &pl_block, appData))
+	{
+		checkBlock(pl_block, state->pool);
+		s_level = (int) getDeepestLevel(state->treeHeight, pl_block->location[0], leaf);
+
+		while (s_level >= 0 && totals[s_level] == state->bucketCapacity)
+		{
+			s_level--;
+		}
+
+		if (s_level >= 0)
+		{
+			selectedBlocks[s_level * state->bucketCapacity + totals[s_level]] = pl_block;
+			totals[s_level]++;
+			freeSlots--;
+		}
+	}
+
+	stash->stashcloseIt(state->stash, state->file, appData);
+
+	for (level = 0; level <= state->treeHeight; level++)
+	{
+		for (loffset = 0; loffset < totals[level]; loffset++)
+		{
+#ifdef STASH_COUNT
+			state->nblocksStash -= 1;
+#endif
+			stash->stashremove(state->stash, state->file,
+                               selectedBlocks[level * state->bucketCapacity + loffset],
+                               appData);
+		}
+
+		writeBucket(state, path[level], level,
+                    &selectedBlocks[level * state->bucketCapacity],
+                    totals[level], appData);
+	}
+}
+
+/*
+ * Reshuffles the buckets of the path to leaf whose dummy slots may have all
+ * been read. The headers read with the path are still the current ones,
+ * except those replaced by an eviction along another path.
+ */
+void
+earlyReshuffle(ORAMState state, unsigned int leaf, void *appData)
+{
+	unsigned int level;
+	unsigned int nselected;
+	unsigned int index;
+	TreeNode	node;
+	TreePath	path;
+	PLBlock		pl_block;
+	PLBList		selectedBlocks = state->evictBlocks;
+	AMStash    *stash = state->amgr->am_stash;
+
+	path = getTreePath(state, leaf);
+
+	for (level = 0; level <= state->treeHeight; level++)
+	{
+		node = path[level];
+
+		if (state->headerNodes[level] != node)
+		{
+			readHeader(state, node, level, appData);
+		}
+
+		if (getHeader(state, level)[0] < state->dummySlots)
+			continue;
+
+		readBucket(state, level, appData);
+
+		nselected = 0;
+		stash->stashstartIt(state->stash, state->file, appData);
+
+		while (nselected < state->bucketCapacity
+               && stash->stashnext(state->stash, state->file, &pl_block, appData))
+		{
+			checkBlock(pl_block, state->pool);
+			if (getDeepestLevel(state->treeHeight, pl_block->location[0], leaf) >= level)
+			{
+				selectedBlocks[nselected] = pl_block;
+				nselected++;
+			}
+		}
+
+		stash->stashcloseIt(state->stash, state->file, appData);
+
+		for (index = 0; index < nselected; index++)
+		{
+#ifdef STASH_COUNT
+			state->nblocksStash -= 1;
+#endif
+			stash->stashremove(state->stash, state->file, selectedBlocks[index],
+                               appData);
+		}
+
+		writeBucket(state, node, level, selectedBlocks, nselected, appData);
+	}
+}
+
+/*
+ * Evicts every A accesses and reshuffles the buckets of the accessed path
+ * that ran out of dummies.
+ */
+void
+finishAccess(ORAMState state, unsigned int leaf, void *appData)
+{
+	state->round = (state->round + 1) % state->evictionRate;
+
+	if (state->round == 0)
+	{
+		evictPath(state, appData);
+	}
+
+	earlyReshuffle(state, leaf, appData);
+}
+
+void
+updateStashWithNewBlock(void *data, unsigned int blkSize, BlockNumber blkno,
+                        ORAMState state, Location location, void *appData)
+{
+	PLBlock		plblock;
+	int			found = 0;
+
+	if (blkno == DUMMY_BLOCK)
+		return;
+
+	plblock = createPooledBlock(state->pool, (int) blkno, blkSize, data);
+	plblock->location[0] = location->leaf;
+
+	found = state->amgr->am_stash->stashupdate(state->stash, state->file,
+                                               plblock, appData);
+
+#ifdef STASH_COUNT
+	if (!found)
+	{
+		state->nblocksStash += 1;
+		state->max = state->max < state->nblocksStash ? state->nblocksStash : state->max;
+	}
+#endif
+}
+
+
+int
+read_oram(char **ptr, BlockNumber blkno, ORAMState state, void *appData)
+{
+	unsigned int leaf = 0;
+	int			result = 0;
+	struct Location nLocation;
+	struct PLBlock plblock;
+
+	AMPMap	   *pmap = state->amgr->am_pmap;
+	AMStash    *stash = state->amgr->am_stash;
+
+	if (blkno < 0 || blkno > state->nblocks)
+	{
+		logger(DEBUG, "Requested read_oram on invalid address %d", blkno);
+		abort();
+	}
+
+	memset(&plblock, 0, sizeof(struct PLBlock));
+	plblock.blkno = DUMMY_BLOCK;
+	plblock.size = -1;
+
+	leaf = pmap->pmget(state->pmap, state->file, blkno)->leaf;
+	pmap->pmupdate(state->pmap, state->file, blkno);
+	nLocation.leaf = pmap->pmget(state->pmap, state->file, blkno)->leaf;
+
+	readPath(state, leaf, blkno, appData);
+
+	stash->stashget(state->stash, &plblock, blkno, state->file, appData);
+	updateStashWithNewBlock(plblock.block, plblock.size, plblock.blkno,
+                            state, &nLocation, appData);
+
+	finishAccess(state, leaf, appData);
+
+	*ptr = plblock.block;
+
+	/* No block has been inserted yet */
+	if (plblock.blkno == DUMMY_BLOCK)
+	{
+		result = DUMMY_BLOCK;
+	}
+	else
+	{
+		result = plblock.size;
+	}
+	return result;
+}
+
+int
+write_oram(char *data, unsigned int blkSize, BlockNumber blkno, ORAMState state, void *appData)
+{
+	unsigned int leaf = 0;
+	struct Location nLocation;
+
+	AMPMap	   *pmap = state->amgr->am_pmap;
+
+	if (blkno < 0 || blkno > state->nblocks)
+	{
+		logger(DEBUG, "Requested write_oram on invalid address %d", blkno);
+		abort();
+	}
+
+	leaf = pmap->pmget(state->pmap, state->file, blkno)->leaf;
+	pmap->pmupdate(state->pmap, state->file, blkno);
+	nLocation.leaf = pmap->pmget(state->pmap, state->file, blkno)->leaf;
+
+	/* The path read is indistinguishable from the one of a read request. */
+	readPath(state, leaf, blkno, appData);
+	updateStashWithNewBlock(data, blkSize, blkno, state, &nLocation, appData);
+
+	finishAccess(state, leaf, appData);
+
+	return blkSize;
+}
+
+/*
+ * Ring ORAM already reads a single block per bucket, batches are served one
+ * request at a time.
+ */
+int
+read_oram_batch(char **ptrs, int *results, const BlockNumber *blknos,
+                unsigned int nrequests, ORAMState state, void *appData)
+{
+	unsigned int index;
+
+	for (index = 0; index < nrequests; index++)
+	{
+		results[index] = read_oram(&ptrs[index], blknos[index], state, appData);
+	}
+	return nrequests;
+}
+
+int
+write_oram_batch(char **data, const unsigned int *blkSizes, int *results,
+                 const BlockNumber *blknos, unsigned int nrequests,
+                 ORAMState state, void *appData)
+{
+	unsigned int index;
+
+	for (index = 0; index < nrequests; index++)
+	{
+		results[index] = write_oram(data[index], blkSizes[index], blknos[index],
+                                    state, appData);
+	}
+	return nrequests;
+}
+
+void
+close_oram(ORAMState state, void *appData)
+{
+	unsigned int index;
+
+#ifdef STASH_COUNT
+	logStashes(state);
+#endif
+	state->amgr->am_stash->stashclose(state->stash, state->file, appData);
+	state->amgr->am_pmap->pmclose(state->pmap, state->file);
+	state->amgr->am_ofile->ofileclose(state->fhandler, state->file, appData);
+	freeBlockPool(state->pool);
+	freeBlock(state->dummyBlock);
+	for (index = 0; index < state->headerSlots; index++)
+	{
+		free(state->headerBlocks[index]);
+	}
+	free(state->headerBlocks);
+	free(state->headerArena);
+	free(state->headers);
+	free(state->headerNodes);
+	free(state->levelTotals);
+	free(state->path);
+	free(state->evictBlocks);
+	free(state->bucketBlocks);
+	free(state->permutation);
+	free(state->file);
+	free(state->amgr->am_stash);
+	free(state->amgr->am_pmap);
+	free(state->amgr->am_ofile);
+	free(state->ofileExt);
+	free(state->pmapExt);
+	free(state);
+}
+
+void
+setToken(ORAMState state, const unsigned int *token)
+{
+	if (state->amgr->am_pmap->pmstoken != NULL)
+	{
+		state->amgr->am_pmap->pmstoken(state->pmap, token);
+	}
+	else
+	{
+		logger(DEBUG, "Set Token function is not available in PMAP!");
+	}
+}
+
+void
+setTokens(ORAMState state, const unsigned int *tokens, unsigned int ntokens)
+{
+	if (state->pmapExt != NULL && state->pmapExt->pmstokens != NULL)
+	{
+		state->pmapExt->pmstokens(state->pmap, tokens, ntokens);
+	}
+	else
+	{
+		logger(DEBUG, "Set Tokens function is not available in PMAP!");
+	}
+}
+
+/*
+ * The file extension is kept only to be released by close_oram, buckets are
+ * read and written one slot at a time.
+ */
+void
+setOFileExt(ORAMState state, AMOFileExt *ext)
+{
+	free(state->ofileExt);
+	state->ofileExt = ext;
+}
+
+void
+setPMapExt(ORAMState state, AMPMapExt *ext)
+{
+	free(state->pmapExt);
+	state->pmapExt = ext;
+}
+
+#ifdef STASH_COUNT
+void
+logStashes(ORAMState state)
+{
+	logger(DEBUG, "Stash has %d blocks and max is %d\n", state->nblocksStash, state->max);
+}
+#endif
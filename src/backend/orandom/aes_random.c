@@ -0,0 +1,171 @@
+/*-------------------------------------------------------------------------
+ *
+ * aes_random.c
+ *	   Cryptographically secure random library built on AES-CTR.
+ *
+ * Random integers are read from the AES-128-CTR keystream of a key drawn
+ * from the system random source. Each thread keeps its own key and a buffer
+ * of AES_RANDOM_BUFFER bytes of keystream, so drawing an integer takes no
+ * lock and the keystream is generated several AES blocks at a time (see
+ * aes.c). getRandomInts fills large requests directly from the keystream,
+ * without going through the buffer.
+ *
+ * A child process reseeds the thread that forked it, so the parent and
+ * the child never return the same values.
+ *
+ * Copyright (c) 2018-2020, HASLab
+ *
+ * IDENTIFICATION
+ *		  backend/orandom/aes_random.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "oram/orandom.h"
+#include "oram/logger.h"
+#include "oram/aes.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+
+/* Bytes of keystream generated at a time, a multiple of the AES block size */
+#ifndef AES_RANDOM_BUFFER
+#define AES_RANDOM_BUFFER 4096
+#endif
+
+#define AES_RANDOM_INTS (AES_RANDOM_BUFFER / sizeof(unsigned int))
+
+typedef struct RandomState
+{
+	AESKey		key;
+	/* Next unused AES block of the keystream */
+	uint64_t	counter;
+	unsigned int buffer[AES_RANDOM_INTS] __attribute__((aligned(16)));
+	/* Next unused integer of buffer, AES_RANDOM_INTS when empty */
+	unsigned int position;
+	int			seeded;
+} RandomState;
+
+static __thread RandomState randomState;
+
+static pthread_once_t forkHandlerOnce = PTHREAD_ONCE_INIT;
+
+
+static void
+reseedChild(void)
+{
+	randomState.seeded = 0;
+}
+
+static void
+registerForkHandler(void)
+{
+	pthread_atfork(NULL, NULL, &reseedChild);
+}
+
+static void
+seed(RandomState *state)
+{
+	uint8_t		raw[AES_KEY_SIZE];
+	size_t		filled = 0;
+	ssize_t		result;
+	int			save_errno = errno;
+
+	pthread_once(&forkHandlerOnce, &registerForkHandler);
+
+	while (filled < AES_KEY_SIZE)
+	{
+		result = getrandom(raw + filled, AES_KEY_SIZE - filled, 0);
+		if (result < 0 && errno != EINTR)
+		{
+			logger(DEBUG, "Random generator seeding failed: %s\n", strerror(errno));
+			abort();
+		}
+		if (result > 0)
+		{
+			filled += (size_t) result;
+		}
+	}
+	errno = save_errno;
+
+	aesSetKey(&state->key, raw);
+	memset(raw, 0, AES_KEY_SIZE);
+
+	state->counter = 0;
+	state->position = AES_RANDOM_INTS;
+	state->seeded = 1;
+}
+
+/*
+ * Writes nblocks AES blocks of keystream to out.
+ */
+static inline void
+keystream(RandomState *state, void *out, size_t nblocks)
+{
+	memset(out, 0, nblocks * AES_BLOCK_SIZE);
+	aesCtr(&state->key, 0, state->counter, (uint8_t *) out,
+		   nblocks * AES_BLOCK_SIZE);
+	state->counter += nblocks;
+}
+
+unsigned int
+getRandomInt(void)
+{
+	RandomState *state = &randomState;
+
+	if (!state->seeded)
+	{
+		seed(state);
+	}
+
+	if (state->position == AES_RANDOM_INTS)
+	{
+		keystream(state, state->buffer, AES_RANDOM_BUFFER / AES_BLOCK_SIZE);
+		state->position = 0;
+	}
+
+	return state->buffer[state->position++];
+}
+
+void
+getRandomInts(unsigned int *values, size_t n)
+{
+	RandomState *state = &randomState;
+	size_t		available;
+	size_t		direct;
+
+	if (!state->seeded)
+	{
+		seed(state);
+	}
+
+	/* Drain the buffer first, so that no keystream is used twice */
+	available = AES_RANDOM_INTS - state->position;
+	if (available > n)
+	{
+		available = n;
+	}
+	memcpy(values, state->buffer + state->position, available * sizeof(unsigned int));
+	state->position += available;
+	values += available;
+	n -= available;
+
+	/* Whole AES blocks go straight to the caller */
+	direct = n * sizeof(unsigned int) / AES_BLOCK_SIZE;
+	if (direct > 0)
+	{
+		keystream(state, values, direct);
+		values += direct * AES_BLOCK_SIZE / sizeof(unsigned int);
+		n -= direct * AES_BLOCK_SIZE / sizeof(unsigned int);
+	}
+
+	while (n > 0)
+	{
+		*values++ = getRandomInt();
+		n--;
+	}
+}
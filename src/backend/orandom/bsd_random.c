@@ -20,3 +20,9 @@ getRandomInt(void)
 {
 	return arc4random();
 }
+
+void
+getRandomInts(unsigned int *values, size_t n)
+{
+	arc4random_buf(values, n * sizeof(unsigned int));
+}
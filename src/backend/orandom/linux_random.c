@@ -19,3 +19,11 @@ unsigned int getRandomInt(void) {
    return random();
 }
 
+void getRandomInts(unsigned int *values, size_t n) {
+   size_t i;
+
+   for (i = 0; i < n; i++) {
+      values[i] = random();
+   }
+}
+
@@ -0,0 +1,190 @@
+/*-------------------------------------------------------------------------
+ *
+ * bpmap.c
+ *      In-memory position map with bit-packed leaves.
+ *
+ * Same as pmap.c, but each leaf is stored in treeHeight bits of an array of
+ * 64-bit words instead of a full unsigned int. An entry may straddle two
+ * words, so both words are always read and written with shifts and masks,
+ * and a padding word at the end of the array keeps the second access in
+ * bounds. Leaves are returned in a Location owned by the position map that
+ * is overwritten by the next call to pmapGet.
+ *
+ * This implementation assumes that only a single file is being accessed
+ * obliviously and ignores the filename.
+ *
+ * Copyright (c) 2018-2020, HASLab
+ *
+ * IDENTIFICATION
+ *        backend/pmap/bpmap.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "oram/pmap.h"
+#include "oram/logger.h"
+#include "oram/orandom.h"
+#include "oram/pmapdefs/pdeforam.h"
+
+/* Leaves drawn at a time when the position map is initialized */
+#define PMAP_RANDOM_CHUNK 1024
+
+struct PMap
+{
+	uint64_t   *words;
+	/* Bits per entry and the mask of an entry */
+	unsigned int bits;
+	uint64_t	mask;
+	/* The number of leaves is a power of two, leaves are masked random ints */
+	unsigned int leafMask;
+	/* Location returned by pmapGet */
+	struct Location location;
+};
+
+
+static PMap pmapInit(const char *filename, const unsigned int nblocks, TreeConfig config);
+
+static Location pmapGet(PMap pmap, const char *fileName, const BlockNumber blkno);
+
+static void pmapUpdate(PMap pmap, const char *fileName, const BlockNumber realBlkno);
+
+static void pmapClose(PMap pmap, const char *filename);
+
+static void pmapSetToken(PMap pmap, const unsigned int *token);
+
+
+static inline uint64_t
+entryGet(PMap pmap, BlockNumber blkno)
+{
+	uint64_t	offset = (uint64_t) blkno * pmap->bits;
+	const uint64_t *word = pmap->words + (offset >> 6);
+	unsigned int shift = offset & 63;
+
+	/* Shifting by 1 and 63 - shift is shifting by 64 - shift, 0 for shift 0 */
+	return ((word[0] >> shift) | ((word[1] << 1) << (63 - shift))) & pmap->mask;
+}
+
+static inline void
+entrySet(PMap pmap, BlockNumber blkno, uint64_t value)
+{
+	uint64_t	offset = (uint64_t) blkno * pmap->bits;
+	uint64_t   *word = pmap->words + (offset >> 6);
+	unsigned int shift = offset & 63;
+
+	word[0] = (word[0] & ~(pmap->mask << shift)) | (value << shift);
+	word[1] = (word[1] & ~((pmap->mask >> 1) >> (63 - shift)))
+		| ((value >> 1) >> (63 - shift));
+}
+
+PMap
+pmapInit(const char *filename, unsigned int nblocks, TreeConfig treeConfig)
+{
+	PMap		pmap;
+	unsigned int leaves[PMAP_RANDOM_CHUNK];
+	unsigned int i;
+	unsigned int j;
+	unsigned int count;
+	size_t		nwords;
+	uint64_t   *word;
+	uint64_t	accumulator = 0;
+	unsigned int filled = 0;
+	int			save_errno = errno;
+
+	errno = 0;
+	pmap = (PMap) malloc(sizeof(struct PMap));
+
+	if (pmap == NULL && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory when allocating position map\n");
+		errno = save_errno;
+		abort();
+	}
+
+	/* A tree of height 0 has a single leaf, entries still take a bit */
+	pmap->bits = treeConfig->treeHeight > 0 ? treeConfig->treeHeight : 1;
+	pmap->mask = (UINT64_C(1) << pmap->bits) - 1;
+	pmap->leafMask = (1U << treeConfig->treeHeight) - 1;
+
+	nwords = ((uint64_t) nblocks * pmap->bits + 63) / 64 + 1;
+	pmap->words = (uint64_t *) malloc(sizeof(uint64_t) * nwords);
+
+	if (pmap->words == NULL && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory when allocating pmap blocks\n");
+		errno = save_errno;
+		abort();
+	}
+	errno = save_errno;
+
+	/* Entries are packed in order, one whole word at a time */
+	word = pmap->words;
+	for (i = 0; i < nblocks; i += count)
+	{
+		count = nblocks - i < PMAP_RANDOM_CHUNK ? nblocks - i : PMAP_RANDOM_CHUNK;
+		getRandomInts(leaves, count);
+
+		for (j = 0; j < count; j++)
+		{
+			uint64_t	leaf = leaves[j] & pmap->leafMask;
+
+			accumulator |= leaf << filled;
+			filled += pmap->bits;
+			if (filled >= 64)
+			{
+				*word++ = accumulator;
+				filled -= 64;
+				accumulator = filled > 0 ? leaf >> (pmap->bits - filled) : 0;
+			}
+		}
+	}
+
+	while (word < pmap->words + nwords)
+	{
+		*word++ = accumulator;
+		accumulator = 0;
+	}
+
+	return pmap;
+}
+
+Location
+pmapGet(PMap pmap, const char *fileName, const BlockNumber blkno)
+{
+	pmap->location.leaf = (unsigned int) entryGet(pmap, blkno);
+	return &pmap->location;
+}
+
+void
+pmapUpdate(PMap pmap, const char *fileName, const BlockNumber realBlkno)
+{
+	entrySet(pmap, realBlkno, getRandomInt() & pmap->leafMask);
+}
+
+void
+pmapClose(PMap pmap, const char *filename)
+{
+	free(pmap->words);
+	free(pmap);
+}
+
+void
+pmapSetToken(PMap pmap, const unsigned int *token)
+{
+}
+
+AMPMap *
+pmapCreate(void)
+{
+	AMPMap	   *pmap = (AMPMap *) malloc(sizeof(AMPMap));
+
+	pmap->pminit = &pmapInit;
+	pmap->pmget = &pmapGet;
+	pmap->pmupdate = &pmapUpdate;
+	pmap->pmclose = &pmapClose;
+	pmap->pmstoken = &pmapSetToken;
+	return pmap;
+}
@@ -7,6 +7,9 @@
  * oram leaf nodes in an array. This implementation assumes that only a
  * single file is being accessed obliviously and ignores the filename. 
  *
+ * With LAZY_INIT, the location of a block is drawn the first time pmapGet
+ * reads it instead of in pmapInit, as in pmap.c.
+ *
  * Copyright (c) 2018-2019, HASLab
  *
  * IDENTIFICATION
@@ -15,8 +18,8 @@
  *-------------------------------------------------------------------------
  */
 
-#include <math.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <errno.h>
 
 
@@ -26,10 +29,18 @@
 #include "oram/pmapdefs/fdeforam.h"
 
 
+/* Locations drawn at a time when the position map is initialized */
+#define PMAP_RANDOM_CHUNK 1024
+
 struct PMap {
     struct Location *map;
-    int treeHeight;
-    int nPartitions;
+    /* The number of leaves is a power of two, leaves are masked random ints */
+    unsigned int leafMask;
+    unsigned int nPartitions;
+#ifdef LAZY_INIT
+    /* Bit blkno is set once the location of blkno has been drawn */
+    uint64_t *initialized;
+#endif
 };
 
 
@@ -45,9 +56,12 @@ PMap pmapInit(const char *filename, unsigned int nblocks, TreeConfig treeConfig)
 
     unsigned int treeHeight;
     unsigned int nPartitions;
-    int i;
-    unsigned int leaf;
-    unsigned int partition;
+#ifndef LAZY_INIT
+    unsigned int i;
+    unsigned int j;
+    unsigned int count;
+    unsigned int values[2 * PMAP_RANDOM_CHUNK];
+#endif
     unsigned int save_errno = 0;
 
 
@@ -77,36 +91,62 @@ PMap pmapInit(const char *filename, unsigned int nblocks, TreeConfig treeConfig)
     
     errno = save_errno;
 
-    for (i = 0; i < nblocks; i++) {
+    pmap->leafMask = (1U << treeHeight) - 1;
+    pmap->nPartitions = nPartitions;
 
-        leaf = (BlockNumber) ((BlockNumber) getRandomInt()) % ((BlockNumber) (pow(2, treeHeight)));
-        partition = (BlockNumber) ((BlockNumber) getRandomInt()  % ((BlockNumber) nPartitions));
-        
-        if( (leaf < 0 || leaf > pow(2, treeHeight)) || (partition > nPartitions) ){
-            logger(DEBUG, "pmap leaf %d or partition %d do not match\n");
-        }
+#ifdef LAZY_INIT
+    errno = 0;
+    pmap->initialized = (uint64_t *) calloc((nblocks + 63) / 64, sizeof(uint64_t));
 
-        pmap->map[i].partition = partition;
-        pmap->map[i].leaf = leaf;
+    if(pmap->initialized == NULL && errno == ENOMEM){
+        logger(OUT_OF_MEMORY, "Out of memory when allocating position map bitmap\n");
+        errno = save_errno;
+        abort();
     }
-    pmap->treeHeight = treeHeight;
-    pmap->nPartitions = nPartitions;
+
+    errno = save_errno;
+#else
+    for (i = 0; i < nblocks; i += count) {
+        count = nblocks - i < PMAP_RANDOM_CHUNK ? nblocks - i : PMAP_RANDOM_CHUNK;
+        getRandomInts(values, 2 * count);
+
+        for (j = 0; j < count; j++) {
+            pmap->map[i + j].partition = values[2 * j] % nPartitions;
+            pmap->map[i + j].leaf = values[2 * j + 1] & pmap->leafMask;
+        }
+    }
+#endif
 
     return pmap;
 }
 
 Location pmapGet(PMap pmap, const char *fileName, const BlockNumber blkno) {
+#ifdef LAZY_INIT
+    uint64_t bit = UINT64_C(1) << (blkno % 64);
+
+    if (!(pmap->initialized[blkno / 64] & bit)) {
+        pmap->map[blkno].partition = getRandomInt() % pmap->nPartitions;
+        pmap->map[blkno].leaf = getRandomInt() & pmap->leafMask;
+        pmap->initialized[blkno / 64] |= bit;
+    }
+#endif
     return &pmap->map[blkno];
 }
 
 void pmapUpdate(PMap pmap, const char *fileName, const BlockNumber realBlkno) {
-    pmap->map[realBlkno].partition =  (BlockNumber) ((BlockNumber) getRandomInt()  % ((BlockNumber) pmap->nPartitions));
-    pmap->map[realBlkno].leaf = (BlockNumber) ((BlockNumber) getRandomInt()) % ((BlockNumber) (pow(2, pmap->treeHeight)));
+    pmap->map[realBlkno].partition = getRandomInt() % pmap->nPartitions;
+    pmap->map[realBlkno].leaf = getRandomInt() & pmap->leafMask;
+#ifdef LAZY_INIT
+    pmap->initialized[realBlkno / 64] |= UINT64_C(1) << (realBlkno % 64);
+#endif
 
 }
 
 
 void pmapClose(PMap pmap, const char *filename) {
+#ifdef LAZY_INIT
+    free(pmap->initialized);
+#endif
     free(pmap->map);
     free(pmap);
 }
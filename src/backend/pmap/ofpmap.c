@@ -0,0 +1,291 @@
+/*-------------------------------------------------------------------------
+ *
+ * ofpmap.c
+ *      Forest ORAM position map accessed with oblivious linear scans.
+ *
+ * Same as opmap.c for the locations of forest ORAM. The partition and the
+ * leaf of a block are stored together in a 64-bit entry, the partition in
+ * the low half and the leaf in the high half, and the AVX2 scans handle
+ * four entries per instruction.
+ *
+ * This implementation assumes that only a single file is being accessed
+ * obliviously and ignores the filename.
+ *
+ * Copyright (c) 2018-2020, HASLab
+ *
+ * IDENTIFICATION
+ *        backend/pmap/ofpmap.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "oram/pmap.h"
+#include "oram/logger.h"
+#include "oram/orandom.h"
+#include "oram/pmapdefs/fdeforam.h"
+#include "oram/oblivious.h"
+
+/* Entries per AVX2 vector, the map is padded to a multiple of it */
+#define OPMAP_LANES 4
+
+/* Locations drawn at a time when the position map is initialized */
+#define PMAP_RANDOM_CHUNK 1024
+
+#define ENTRY(partition, leaf) (((uint64_t) (leaf) << 32) | (partition))
+
+struct PMap
+{
+	uint64_t   *map;
+	/* Entries in map, including the padding */
+	unsigned int nentries;
+	/* The number of leaves is a power of two, leaves are masked random ints */
+	unsigned int leafMask;
+	unsigned int nPartitions;
+	/* The last call was pmapUpdate of blkno and location holds the new location */
+	int			updated;
+	BlockNumber blkno;
+	struct Location location;
+};
+
+
+static PMap pmapInit(const char *filename, const unsigned int nblocks, TreeConfig config);
+
+static Location pmapGet(PMap pmap, const char *fileName, const BlockNumber blkno);
+
+static void pmapUpdate(PMap pmap, const char *fileName, const BlockNumber realBlkno);
+
+static void pmapClose(PMap pmap, const char *filename);
+
+static void pmapSetToken(PMap pmap, const unsigned int *token);
+
+
+/*
+ * Returns the entry of blkno, scanning the whole map.
+ */
+static uint64_t
+scanGetPortable(const uint64_t *map, unsigned int nentries, uint64_t blkno)
+{
+	uint64_t	result = 0;
+	uint64_t	mask;
+	unsigned int index;
+
+	for (index = 0; index < nentries; index++)
+	{
+		/*
+		 * All ones for the entry of blkno, zero otherwise. The barrier keeps
+		 * the compiler from branching on it.
+		 */
+		mask = 0 - (uint64_t) (index == blkno);
+		OBLIVIOUS_BARRIER(mask);
+		result |= map[index] & mask;
+	}
+	return result;
+}
+
+/*
+ * Sets the entry of blkno to value, rewriting every entry of the map.
+ */
+static void
+scanSetPortable(uint64_t *map, unsigned int nentries, uint64_t blkno,
+				uint64_t value)
+{
+	uint64_t	mask;
+	unsigned int index;
+
+	for (index = 0; index < nentries; index++)
+	{
+		mask = 0 - (uint64_t) (index == blkno);
+		OBLIVIOUS_BARRIER(mask);
+		map[index] = (map[index] & ~mask) | (value & mask);
+	}
+}
+
+#ifdef HAVE_AVX2
+
+__attribute__((target("avx2")))
+static uint64_t
+scanGetAVX2(const uint64_t *map, unsigned int nentries, uint64_t blkno)
+{
+	__m256i		indexes = _mm256_setr_epi64x(0, 1, 2, 3);
+	__m256i		step = _mm256_set1_epi64x(OPMAP_LANES);
+	__m256i		target = _mm256_set1_epi64x((long long) blkno);
+	__m256i		result = _mm256_setzero_si256();
+	__m256i		mask;
+	__m128i		half;
+	unsigned int index;
+
+	for (index = 0; index < nentries; index += OPMAP_LANES)
+	{
+		mask = _mm256_cmpeq_epi64(indexes, target);
+		result = _mm256_or_si256(result,
+								 _mm256_and_si256(_mm256_load_si256((const __m256i *) (map + index)), mask));
+		indexes = _mm256_add_epi64(indexes, step);
+	}
+
+	half = _mm_or_si128(_mm256_castsi256_si128(result),
+						_mm256_extracti128_si256(result, 1));
+	half = _mm_or_si128(half, _mm_unpackhi_epi64(half, half));
+	return (uint64_t) _mm_cvtsi128_si64(half);
+}
+
+__attribute__((target("avx2")))
+static void
+scanSetAVX2(uint64_t *map, unsigned int nentries, uint64_t blkno,
+			uint64_t value)
+{
+	__m256i		indexes = _mm256_setr_epi64x(0, 1, 2, 3);
+	__m256i		step = _mm256_set1_epi64x(OPMAP_LANES);
+	__m256i		target = _mm256_set1_epi64x((long long) blkno);
+	__m256i		values = _mm256_set1_epi64x((long long) value);
+	__m256i		entries;
+	unsigned int index;
+
+	for (index = 0; index < nentries; index += OPMAP_LANES)
+	{
+		entries = _mm256_load_si256((const __m256i *) (map + index));
+		entries = _mm256_blendv_epi8(entries, values,
+									 _mm256_cmpeq_epi64(indexes, target));
+		_mm256_store_si256((__m256i *) (map + index), entries);
+		indexes = _mm256_add_epi64(indexes, step);
+	}
+}
+
+#endif
+
+static inline uint64_t
+scanGet(PMap pmap, uint64_t blkno)
+{
+#ifdef HAVE_AVX2
+	if (hasAVX2())
+	{
+		return scanGetAVX2(pmap->map, pmap->nentries, blkno);
+	}
+#endif
+	return scanGetPortable(pmap->map, pmap->nentries, blkno);
+}
+
+static inline void
+scanSet(PMap pmap, uint64_t blkno, uint64_t value)
+{
+#ifdef HAVE_AVX2
+	if (hasAVX2())
+	{
+		scanSetAVX2(pmap->map, pmap->nentries, blkno, value);
+		return;
+	}
+#endif
+	scanSetPortable(pmap->map, pmap->nentries, blkno, value);
+}
+
+PMap
+pmapInit(const char *filename, unsigned int nblocks, TreeConfig treeConfig)
+{
+	PMap		pmap;
+	unsigned int values[2 * PMAP_RANDOM_CHUNK];
+	unsigned int i;
+	unsigned int j;
+	unsigned int count;
+	int			save_errno = errno;
+
+	errno = 0;
+	pmap = (PMap) malloc(sizeof(struct PMap));
+
+	if (pmap == NULL && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory when allocating position map\n");
+		errno = save_errno;
+		abort();
+	}
+
+	pmap->nentries = (nblocks + OPMAP_LANES - 1) / OPMAP_LANES * OPMAP_LANES;
+	if (pmap->nentries == 0)
+	{
+		pmap->nentries = OPMAP_LANES;
+	}
+	pmap->leafMask = (1U << treeConfig->treeHeight) - 1;
+	pmap->nPartitions = treeConfig->nPartitions;
+	pmap->updated = 0;
+
+	/* Vectors of the map are aligned for the AVX2 loads and stores */
+	pmap->map = (uint64_t *) aligned_alloc(32, sizeof(uint64_t) * pmap->nentries);
+
+	if (pmap->map == NULL && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory when allocating pmap blocks\n");
+		errno = save_errno;
+		abort();
+	}
+	errno = save_errno;
+
+	for (i = 0; i < pmap->nentries; i += count)
+	{
+		count = pmap->nentries - i < PMAP_RANDOM_CHUNK ? pmap->nentries - i : PMAP_RANDOM_CHUNK;
+		getRandomInts(values, 2 * count);
+
+		for (j = 0; j < count; j++)
+		{
+			pmap->map[i + j] = ENTRY(values[2 * j] % pmap->nPartitions,
+									 values[2 * j + 1] & pmap->leafMask);
+		}
+	}
+
+	return pmap;
+}
+
+Location
+pmapGet(PMap pmap, const char *fileName, const BlockNumber blkno)
+{
+	uint64_t	entry;
+
+	if (pmap->updated && pmap->blkno == blkno)
+	{
+		pmap->updated = 0;
+		return &pmap->location;
+	}
+	pmap->updated = 0;
+
+	entry = scanGet(pmap, (uint64_t) blkno);
+	pmap->location.partition = (unsigned int) entry;
+	pmap->location.leaf = (unsigned int) (entry >> 32);
+	return &pmap->location;
+}
+
+void
+pmapUpdate(PMap pmap, const char *fileName, const BlockNumber realBlkno)
+{
+	pmap->location.partition = getRandomInt() % pmap->nPartitions;
+	pmap->location.leaf = getRandomInt() & pmap->leafMask;
+	scanSet(pmap, (uint64_t) realBlkno,
+			ENTRY(pmap->location.partition, pmap->location.leaf));
+	pmap->blkno = realBlkno;
+	pmap->updated = 1;
+}
+
+void
+pmapClose(PMap pmap, const char *filename)
+{
+	free(pmap->map);
+	free(pmap);
+}
+
+void
+pmapSetToken(PMap pmap, const unsigned int *token)
+{
+}
+
+AMPMap *
+pmapCreate(void)
+{
+	AMPMap	   *pmap = (AMPMap *) malloc(sizeof(AMPMap));
+
+	pmap->pminit = &pmapInit;
+	pmap->pmget = &pmapGet;
+	pmap->pmupdate = &pmapUpdate;
+	pmap->pmclose = &pmapClose;
+	pmap->pmstoken = &pmapSetToken;
+	return pmap;
+}
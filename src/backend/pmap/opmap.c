@@ -0,0 +1,285 @@
+/*-------------------------------------------------------------------------
+ *
+ * opmap.c
+ *      In-memory position map accessed with oblivious linear scans.
+ *
+ * Same map as pmap.c, but pmapGet and pmapUpdate never index the map with
+ * the requested block number. Every call reads, and every update writes,
+ * every entry of the map in order, and the entry of the requested block is
+ * selected with masks computed from comparisons instead of branches. The
+ * memory addresses touched, and therefore the cache lines and pages, do not
+ * depend on the block accessed, which is what the doubly-oblivious builds
+ * (dstash.c with OBLIVIOUS_EVICTION) need from the position map as well.
+ *
+ * The cost of an access is linear in the number of blocks, so this map is
+ * meant for small maps, e.g., the top position map of a recursive ORAM,
+ * that fit in the L2 cache. On x86 processors with AVX2 the scan handles
+ * eight entries per instruction with vector compares and blends; otherwise
+ * a portable branch-free loop is used.
+ *
+ * The engines read the location of a block, update it and read the new
+ * location right away. The update keeps the new location, which is returned
+ * by the following pmapGet of the same block without another scan. As the
+ * engines always read the block they have just updated, whether a scan
+ * happens only depends on the sequence of calls.
+ *
+ * This implementation assumes that only a single file is being accessed
+ * obliviously and ignores the filename.
+ *
+ * Copyright (c) 2018-2020, HASLab
+ *
+ * IDENTIFICATION
+ *        backend/pmap/opmap.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "oram/pmap.h"
+#include "oram/logger.h"
+#include "oram/orandom.h"
+#include "oram/pmapdefs/pdeforam.h"
+#include "oram/oblivious.h"
+
+/* Entries per AVX2 vector, the map is padded to a multiple of it */
+#define OPMAP_LANES 8
+
+struct PMap
+{
+	uint32_t   *map;
+	/* Entries in map, including the padding */
+	unsigned int nentries;
+	/* The number of leaves is a power of two, leaves are masked random ints */
+	unsigned int leafMask;
+	/* The last call was pmapUpdate of blkno and location holds the new leaf */
+	int			updated;
+	BlockNumber blkno;
+	struct Location location;
+};
+
+
+static PMap pmapInit(const char *filename, const unsigned int nblocks, TreeConfig config);
+
+static Location pmapGet(PMap pmap, const char *fileName, const BlockNumber blkno);
+
+static void pmapUpdate(PMap pmap, const char *fileName, const BlockNumber realBlkno);
+
+static void pmapClose(PMap pmap, const char *filename);
+
+static void pmapSetToken(PMap pmap, const unsigned int *token);
+
+
+/*
+ * Returns the entry of blkno, scanning the whole map.
+ */
+static uint32_t
+scanGetPortable(const uint32_t *map, unsigned int nentries, uint32_t blkno)
+{
+	uint32_t	result = 0;
+	uint32_t	mask;
+	unsigned int index;
+
+	for (index = 0; index < nentries; index++)
+	{
+		/*
+		 * All ones for the entry of blkno, zero otherwise. The barrier keeps
+		 * the compiler from branching on it.
+		 */
+		mask = 0 - (uint32_t) (index == blkno);
+		OBLIVIOUS_BARRIER(mask);
+		result |= map[index] & mask;
+	}
+	return result;
+}
+
+/*
+ * Sets the entry of blkno to value, rewriting every entry of the map.
+ */
+static void
+scanSetPortable(uint32_t *map, unsigned int nentries, uint32_t blkno,
+				uint32_t value)
+{
+	uint32_t	mask;
+	unsigned int index;
+
+	for (index = 0; index < nentries; index++)
+	{
+		mask = 0 - (uint32_t) (index == blkno);
+		OBLIVIOUS_BARRIER(mask);
+		map[index] = (map[index] & ~mask) | (value & mask);
+	}
+}
+
+#ifdef HAVE_AVX2
+
+__attribute__((target("avx2")))
+static uint32_t
+scanGetAVX2(const uint32_t *map, unsigned int nentries, uint32_t blkno)
+{
+	__m256i		indexes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	__m256i		step = _mm256_set1_epi32(OPMAP_LANES);
+	__m256i		target = _mm256_set1_epi32((int) blkno);
+	__m256i		result = _mm256_setzero_si256();
+	__m256i		mask;
+	__m128i		half;
+	unsigned int index;
+
+	for (index = 0; index < nentries; index += OPMAP_LANES)
+	{
+		mask = _mm256_cmpeq_epi32(indexes, target);
+		result = _mm256_or_si256(result,
+								 _mm256_and_si256(_mm256_load_si256((const __m256i *) (map + index)), mask));
+		indexes = _mm256_add_epi32(indexes, step);
+	}
+
+	half = _mm_or_si128(_mm256_castsi256_si128(result),
+						_mm256_extracti128_si256(result, 1));
+	half = _mm_or_si128(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+	half = _mm_or_si128(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+	return (uint32_t) _mm_cvtsi128_si32(half);
+}
+
+__attribute__((target("avx2")))
+static void
+scanSetAVX2(uint32_t *map, unsigned int nentries, uint32_t blkno,
+			uint32_t value)
+{
+	__m256i		indexes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	__m256i		step = _mm256_set1_epi32(OPMAP_LANES);
+	__m256i		target = _mm256_set1_epi32((int) blkno);
+	__m256i		values = _mm256_set1_epi32((int) value);
+	__m256i		entries;
+	unsigned int index;
+
+	for (index = 0; index < nentries; index += OPMAP_LANES)
+	{
+		entries = _mm256_load_si256((const __m256i *) (map + index));
+		entries = _mm256_blendv_epi8(entries, values,
+									 _mm256_cmpeq_epi32(indexes, target));
+		_mm256_store_si256((__m256i *) (map + index), entries);
+		indexes = _mm256_add_epi32(indexes, step);
+	}
+}
+
+#endif
+
+static inline uint32_t
+scanGet(PMap pmap, uint32_t blkno)
+{
+#ifdef HAVE_AVX2
+	if (hasAVX2())
+	{
+		return scanGetAVX2(pmap->map, pmap->nentries, blkno);
+	}
+#endif
+	return scanGetPortable(pmap->map, pmap->nentries, blkno);
+}
+
+static inline void
+scanSet(PMap pmap, uint32_t blkno, uint32_t value)
+{
+#ifdef HAVE_AVX2
+	if (hasAVX2())
+	{
+		scanSetAVX2(pmap->map, pmap->nentries, blkno, value);
+		return;
+	}
+#endif
+	scanSetPortable(pmap->map, pmap->nentries, blkno, value);
+}
+
+PMap
+pmapInit(const char *filename, unsigned int nblocks, TreeConfig treeConfig)
+{
+	PMap		pmap;
+	unsigned int index;
+	int			save_errno = errno;
+
+	errno = 0;
+	pmap = (PMap) malloc(sizeof(struct PMap));
+
+	if (pmap == NULL && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory when allocating position map\n");
+		errno = save_errno;
+		abort();
+	}
+
+	pmap->nentries = (nblocks + OPMAP_LANES - 1) / OPMAP_LANES * OPMAP_LANES;
+	if (pmap->nentries == 0)
+	{
+		pmap->nentries = OPMAP_LANES;
+	}
+	pmap->leafMask = (1U << treeConfig->treeHeight) - 1;
+	pmap->updated = 0;
+
+	/* Vectors of the map are aligned for the AVX2 loads and stores */
+	pmap->map = (uint32_t *) aligned_alloc(32, sizeof(uint32_t) * pmap->nentries);
+
+	if (pmap->map == NULL && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory when allocating pmap blocks\n");
+		errno = save_errno;
+		abort();
+	}
+	errno = save_errno;
+
+	getRandomInts(pmap->map, pmap->nentries);
+	for (index = 0; index < pmap->nentries; index++)
+	{
+		pmap->map[index] &= pmap->leafMask;
+	}
+
+	return pmap;
+}
+
+Location
+pmapGet(PMap pmap, const char *fileName, const BlockNumber blkno)
+{
+	if (pmap->updated && pmap->blkno == blkno)
+	{
+		pmap->updated = 0;
+		return &pmap->location;
+	}
+	pmap->updated = 0;
+
+	pmap->location.leaf = scanGet(pmap, (uint32_t) blkno);
+	return &pmap->location;
+}
+
+void
+pmapUpdate(PMap pmap, const char *fileName, const BlockNumber realBlkno)
+{
+	pmap->location.leaf = getRandomInt() & pmap->leafMask;
+	scanSet(pmap, (uint32_t) realBlkno, pmap->location.leaf);
+	pmap->blkno = realBlkno;
+	pmap->updated = 1;
+}
+
+void
+pmapClose(PMap pmap, const char *filename)
+{
+	free(pmap->map);
+	free(pmap);
+}
+
+void
+pmapSetToken(PMap pmap, const unsigned int *token)
+{
+}
+
+AMPMap *
+pmapCreate(void)
+{
+	AMPMap	   *pmap = (AMPMap *) malloc(sizeof(AMPMap));
+
+	pmap->pminit = &pmapInit;
+	pmap->pmget = &pmapGet;
+	pmap->pmupdate = &pmapUpdate;
+	pmap->pmclose = &pmapClose;
+	pmap->pmstoken = &pmapSetToken;
+	return pmap;
+}
@@ -7,6 +7,12 @@
  * oram leaf nodes in an array. This implementation assumes that only a
  * single file is being accessed obliviously and ignores the filename.
  *
+ * With LAZY_INIT, pmapInit does not draw the leaves of the blocks. A bitmap
+ * records the entries already set, and the leaf of a block is drawn the
+ * first time pmapGet reads it. Large maps are then ready in constant time,
+ * as the operating system only provides the pages of the map and bitmap
+ * when they are first touched.
+ *
  * Copyright (c) 2018-2019, HASLab
  *
  * IDENTIFICATION
@@ -15,17 +21,27 @@
  *-------------------------------------------------------------------------
  */
 
-#include <math.h>
+#include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "oram/pmap.h"
+#include "oram/logger.h"
 #include "oram/orandom.h"
 #include "oram/pmapdefs/pdeforam.h"
 
+/* Leaves drawn at a time when the position map is initialized */
+#define PMAP_RANDOM_CHUNK 1024
+
 struct PMap
 {
 	struct Location *map;
-    int treeHeight;
+    /* The number of leaves is a power of two, leaves are masked random ints */
+    unsigned int leafMask;
+#ifdef LAZY_INIT
+	/* Bit blkno is set once the leaf of blkno has been drawn */
+	uint64_t   *initialized;
+#endif
 };
 
 
@@ -40,19 +56,42 @@ static void pmapClose(PMap pmap, const char *filename);
 PMap
 pmapInit(const char *filename, unsigned int nblocks, TreeConfig treeConfig)
 {
-	int			i;
-	BlockNumber r;
 	PMap		pmap;
+#ifndef LAZY_INIT
+	unsigned int i;
+	unsigned int j;
+	unsigned int count;
+	unsigned int leaves[PMAP_RANDOM_CHUNK];
+#else
+	int			save_errno = errno;
+#endif
 
 	pmap = (PMap) malloc(sizeof(struct PMap));
 	pmap->map = (Location) malloc(sizeof(struct Location) * nblocks);
-    pmap->treeHeight = treeConfig->treeHeight;
+    pmap->leafMask = (1U << treeConfig->treeHeight) - 1;
+
+#ifdef LAZY_INIT
+	errno = 0;
+	pmap->initialized = (uint64_t *) calloc((nblocks + 63) / 64, sizeof(uint64_t));
 
-	for (i = 0; i < nblocks; i++)
+	if (pmap->initialized == NULL && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory when allocating position map bitmap\n");
+		errno = save_errno;
+		abort();
+	}
+	errno = save_errno;
+#else
+	for (i = 0; i < nblocks; i += count)
 	{
-		r = (BlockNumber) ((BlockNumber) getRandomInt()) % ((BlockNumber) (pow(2, treeConfig->treeHeight)));
-		pmap->map[i].leaf = r;
+		count = nblocks - i < PMAP_RANDOM_CHUNK ? nblocks - i : PMAP_RANDOM_CHUNK;
+		getRandomInts(leaves, count);
+		for (j = 0; j < count; j++)
+		{
+			pmap->map[i + j].leaf = leaves[j] & pmap->leafMask;
+		}
 	}
+#endif
 
 	return pmap;
 }
@@ -60,19 +99,33 @@ pmapInit(const char *filename, unsigned int nblocks, TreeConfig treeConfig)
 Location
 pmapGet(PMap pmap, const char *fileName, const BlockNumber blkno)
 {
+#ifdef LAZY_INIT
+	uint64_t	bit = UINT64_C(1) << (blkno % 64);
+
+	if (!(pmap->initialized[blkno / 64] & bit))
+	{
+		pmap->map[blkno].leaf = getRandomInt() & pmap->leafMask;
+		pmap->initialized[blkno / 64] |= bit;
+	}
+#endif
 	return &pmap->map[blkno];
 }
 
 
 void
 pmapUpdate(PMap pmap, const char *fileName, const BlockNumber realBlkno){
-    pmap->map[realBlkno].leaf = (BlockNumber) ((BlockNumber) getRandomInt()) % ((BlockNumber) (pow(2, pmap->treeHeight)));
-
+    pmap->map[realBlkno].leaf = getRandomInt() & pmap->leafMask;
+#ifdef LAZY_INIT
+	pmap->initialized[realBlkno / 64] |= UINT64_C(1) << (realBlkno % 64);
+#endif
 }
 
 void
 pmapClose(PMap pmap, const char *filename)
 {
+#ifdef LAZY_INIT
+	free(pmap->initialized);
+#endif
 	free(pmap->map);
 	free(pmap);
 }
@@ -0,0 +1,339 @@
+/*-------------------------------------------------------------------------
+ *
+ * prfpmap.c
+ *      Position map that derives leaves from per-block access counters.
+ *
+ * Instead of a leaf per block, this position map keeps a small counter of
+ * the accesses to each block and computes the leaf of a block as
+ * PRF(key, blkno || counter), with AES-128 under a key drawn from the system
+ * random source as the PRF. Updating the leaf of a block increments its
+ * counter, which yields a fresh pseudorandom leaf.
+ *
+ * Counters are PRFPMAP_COUNTER_BITS wide (8 or 16) and blocks are grouped in
+ * groups of PRFPMAP_GROUP_SIZE blocks that share a 32-bit base. The counter
+ * of a block is the group base plus the block's own counter. When the counter
+ * of a block is about to overflow, the smallest counter of its group is moved
+ * to the base, which leaves the counters of the other blocks unchanged. If
+ * that is not possible, because some block of the group has not been accessed
+ * since the last rebase, the group is split in halves with a base each and
+ * the half of the block is rebased in turn. A part with a single block can
+ * always be rebased, so at worst every block of the group ends up with its own
+ * base, the memory of 32-bit counters. The number of splits is logged when
+ * the position map is closed.
+ *
+ * The counters start at zero, so initialization only allocates zeroed
+ * memory and draws the key. This implementation assumes that only a single
+ * file is being accessed obliviously and ignores the filename.
+ *
+ * Copyright (c) 2018-2020, HASLab
+ *
+ * IDENTIFICATION
+ *        backend/pmap/prfpmap.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+
+#include "oram/pmap.h"
+#include "oram/logger.h"
+#include "oram/aes.h"
+#include "oram/pmapdefs/pdeforam.h"
+
+/* Width in bits of the per-block counters, 8 or 16 */
+#ifndef PRFPMAP_COUNTER_BITS
+#define PRFPMAP_COUNTER_BITS 16
+#endif
+
+/* Number of blocks that share a counter base */
+#ifndef PRFPMAP_GROUP_SIZE
+#define PRFPMAP_GROUP_SIZE 64
+#endif
+
+#if PRFPMAP_COUNTER_BITS == 8
+typedef uint8_t Counter;
+#elif PRFPMAP_COUNTER_BITS == 16
+typedef uint16_t Counter;
+#else
+#error "PRFPMAP_COUNTER_BITS must be 8 or 16"
+#endif
+
+/* Groups are split in halves down to single blocks */
+#if (PRFPMAP_GROUP_SIZE & (PRFPMAP_GROUP_SIZE - 1)) != 0
+#error "PRFPMAP_GROUP_SIZE must be a power of two"
+#endif
+
+/* Largest per-block counter, smaller values exercise rebasing in tests */
+#ifndef PRFPMAP_COUNTER_MAX
+#define PRFPMAP_COUNTER_MAX ((Counter) ~0)
+#endif
+
+typedef struct CounterGroup
+{
+	/* Base of the group until it is split */
+	uint32_t	base;
+	/* Bases of the nbases equal parts of a split group, NULL otherwise */
+	uint32_t   *bases;
+	unsigned int nbases;
+} CounterGroup;
+
+struct PMap
+{
+	Counter    *counters;
+	CounterGroup *groups;
+	unsigned int nblocks;
+	unsigned int ngroups;
+	/* Number of times a group has been split */
+	unsigned int nsplits;
+	/* The number of leaves is a power of two, leaves are masked PRF outputs */
+	uint32_t	leafMask;
+	AESKey		key;
+	/* Location returned by pmapGet */
+	struct Location location;
+};
+
+
+static PMap pmapInit(const char *filename, const unsigned int nblocks, TreeConfig config);
+
+static Location pmapGet(PMap pmap, const char *fileName, const BlockNumber blkno);
+
+static void pmapUpdate(PMap pmap, const char *fileName, const BlockNumber realBlkno);
+
+static void pmapClose(PMap pmap, const char *filename);
+
+static void pmapSetToken(PMap pmap, const unsigned int *token);
+
+static void pmapRebase(PMap pmap, BlockNumber blkno);
+
+static void pmapSplit(PMap pmap, CounterGroup *group);
+
+
+PMap
+pmapInit(const char *filename, unsigned int nblocks, TreeConfig treeConfig)
+{
+	PMap		pmap;
+	uint8_t		raw[AES_KEY_SIZE];
+	size_t		filled = 0;
+	ssize_t		result;
+	int			save_errno = errno;
+
+	errno = 0;
+	pmap = (PMap) malloc(sizeof(struct PMap));
+
+	if (pmap == NULL && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory when allocating position map\n");
+		errno = save_errno;
+		abort();
+	}
+
+	pmap->nblocks = nblocks;
+	pmap->ngroups = (nblocks + PRFPMAP_GROUP_SIZE - 1) / PRFPMAP_GROUP_SIZE;
+	pmap->nsplits = 0;
+	pmap->leafMask = treeConfig->treeHeight >= 32 ? ~0U
+		: (1U << treeConfig->treeHeight) - 1;
+
+	pmap->counters = (Counter *) calloc(nblocks > 0 ? nblocks : 1, sizeof(Counter));
+	pmap->groups = (CounterGroup *) calloc(pmap->ngroups > 0 ? pmap->ngroups : 1,
+										   sizeof(CounterGroup));
+
+	if ((pmap->counters == NULL || pmap->groups == NULL) && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory when allocating pmap counters\n");
+		errno = save_errno;
+		abort();
+	}
+
+	while (filled < AES_KEY_SIZE)
+	{
+		result = getrandom(raw + filled, AES_KEY_SIZE - filled, 0);
+		if (result < 0 && errno != EINTR)
+		{
+			logger(DEBUG, "Position map key generation failed: %s\n", strerror(errno));
+			abort();
+		}
+		if (result > 0)
+		{
+			filled += (size_t) result;
+		}
+	}
+	errno = save_errno;
+
+	aesSetKey(&pmap->key, raw);
+	memset(raw, 0, AES_KEY_SIZE);
+
+	return pmap;
+}
+
+/* Base of the part of its group that blkno belongs to */
+static inline uint32_t *
+pmapBase(PMap pmap, BlockNumber blkno)
+{
+	CounterGroup *group = &pmap->groups[blkno / PRFPMAP_GROUP_SIZE];
+
+	if (group->bases == NULL)
+	{
+		return &group->base;
+	}
+	return &group->bases[(blkno % PRFPMAP_GROUP_SIZE)
+						 / (PRFPMAP_GROUP_SIZE / group->nbases)];
+}
+
+static inline uint32_t
+pmapCounter(PMap pmap, BlockNumber blkno)
+{
+	return *pmapBase(pmap, blkno) + pmap->counters[blkno];
+}
+
+Location
+pmapGet(PMap pmap, const char *fileName, const BlockNumber blkno)
+{
+	uint32_t	input[4];
+	uint32_t	output[4];
+
+	input[0] = (uint32_t) blkno;
+	input[1] = pmapCounter(pmap, blkno);
+	input[2] = 0;
+	input[3] = 0;
+
+	aesEncryptBlocks(&pmap->key, (const uint8_t *) input, (uint8_t *) output, 1);
+
+	pmap->location.leaf = output[0] & pmap->leafMask;
+
+	return &pmap->location;
+}
+
+/*
+ * Makes room in the counter of blkno, which reached PRFPMAP_COUNTER_MAX, by
+ * moving the smallest counter of its part of the group to the base of the
+ * part. Parts are split until the smallest counter is not zero, which at
+ * worst leaves blkno alone in its part.
+ */
+void
+pmapRebase(PMap pmap, BlockNumber blkno)
+{
+	CounterGroup *group = &pmap->groups[blkno / PRFPMAP_GROUP_SIZE];
+	unsigned int size;
+	unsigned int first;
+	unsigned int last;
+	unsigned int index;
+	Counter		minimum;
+
+	for (;;)
+	{
+		size = PRFPMAP_GROUP_SIZE / (group->bases == NULL ? 1 : group->nbases);
+		first = blkno - blkno % size;
+		last = first + size < pmap->nblocks ? first + size : pmap->nblocks;
+		minimum = PRFPMAP_COUNTER_MAX;
+
+		for (index = first; index < last; index++)
+		{
+			if (pmap->counters[index] < minimum)
+			{
+				minimum = pmap->counters[index];
+			}
+		}
+
+		if (minimum > 0)
+		{
+			break;
+		}
+		pmapSplit(pmap, group);
+	}
+
+	for (index = first; index < last; index++)
+	{
+		pmap->counters[index] -= minimum;
+	}
+	*pmapBase(pmap, blkno) += minimum;
+}
+
+/*
+ * Splits every part of group in two halves that start with the base of the
+ * part.
+ */
+void
+pmapSplit(PMap pmap, CounterGroup *group)
+{
+	unsigned int nbases = group->bases == NULL ? 1 : group->nbases;
+	unsigned int index;
+	uint32_t   *bases;
+	int			save_errno = errno;
+
+	errno = 0;
+	bases = (uint32_t *) malloc(sizeof(uint32_t) * nbases * 2);
+
+	if (bases == NULL && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory when splitting pmap counters\n");
+		errno = save_errno;
+		abort();
+	}
+	errno = save_errno;
+
+	for (index = 0; index < nbases; index++)
+	{
+		bases[2 * index] = group->bases == NULL ? group->base : group->bases[index];
+		bases[2 * index + 1] = bases[2 * index];
+	}
+
+	free(group->bases);
+	group->bases = bases;
+	group->nbases = nbases * 2;
+	pmap->nsplits++;
+}
+
+void
+pmapUpdate(PMap pmap, const char *fileName, const BlockNumber realBlkno)
+{
+	if (pmap->counters[realBlkno] == PRFPMAP_COUNTER_MAX)
+	{
+		pmapRebase(pmap, realBlkno);
+	}
+	pmap->counters[realBlkno]++;
+}
+
+void
+pmapClose(PMap pmap, const char *filename)
+{
+	unsigned int index;
+	unsigned int nsplit = 0;
+
+	for (index = 0; index < pmap->ngroups; index++)
+	{
+		nsplit += pmap->groups[index].bases != NULL;
+		free(pmap->groups[index].bases);
+	}
+
+	if (pmap->nsplits > 0)
+	{
+		logger(DEBUG, "Position map split %u of %u counter groups, %u splits\n",
+			   nsplit, pmap->ngroups, pmap->nsplits);
+	}
+	memset(&pmap->key, 0, sizeof(AESKey));
+	free(pmap->groups);
+	free(pmap->counters);
+	free(pmap);
+}
+
+void
+pmapSetToken(PMap pmap, const unsigned int *token)
+{
+}
+
+AMPMap *
+pmapCreate(void)
+{
+	AMPMap	   *pmap = (AMPMap *) malloc(sizeof(AMPMap));
+
+	pmap->pminit = &pmapInit;
+	pmap->pmget = &pmapGet;
+	pmap->pmupdate = &pmapUpdate;
+	pmap->pmclose = &pmapClose;
+	pmap->pmstoken = &pmapSetToken;
+	return pmap;
+}
@@ -0,0 +1,314 @@
+/*-------------------------------------------------------------------------
+ *
+ * rpmap.c
+ *      Recursive implementation of a position map.
+ *
+ * Position map that only keeps the leaves of the blocks in client memory if
+ * they fit in RPMAP_BUDGET bytes. Otherwise, the leaves are packed in chunks
+ * of RPMAP_CHUNK_SIZE bytes that are stored in a smaller ORAM built with the
+ * same ORAM construction this position map is linked with. The smaller ORAM
+ * uses a recursive position map as well, so the recursion continues until the
+ * position map of the smallest ORAM fits the budget.
+ *
+ * Every access to the position map is a single read-modify-write of the
+ * chunk of the requested block: the update of its leaf reads the chunk with
+ * read_poram, changes the leaf while the path of the chunk is open and
+ * writes it back with evict_poram. Hence, the smaller ORAM must be a Path
+ * ORAM, the construction this position map is meant to be linked with, and
+ * every level of the recursion costs one access. The last chunk accessed is
+ * kept in client memory, so that the queries before and after the update are
+ * served without further accesses. Chunks that were never written are
+ * materialized with random leafs when first read.
+ *
+ * This implementation assumes that only a single file is being accessed
+ * obliviously and derives the file name of the smaller ORAM from it.
+ *
+ * Copyright (c) 2018-2020, HASLab
+ *
+ * IDENTIFICATION
+ *        backend/pmap/rpmap.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "oram/poram.h"
+#include "oram/logger.h"
+#include "oram/orandom.h"
+#include "oram/pmapdefs/pdeforam.h"
+
+/* Maximum size in bytes of a position map kept in client memory */
+#ifndef RPMAP_BUDGET
+#define RPMAP_BUDGET (1 << 20)
+#endif
+
+/* Size in bytes of the blocks of the ORAM that stores the position map */
+#ifndef RPMAP_CHUNK_SIZE
+#define RPMAP_CHUNK_SIZE 4096
+#endif
+
+/* Bucket capacity of the ORAM that stores the position map */
+#ifndef RPMAP_BUCKET_CAPACITY
+#define RPMAP_BUCKET_CAPACITY 4
+#endif
+
+#define RPMAP_SUFFIX ".pmap"
+
+
+struct PMap
+{
+	/* Leaves of every block if they fit the budget, NULL otherwise */
+	struct Location *map;
+	/* The number of leaves is a power of two, leaves are masked random ints */
+	unsigned int leafMask;
+
+	/* ORAM that stores the position map chunks */
+	ORAMState	oram;
+	Amgr		amgr;
+	char	   *file;
+	unsigned int entriesPerChunk;
+	unsigned int nChunks;
+
+	/* Last chunk accessed, nChunks if none */
+	struct Location *chunk;
+	BlockNumber chunkNumber;
+	/* The path of chunk has been read and not evicted yet */
+	unsigned int open;
+};
+
+
+static PMap pmapInit(const char *filename, const unsigned int nblocks, TreeConfig config);
+
+static Location pmapGet(PMap pmap, const char *fileName, const BlockNumber blkno);
+
+static void pmapUpdate(PMap pmap, const char *fileName, const BlockNumber realBlkno);
+
+static void pmapClose(PMap pmap, const char *filename);
+
+static void pmapOpenChunk(PMap pmap, const BlockNumber chunkNumber);
+
+static void pmapCloseChunk(PMap pmap);
+
+static unsigned int pmapRandomLeaf(PMap pmap);
+
+
+unsigned int
+pmapRandomLeaf(PMap pmap)
+{
+	return getRandomInt() & pmap->leafMask;
+}
+
+PMap
+pmapInit(const char *filename, unsigned int nblocks, TreeConfig treeConfig)
+{
+	int			i;
+	int			save_errno = 0;
+	int			namelen = 0;
+	PMap		pmap;
+
+	save_errno = errno;
+	errno = 0;
+
+	pmap = (PMap) malloc(sizeof(struct PMap));
+
+	if (pmap == NULL && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory when allocating position map\n");
+		errno = save_errno;
+		abort();
+	}
+
+	pmap->leafMask = (1U << treeConfig->treeHeight) - 1;
+	pmap->map = NULL;
+	pmap->oram = NULL;
+	pmap->file = NULL;
+	pmap->chunk = NULL;
+	pmap->open = 0;
+
+	if ((size_t) nblocks * sizeof(struct Location) <= RPMAP_BUDGET)
+	{
+		pmap->map = (Location) malloc(sizeof(struct Location) * nblocks);
+
+		if (pmap->map == NULL && errno == ENOMEM)
+		{
+			logger(OUT_OF_MEMORY, "Out of memory when allocating pmap blocks\n");
+			errno = save_errno;
+			abort();
+		}
+		errno = save_errno;
+
+		for (i = 0; i < nblocks; i++)
+		{
+			pmap->map[i].leaf = pmapRandomLeaf(pmap);
+		}
+
+		return pmap;
+	}
+
+	pmap->entriesPerChunk = RPMAP_CHUNK_SIZE / sizeof(struct Location);
+	/* ORAM engines accept block numbers up to nblocks. */
+	pmap->nChunks = nblocks / pmap->entriesPerChunk + 1;
+	pmap->chunkNumber = pmap->nChunks;
+
+	namelen = strlen(filename) + strlen(RPMAP_SUFFIX) + 1;
+	pmap->file = (char *) malloc(namelen);
+	pmap->chunk = (Location) malloc(pmap->entriesPerChunk * sizeof(struct Location));
+
+	if ((pmap->file == NULL || pmap->chunk == NULL) && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory when allocating pmap chunk\n");
+		errno = save_errno;
+		abort();
+	}
+	errno = save_errno;
+
+	snprintf(pmap->file, namelen, "%s%s", filename, RPMAP_SUFFIX);
+
+	pmap->amgr.am_stash = stashCreate();
+	pmap->amgr.am_pmap = pmapCreate();
+	pmap->amgr.am_ofile = ofileCreate();
+
+	logger(DEBUG, "Recursive position map stores %d blocks in %d chunks\n",
+           nblocks, pmap->nChunks);
+
+	pmap->oram = init_oram(pmap->file, pmap->nChunks,
+                           pmap->entriesPerChunk * sizeof(struct Location),
+                           RPMAP_BUCKET_CAPACITY, &pmap->amgr, NULL);
+
+	return pmap;
+}
+
+/*
+ * Reads chunkNumber from the position map ORAM without evicting its path,
+ * unless it is already open. A different chunk still open is evicted first.
+ */
+void
+pmapOpenChunk(PMap pmap, const BlockNumber chunkNumber)
+{
+	char	   *data = NULL;
+	int			result;
+	int			i;
+
+	if (pmap->open && pmap->chunkNumber == chunkNumber)
+	{
+		return;
+	}
+
+	if (pmap->open)
+	{
+		pmapCloseChunk(pmap);
+	}
+
+	result = read_poram(&data, chunkNumber, pmap->oram, NULL);
+
+	if (result == DUMMY_BLOCK)
+	{
+		for (i = 0; i < pmap->entriesPerChunk; i++)
+		{
+			pmap->chunk[i].leaf = pmapRandomLeaf(pmap);
+		}
+	}
+	else
+	{
+		memcpy(pmap->chunk, data, pmap->entriesPerChunk * sizeof(struct Location));
+	}
+
+	free(data);
+	pmap->chunkNumber = chunkNumber;
+	pmap->open = 1;
+}
+
+/*
+ * Writes the open chunk back and evicts its path, which completes the access
+ * to the position map ORAM. The chunk stays in client memory.
+ */
+void
+pmapCloseChunk(PMap pmap)
+{
+	evict_poram((char *) pmap->chunk,
+                pmap->entriesPerChunk * sizeof(struct Location),
+                pmap->chunkNumber, pmap->oram, NULL);
+	pmap->open = 0;
+}
+
+/*
+ * Queries are served from the last chunk accessed. Otherwise, the chunk is
+ * opened and the access completes with the update of the block.
+ */
+Location
+pmapGet(PMap pmap, const char *fileName, const BlockNumber blkno)
+{
+	BlockNumber chunkNumber;
+
+	if (pmap->map != NULL)
+	{
+		return &pmap->map[blkno];
+	}
+
+	chunkNumber = blkno / pmap->entriesPerChunk;
+
+	if (pmap->chunkNumber != chunkNumber)
+	{
+		pmapOpenChunk(pmap, chunkNumber);
+	}
+
+	return &pmap->chunk[blkno % pmap->entriesPerChunk];
+}
+
+/*
+ * Every update costs exactly one access to the position map ORAM, whatever
+ * queries preceded it.
+ */
+void
+pmapUpdate(PMap pmap, const char *fileName, const BlockNumber realBlkno)
+{
+	if (pmap->map != NULL)
+	{
+		pmap->map[realBlkno].leaf = pmapRandomLeaf(pmap);
+		return;
+	}
+
+	pmapOpenChunk(pmap, realBlkno / pmap->entriesPerChunk);
+	pmap->chunk[realBlkno % pmap->entriesPerChunk].leaf = pmapRandomLeaf(pmap);
+	pmapCloseChunk(pmap);
+}
+
+void
+pmapClose(PMap pmap, const char *filename)
+{
+	if (pmap->open)
+	{
+		pmapCloseChunk(pmap);
+	}
+
+	if (pmap->oram != NULL)
+	{
+		close_oram(pmap->oram, NULL);
+	}
+	free(pmap->chunk);
+	free(pmap->file);
+	free(pmap->map);
+	free(pmap);
+}
+
+void
+pmapSetToken(PMap pmap, const unsigned int *token)
+{
+}
+
+AMPMap *
+pmapCreate(void)
+{
+	AMPMap	   *pmap = (AMPMap *) malloc(sizeof(AMPMap));
+
+	pmap->pminit = &pmapInit;
+	pmap->pmget = &pmapGet;
+	pmap->pmupdate = &pmapUpdate;
+	pmap->pmclose = &pmapClose;
+	pmap->pmstoken = &pmapSetToken;
+	return pmap;
+}
@@ -3,6 +3,12 @@
  * Token pmap for path oram
  * Implementation of a pmap that generates the leaf of a pathoram tree
  * from a cryptographic token given as input by a client application.
+ *
+ * The token of the next access is either set with setToken or taken from a
+ * ring buffer of tokens handed over in bulk with setTokens. An access takes
+ * the next queued token on its first pmapGet and is done with it after the
+ * pmapGet that follows pmapUpdate. When no token is queued, the last token
+ * keeps being used, as with setToken alone.
  * 
  * Copyright (c) 2018-2020, HASLab
  *
@@ -12,7 +18,7 @@
  *-------------------------------------------------------------------------
  */
 
-#include <math.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -24,12 +30,28 @@
 //The token size is 4 integers (128 bits, the size of an AES block)
 #define TOKEN_SIZE 4
 
+//Initial number of tokens the ring buffer can queue
+#define TOKEN_RING_CAPACITY 64
+
+//Progress of the access that uses the current token
+#define TOKEN_SPENT 0
+#define TOKEN_CURRENT 1
+#define TOKEN_UPDATED 2
+
 struct PMap
 {
 
-    int treeHeight; 
+    /* The number of leaves is a power of two, leaves are masked tokens */
+    unsigned int leafMask;
     unsigned int* token;
     Location loc;
+    int tokenState;
+
+    /* Ring buffer of queued tokens */
+    unsigned int* ring;
+    unsigned int ringCapacity;
+    unsigned int ringHead;
+    unsigned int ringCount;
 };
 
 
@@ -43,6 +65,10 @@ static void pmapClose(PMap pmap, const char *filename);
 
 static void pmapSetToken(PMap pmap, const unsigned int* token);
 
+static void pmapSetTokens(PMap pmap, const unsigned int* tokens, unsigned int ntokens);
+
+static void pmapGrowRing(PMap pmap, unsigned int capacity);
+
 PMap
 pmapInit(const char *filename, unsigned int nblocks, TreeConfig treeConfig)
 {
@@ -51,21 +77,96 @@ pmapInit(const char *filename, unsigned int nblocks, TreeConfig treeConfig)
 	PMap		pmap;
 
 	pmap = (PMap) malloc(sizeof(struct PMap));
-    pmap->treeHeight = treeConfig->treeHeight;
+    pmap->leafMask = (1U << treeConfig->treeHeight) - 1;
     pmap->token = (unsigned int*) malloc(TOKEN_SIZE*sizeof(unsigned int));
     pmap->loc = (Location) malloc(sizeof(struct Location));
+    memset(pmap->token, 0, TOKEN_SIZE*sizeof(unsigned int));
+    pmap->tokenState = TOKEN_SPENT;
+
+    pmap->ring = NULL;
+    pmap->ringCapacity = 0;
+    pmap->ringHead = 0;
+    pmap->ringCount = 0;
 
 	return pmap;
 }
 
 void pmapSetToken(PMap pmap, const unsigned int* token){
     memcpy(pmap->token, token, TOKEN_SIZE*sizeof(unsigned int));
+    pmap->tokenState = TOKEN_CURRENT;
+}
+
+/*
+ * Grows the ring buffer to hold at least capacity tokens, moving the queued
+ * tokens to its start.
+ */
+void
+pmapGrowRing(PMap pmap, unsigned int capacity)
+{
+    unsigned int* ring;
+    unsigned int newCapacity;
+    unsigned int index;
+    int save_errno = errno;
+
+    newCapacity = pmap->ringCapacity > 0 ? pmap->ringCapacity : TOKEN_RING_CAPACITY;
+    while (newCapacity < capacity) {
+        newCapacity *= 2;
+    }
+
+    errno = 0;
+    ring = (unsigned int*) malloc(sizeof(unsigned int) * TOKEN_SIZE * newCapacity);
+
+    if (ring == NULL && errno == ENOMEM) {
+        logger(OUT_OF_MEMORY, "Out of memory when queueing pmap tokens\n");
+        errno = save_errno;
+        abort();
+    }
+    errno = save_errno;
+
+    for (index = 0; index < pmap->ringCount; index++) {
+        memcpy(ring + index * TOKEN_SIZE,
+               pmap->ring + ((pmap->ringHead + index) % pmap->ringCapacity) * TOKEN_SIZE,
+               TOKEN_SIZE * sizeof(unsigned int));
+    }
+
+    free(pmap->ring);
+    pmap->ring = ring;
+    pmap->ringCapacity = newCapacity;
+    pmap->ringHead = 0;
+}
+
+void pmapSetTokens(PMap pmap, const unsigned int* tokens, unsigned int ntokens){
+    unsigned int index;
+    unsigned int tail;
+
+    if (pmap->ringCount + ntokens > pmap->ringCapacity) {
+        pmapGrowRing(pmap, pmap->ringCount + ntokens);
+    }
+
+    for (index = 0; index < ntokens; index++) {
+        tail = (pmap->ringHead + pmap->ringCount) % pmap->ringCapacity;
+        memcpy(pmap->ring + tail * TOKEN_SIZE, tokens + index * TOKEN_SIZE,
+               TOKEN_SIZE * sizeof(unsigned int));
+        pmap->ringCount++;
+    }
 }
 
 Location
 pmapGet(PMap pmap, const char *fileName, const BlockNumber blkno)
 {
-	pmap->loc->leaf = (pmap->token[0] % ((BlockNumber) (pow(2, pmap->treeHeight))));
+    if (pmap->tokenState == TOKEN_SPENT && pmap->ringCount > 0) {
+        memcpy(pmap->token, pmap->ring + pmap->ringHead * TOKEN_SIZE,
+               TOKEN_SIZE * sizeof(unsigned int));
+        pmap->ringHead = (pmap->ringHead + 1) % pmap->ringCapacity;
+        pmap->ringCount--;
+        pmap->tokenState = TOKEN_CURRENT;
+    }
+
+	pmap->loc->leaf = pmap->token[0] & pmap->leafMask;
+
+    if (pmap->tokenState == TOKEN_UPDATED) {
+        pmap->tokenState = TOKEN_SPENT;
+    }
     return pmap->loc;
 }
 
@@ -76,12 +177,14 @@ pmapUpdate(PMap pmap, const char *fileName, const BlockNumber realBlkno){
     //Both the path oram and forest oram will issue a new pmapGet request
     //that will return a new leaf location.
     pmap->token[0] = pmap->token[1]; 
+    pmap->tokenState = TOKEN_UPDATED;
 
 }
 
 void
 pmapClose(PMap pmap, const char *filename)
 {
+    free(pmap->ring);
     free(pmap->loc);
     free(pmap->token);
 	free(pmap);
@@ -99,3 +202,12 @@ pmapCreate(void)
     pmap->pmstoken = &pmapSetToken;
 	return pmap;
 }
+
+AMPMapExt *
+pmapExtCreate(void)
+{
+	AMPMapExt  *ext = (AMPMapExt *) malloc(sizeof(AMPMapExt));
+
+	ext->pmstokens = &pmapSetTokens;
+	return ext;
+}
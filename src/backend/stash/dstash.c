@@ -1,35 +1,68 @@
 /*-------------------------------------------------------------------------
  *
- * stash.c
- *      In-memory implementation of a stash.
+ * dstash.c
+ *      In-memory implementation of a doubly-oblivious stash.
  *
- * Implementation of a in-memory stash that keeps tracks of the blocks read
- * from an oblivious file and the blocks that have to be updated. This
- * implementation depends on the GSList of the glib and assumes that
- * only a single file is being accessed obliviously and ignores the filename.
+ * The stash has a fixed number of slots and every lookup, insertion, update
+ * and removal scans all of them, whatever the block requested, so the memory
+ * access pattern does not depend on which slot holds a block.
  *
- * Copyright (c) 2018-2019, HASLab
+ * The block numbers of the slots are kept in a contiguous array, apart from
+ * the stashed blocks, so a scan reads a single array instead of following a
+ * pointer per slot. A scan compares every slot with the block requested and
+ * with DUMMY_BLOCK and folds the results into the slot of the block and the
+ * last free slot without branches, several slots at a time with AVX2 if the
+ * processor supports it, checked once at run time, with SSE2 when the
+ * compiler targets it and one slot at a time otherwise. Only the slot found
+ * is accessed afterwards. The stashed blocks are kept by
+ * reference and their payloads stay in the buffers of the block pool of the
+ * ORAM state.
+ *
+ * The iterator skips free slots and, as the eviction of the ORAM algorithms
+ * is not oblivious, the number of stashed blocks is not hidden. If the stash
+ * is full, stashAdd and stashUpdate abort.
+ *
+ * Copyright (c) 2018-2020, HASLab
  *
  * IDENTIFICATION
- *        backend/stash/stash.c
+ *        backend/stash/dstash.c
  *
  *-------------------------------------------------------------------------
  */
 
 #include <errno.h>
-#include <collectc/list.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "oram/stash.h"
 #include "oram/logger.h"
+#include "oram/oblivious.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Slots per AVX2 vector, the array is padded to a multiple of it */
+#define DSTASH_LANES 8
+
+/*
+ * Block number of the slots that pad the array to a multiple of the vector
+ * width. It matches neither a real block nor a free slot.
+ */
+#define PADDING_BLOCK -2
 
 
 struct Stash
 {
 	unsigned int it;
-    unsigned int size;
-
-    PLBlock* blocks;
+	unsigned int size;
+	unsigned int padded;
+	/* Number of slots rounded up to a multiple of DSTASH_LANES */
+
+	int		   *blknos;
+	/* Block number of each slot, DUMMY_BLOCK if the slot is free */
+	PLBList		blocks;
+	/* Block of each slot, only valid if the slot is not free */
 };
 
 
@@ -55,6 +88,8 @@ static unsigned int stashNext(Stash stash, const char *filename, PLBlock *block,
 
 static void stashCloseIt(Stash stash, const char *filename, void *appData);
 
+static void scanSlots(Stash stash, int blkno, int *match, int *freeSlot);
+
 AMStash *
 stashCreate(void)
 {
@@ -78,13 +113,14 @@ stashCreate(void)
 Stash
 stashInit(const char *filename, const unsigned int stashSize, const unsigned int blockSize, void *appData)
 {
-	
-    int i, save_errno = 0;
+
+    unsigned int i;
+    int save_errno = 0;
     Stash stash;
-    
+
     save_errno = errno;
     errno = 0;
-    
+
     stash = (Stash) malloc(sizeof(struct Stash));
 
     if(stash == NULL && errno == ENOMEM){
@@ -92,47 +128,190 @@ stashInit(const char *filename, const unsigned int stashSize, const unsigned int
         errno = save_errno;
         abort();
     }
-    //logger(DEBUG, "Initializing stash with size %d\n", stashSize);
-    stash->blocks = (PLBlock*) malloc(sizeof(PLBlock)*stashSize);
-    
-    if(stash->blocks == NULL  && errno == ENOMEM){
+
+    stash->size = stashSize;
+    stash->padded = (stashSize + DSTASH_LANES - 1) / DSTASH_LANES * DSTASH_LANES;
+    stash->it = 0;
+
+    stash->blknos = (int*) malloc(sizeof(int)*stash->padded);
+    stash->blocks = (PLBList) malloc(sizeof(PLBlock)*stash->padded);
+
+    if((stash->blknos == NULL || stash->blocks == NULL) && errno == ENOMEM){
         logger(OUT_OF_MEMORY, "Out of memory allocating stash array");
         errno = save_errno;
         abort();
     }
-    for(i = 0; i < stashSize; i++){
-       
 
-        stash->blocks[i] = (PLBlock) malloc(sizeof(struct PLBlock));
-
-        if(stash->blocks[i] == NULL && errno == ENOMEM){
-            logger(OUT_OF_MEMORY, "Out of memory allocating stash array");
-            errno = save_errno;
-            abort();
-        }
-        memset(stash->blocks[i], 0, sizeof(struct PLBlock));
-        stash->blocks[i]->blkno = DUMMY_BLOCK;
+    for(i = 0; i < stash->padded; i++){
+        stash->blknos[i] = i < stashSize ? DUMMY_BLOCK : PADDING_BLOCK;
+        stash->blocks[i] = NULL;
     }
 
-    
     errno = save_errno;
-    
-    stash->size = stashSize; 
 
 	return stash;
 }
 
+/*
+ * Folds the slots found by each lane of a vector scan into the last one.
+ */
+static inline void
+reduceLanes(const int *lmatch, const int *lfree, unsigned int nlanes,
+			int *match, int *freeSlot)
+{
+	unsigned int lane;
+
+	for (lane = 0; lane < nlanes; lane++)
+	{
+		*match = lmatch[lane] > *match ? lmatch[lane] : *match;
+		*freeSlot = lfree[lane] > *freeSlot ? lfree[lane] : *freeSlot;
+	}
+}
+
+#if !defined(__SSE2__)
+
+static void
+scanSlotsPortable(const int *blknos, unsigned int nslots, int blkno,
+				  int *match, int *freeSlot)
+{
+	unsigned int offset;
+	int			rmatch = -1;
+	int			rfree = -1;
+	int			mask;
+
+	for (offset = 0; offset < nslots; offset++)
+	{
+		/* Blends the slot in with masks, see oblivious.h */
+		mask = 0 - (int) (blknos[offset] == blkno);
+		OBLIVIOUS_BARRIER(mask);
+		rmatch = (rmatch & ~mask) | ((int) offset & mask);
+
+		mask = 0 - (int) (blknos[offset] == DUMMY_BLOCK);
+		OBLIVIOUS_BARRIER(mask);
+		rfree = (rfree & ~mask) | ((int) offset & mask);
+	}
+
+	*match = rmatch;
+	*freeSlot = rfree;
+}
+
+#else
+
+/*
+ * SSE2 has no 32-bit max or blend. As the indexes only increase, a slot
+ * found replaces the previous one, which is a blend built from masks.
+ */
+static void
+scanSlotsSSE2(const int *blknos, unsigned int nslots, int blkno,
+			  int *match, int *freeSlot)
+{
+	int			lmatch[4];
+	int			lfree[4];
+	unsigned int offset;
+	__m128i		target = _mm_set1_epi32(blkno);
+	__m128i		dummy = _mm_set1_epi32(DUMMY_BLOCK);
+	__m128i		none = _mm_set1_epi32(-1);
+	__m128i		step = _mm_set1_epi32(4);
+	__m128i		idx = _mm_setr_epi32(0, 1, 2, 3);
+	__m128i		vmatch = none;
+	__m128i		vfree = none;
+	__m128i		slots;
+	__m128i		mask;
+
+	for (offset = 0; offset < nslots; offset += 4)
+	{
+		slots = _mm_loadu_si128((const __m128i *) &blknos[offset]);
+
+		mask = _mm_cmpeq_epi32(slots, target);
+		vmatch = _mm_or_si128(_mm_and_si128(mask, idx), _mm_andnot_si128(mask, vmatch));
+
+		mask = _mm_cmpeq_epi32(slots, dummy);
+		vfree = _mm_or_si128(_mm_and_si128(mask, idx), _mm_andnot_si128(mask, vfree));
+
+		idx = _mm_add_epi32(idx, step);
+	}
+
+	_mm_storeu_si128((__m128i *) lmatch, vmatch);
+	_mm_storeu_si128((__m128i *) lfree, vfree);
+
+	*match = -1;
+	*freeSlot = -1;
+	reduceLanes(lmatch, lfree, 4, match, freeSlot);
+}
+
+#endif
+
+#ifdef HAVE_AVX2
+
+__attribute__((target("avx2")))
+static void
+scanSlotsAVX2(const int *blknos, unsigned int nslots, int blkno,
+			  int *match, int *freeSlot)
+{
+	int			lmatch[DSTASH_LANES];
+	int			lfree[DSTASH_LANES];
+	unsigned int offset;
+	__m256i		target = _mm256_set1_epi32(blkno);
+	__m256i		dummy = _mm256_set1_epi32(DUMMY_BLOCK);
+	__m256i		none = _mm256_set1_epi32(-1);
+	__m256i		step = _mm256_set1_epi32(DSTASH_LANES);
+	__m256i		idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	__m256i		vmatch = none;
+	__m256i		vfree = none;
+	__m256i		slots;
+
+	for (offset = 0; offset < nslots; offset += DSTASH_LANES)
+	{
+		slots = _mm256_loadu_si256((const __m256i *) &blknos[offset]);
+		vmatch = _mm256_max_epi32(vmatch,
+                                  _mm256_blendv_epi8(none, idx, _mm256_cmpeq_epi32(slots, target)));
+		vfree = _mm256_max_epi32(vfree,
+                                 _mm256_blendv_epi8(none, idx, _mm256_cmpeq_epi32(slots, dummy)));
+		idx = _mm256_add_epi32(idx, step);
+	}
+
+	_mm256_storeu_si256((__m256i *) lmatch, vmatch);
+	_mm256_storeu_si256((__m256i *) lfree, vfree);
+
+	*match = -1;
+	*freeSlot = -1;
+	reduceLanes(lmatch, lfree, DSTASH_LANES, match, freeSlot);
+}
+
+#endif
+
+/*
+ * Scans every slot and returns in match the slot of blkno, or -1 if it is not
+ * stashed, and in freeSlot the last free slot, or -1 if the stash is full.
+ */
+void
+scanSlots(Stash stash, int blkno, int *match, int *freeSlot)
+{
+#ifdef HAVE_AVX2
+	if (hasAVX2())
+	{
+		scanSlotsAVX2(stash->blknos, stash->padded, blkno, match, freeSlot);
+		return;
+	}
+#endif
+#if defined(__SSE2__)
+	scanSlotsSSE2(stash->blknos, stash->padded, blkno, match, freeSlot);
+#else
+	scanSlotsPortable(stash->blknos, stash->padded, blkno, match, freeSlot);
+#endif
+}
+
 void stashPrint(Stash stash){
 
-    int offset;
+    unsigned int offset;
     PLBlock aux;
-    int real = 0; 
+    int real = 0;
     for(offset = 0; offset < stash->size; offset++){
-        aux = stash->blocks[offset];
 
-        if(aux->blkno == DUMMY_BLOCK){
+        if(stash->blknos[offset] == DUMMY_BLOCK){
             logger(DEBUG, "Stash block at offset %d is dummy\n", offset);
         }else{
+            aux = stash->blocks[offset];
             real +=1;
             logger(DEBUG, "Stash block at offset %d has blkno %d and data %s\n", offset, aux->blkno, aux->block);
         }
@@ -144,20 +323,18 @@ void
 stashGet(Stash stash, PLBlock block, BlockNumber pl_blkno, const char *filename, void *appData)
 {
 	PLBlock		aux;
-	int         offset;
-
-
-    for(offset = 0; offset < stash->size; offset++){
-        aux = stash->blocks[offset];
-
-        if((unsigned int) aux->blkno == pl_blkno){
-            block->blkno = aux->blkno;
-			block->size = aux->size;
-            //block->lsize = aux->lsize;
-			block->block = malloc(aux->size);
-			memcpy(block->block, aux->block, aux->size);
-
-        }
+	int         match, freeSlot;
+
+    scanSlots(stash, (int) pl_blkno, &match, &freeSlot);
+
+    if(match >= 0){
+        aux = stash->blocks[match];
+        block->blkno = aux->blkno;
+        block->size = aux->size;
+        block->block = malloc(aux->size);
+        block->location[0] = aux->location[0];
+        block->location[1] = aux->location[1];
+        memcpy(block->block, aux->block, aux->size);
     }
 
 }
@@ -166,59 +343,42 @@ void
 stashAdd(Stash stash, const char *filename, const PLBlock block, void *appData)
 {
 
-	PLBlock		aux;
-	int         offset, inserted;
-    inserted = 0;
-    for(offset = 0; offset < stash->size; offset++)
-    {
-        aux = stash->blocks[offset];
-        if(!inserted && (unsigned int) aux->blkno == DUMMY_BLOCK){
-            memcpy(aux, block, sizeof(struct PLBlock));
-            free(block);
-            inserted = 1;
-            //break;
-        }
+	int         match, freeSlot;
+
+    scanSlots(stash, block->blkno, &match, &freeSlot);
+
+    if(freeSlot < 0){
+        logger(DEBUG, "No available space to add block %d out of %d", block->blkno, stash->size);
+        abort();
     }
 
+    stash->blknos[freeSlot] = block->blkno;
+    stash->blocks[freeSlot] = block;
+
 }
 
 int
 stashUpdate(Stash stash, const char *filename, const PLBlock block, void *appData)
-{	 
+{
 
-    int     offset, target;
-    int     found = 0;
-    PLBlock aux;
-    
-
-    target = -1;
-
-    //logger(DEBUG, "---------- Stash Update %d -------", block->blkno);
-
-    for(offset = 0; offset < stash->size; offset++){ 
-        aux = stash->blocks[offset];
-        //logger(DEBUG, "stash offset %d has block %d", offset, aux->blkno);
-        if(!found && (unsigned int) aux->blkno == block->blkno){
-            free(aux->block);
-            //free(aux->location);
-            target = offset;
-            found =1;
-            //break;
-        }else if(!found && aux->blkno == DUMMY_BLOCK){
-            target = offset;
-        }
+    int     match, freeSlot;
+
+    scanSlots(stash, block->blkno, &match, &freeSlot);
+
+    if(match >= 0){
+        freeBlock(stash->blocks[match]);
+        stash->blocks[match] = block;
+        return 1;
     }
 
-    aux = stash->blocks[target];
-    
-    if(target == -1){
+    if(freeSlot < 0){
         logger(DEBUG, "No available space to write or update out of %d", stash->size);
         abort();
     }
 
-    memcpy(aux, block, sizeof(struct PLBlock));
-    free(block);
-    return found;
+    stash->blknos[freeSlot] = block->blkno;
+    stash->blocks[freeSlot] = block;
+    return 0;
 
 }
 
@@ -226,21 +386,13 @@ void
 stashRemove(Stash stash, const char *filename, const PLBlock block, void *appData)
 {
 
-	PLBlock	aux;
-	int     offset;
+	int     match, freeSlot;
 
-    for(offset = 0; offset < stash->size; offset++){
-        
-        aux = stash->blocks[offset];
-        
-        if((unsigned int) aux->blkno == block->blkno)
-        {
-           stash->blocks[offset] = (PLBlock) malloc(sizeof(struct PLBlock));
-           memset(stash->blocks[offset], 0, sizeof(struct PLBlock));
-           stash->blocks[offset]->blkno = DUMMY_BLOCK;
-           //break;
-        }
+    scanSlots(stash, block->blkno, &match, &freeSlot);
 
+    if(match >= 0){
+        stash->blknos[match] = DUMMY_BLOCK;
+        stash->blocks[match] = NULL;
     }
 }
 
@@ -248,41 +400,33 @@ int
 stashTake(Stash stash, const char *filename, unsigned int blkno, void *appData)
 {
 
-	PLBlock		aux;
-	int         offset, found = 0;
+	int     match, freeSlot;
 
-    for(offset = 0; offset < stash->size; offset++){
-        
-        aux = stash->blocks[offset];
-        
-        if((unsigned int) aux->blkno == blkno)
-        {
-            free(aux->block);
-            //free(aux->location);
-            memset(aux, 0 , sizeof(struct PLBlock));
-            aux->blkno = DUMMY_BLOCK;
-            found = 1;
-            //break;
-        }
+    scanSlots(stash, (int) blkno, &match, &freeSlot);
 
+    if(match < 0){
+        return 0;
     }
-    return found;
+
+    freeBlock(stash->blocks[match]);
+    stash->blknos[match] = DUMMY_BLOCK;
+    stash->blocks[match] = NULL;
+    return 1;
 }
 
-void    
+void
 stashClose(Stash stash, const char *filename, void *appData)
 {
 
-
-	struct PLBlock		aux;
-    int offset;
+    unsigned int offset;
 
     for(offset=0; offset < stash->size; offset++){
-        //free(stash->blocks[offset]->location);
-        free(stash->blocks[offset]->block);
-        free(stash->blocks[offset]);
+        if(stash->blknos[offset] != DUMMY_BLOCK){
+            freeBlock(stash->blocks[offset]);
+        }
     }
 
+    free(stash->blknos);
     free(stash->blocks);
     free(stash);
 }
@@ -297,25 +441,22 @@ stashStartIt(Stash stash, const char *filename, void *appData)
 unsigned int
 stashNext(Stash stash, const char *filename, PLBlock *block, void *appData)
 {
-    int offset;
-    int onlyDummys = 1;
-    PLBlock aux;
-     
+    unsigned int offset;
+
     for(offset=stash->it; offset < stash->size; offset++){
-        aux = stash->blocks[offset];
-        if(aux->blkno != DUMMY_BLOCK){
-            onlyDummys = false;
+        if(stash->blknos[offset] != DUMMY_BLOCK){
             break;
         }
     }
 
-    stash->it = offset +1;
-    if(onlyDummys){
+    if(offset >= stash->size){
+        stash->it = stash->size;
         return 0;
-    }else{
-        *block = stash->blocks[offset];
-        return 1;
-    }    
+    }
+
+    stash->it = offset + 1;
+    *block = stash->blocks[offset];
+    return 1;
 }
 
 void
@@ -0,0 +1,405 @@
+/*-------------------------------------------------------------------------
+ *
+ * hstash.c
+ *      In-memory implementation of a stash indexed by block number.
+ *
+ * The stashed blocks are kept by reference in a dense array, which is what
+ * the stash iterator walks, and an open addressing hash table with linear
+ * probing maps each block number to its position in the array. Lookups,
+ * updates and removals take constant expected time instead of a walk over the
+ * stash. A removed block is replaced by the last block of the array, so the
+ * iteration order is not the insertion order and the stash must not be
+ * modified while it is being iterated.
+ *
+ * The table is kept at most half full and both the table and the array grow
+ * on demand, the stashSize given to stashInit being only a hint. Like
+ * stash.c, this implementation assumes that only a single file is accessed
+ * obliviously and ignores the filename.
+ *
+ * Copyright (c) 2018-2020, HASLab
+ *
+ * IDENTIFICATION
+ *        backend/stash/hstash.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "oram/stash.h"
+#include "oram/logger.h"
+
+/* Entry of the hash table that is not in use */
+#define EMPTY_ENTRY ((unsigned int) -1)
+
+/* Minimum number of blocks the stash is sized for */
+#define HSTASH_MIN_SIZE 8
+
+typedef struct HEntry
+{
+	BlockNumber blkno;
+	unsigned int index;
+	/* Position of the block in the dense array or EMPTY_ENTRY */
+} HEntry;
+
+struct Stash
+{
+	PLBList		blocks;
+	unsigned int nblocks;
+	unsigned int capacity;
+	/* Dense array of the stashed blocks */
+
+	HEntry	   *table;
+	unsigned int mask;
+	/* Hash table of 2^n entries, mask is 2^n - 1 */
+
+	unsigned int it;
+};
+
+
+/* non-export function prototypes */
+static Stash stashInit(const char *filename, const unsigned int stashSize, const unsigned int blockSize, void *appData);
+
+static void stashAdd(Stash stash, const char *filename, const PLBlock block, void *appData);
+
+static int stashUpdate(Stash stash, const char *filename, const PLBlock block, void *appData);
+
+static void stashGet(Stash stash, PLBlock block, BlockNumber pl_blkno, const char *filename, void *appData);
+
+static void stashRemove(Stash stash, const char *filename, const PLBlock block, void *appData);
+
+int	stashTake(Stash stash, const char *filename, unsigned int blkno, void *appData);
+
+
+static void stashClose(Stash stash, const char *filename, void *appData);
+
+static void stashStartIt(Stash stash, const char *filename, void *appData);
+
+static unsigned int stashNext(Stash stash, const char *filename, PLBlock *block, void *appData);
+
+static void stashCloseIt(Stash stash, const char *filename, void *appData);
+
+static void *allocStash(void *ptr, size_t size);
+
+static void resizeTable(Stash stash, unsigned int nentries);
+
+static unsigned int findEntry(Stash stash, BlockNumber blkno);
+
+static void deleteBlock(Stash stash, unsigned int entry);
+
+
+AMStash *
+stashCreate(void)
+{
+	AMStash    *stash = (AMStash *) malloc(sizeof(AMStash));
+
+	stash->stashinit = &stashInit;
+	stash->stashget = &stashGet;
+	stash->stashadd = &stashAdd;
+	stash->stashupdate = &stashUpdate;
+	stash->stashremove = &stashRemove;
+	stash->stashtake = &stashTake;
+	stash->stashclose = &stashClose;
+
+	stash->stashstartIt = &stashStartIt;
+	stash->stashnext = &stashNext;
+	stash->stashcloseIt = &stashCloseIt;
+
+	return stash;
+}
+
+void *
+allocStash(void *ptr, size_t size)
+{
+	void	   *result;
+	int			save_errno = errno;
+
+	errno = 0;
+	result = realloc(ptr, size);
+
+	if (result == NULL && errno == ENOMEM)
+	{
+		logger(OUT_OF_MEMORY, "Out of memory allocating hash stash");
+		errno = save_errno;
+		abort();
+	}
+	errno = save_errno;
+
+	return result;
+}
+
+static inline unsigned int
+hashBlkno(Stash stash, BlockNumber blkno)
+{
+	/* Fibonacci hashing spreads consecutive block numbers over the table */
+	return ((unsigned int) blkno * 2654435761U) & stash->mask;
+}
+
+/*
+ * Rebuilds the hash table with nentries entries, a power of two.
+ */
+void
+resizeTable(Stash stash, unsigned int nentries)
+{
+	unsigned int index;
+	unsigned int entry;
+
+	free(stash->table);
+	stash->table = (HEntry *) allocStash(NULL, sizeof(HEntry) * nentries);
+	stash->mask = nentries - 1;
+
+	for (index = 0; index < nentries; index++)
+	{
+		stash->table[index].index = EMPTY_ENTRY;
+	}
+
+	for (index = 0; index < stash->nblocks; index++)
+	{
+		entry = hashBlkno(stash, stash->blocks[index]->blkno);
+		while (stash->table[entry].index != EMPTY_ENTRY)
+		{
+			entry = (entry + 1) & stash->mask;
+		}
+		stash->table[entry].blkno = stash->blocks[index]->blkno;
+		stash->table[entry].index = index;
+	}
+}
+
+/*
+ * Returns the entry of blkno in the hash table or EMPTY_ENTRY if the block is
+ * not in the stash.
+ */
+unsigned int
+findEntry(Stash stash, BlockNumber blkno)
+{
+	unsigned int entry = hashBlkno(stash, blkno);
+
+	while (stash->table[entry].index != EMPTY_ENTRY)
+	{
+		if (stash->table[entry].blkno == blkno)
+		{
+			return entry;
+		}
+		entry = (entry + 1) & stash->mask;
+	}
+
+	return EMPTY_ENTRY;
+}
+
+/*
+ * Removes the block of the given table entry from the stash. The last block
+ * of the dense array takes its place and the entries that follow in the
+ * probe sequence are shifted back, so that no tombstones are needed.
+ */
+void
+deleteBlock(Stash stash, unsigned int entry)
+{
+	unsigned int index = stash->table[entry].index;
+	unsigned int next;
+	unsigned int home;
+	unsigned int moved;
+
+	stash->nblocks--;
+	if (index != stash->nblocks)
+	{
+		stash->blocks[index] = stash->blocks[stash->nblocks];
+		moved = findEntry(stash, stash->blocks[index]->blkno);
+		stash->table[moved].index = index;
+	}
+
+	next = entry;
+	for (;;)
+	{
+		next = (next + 1) & stash->mask;
+		if (stash->table[next].index == EMPTY_ENTRY)
+		{
+			break;
+		}
+
+		/* Entries whose home is cyclically in (entry, next] stay */
+		home = hashBlkno(stash, stash->table[next].blkno);
+		if (((next - home) & stash->mask) < ((next - entry) & stash->mask))
+		{
+			continue;
+		}
+
+		stash->table[entry] = stash->table[next];
+		entry = next;
+	}
+
+	stash->table[entry].index = EMPTY_ENTRY;
+}
+
+Stash
+stashInit(const char *filename, const unsigned int stashSize, const unsigned int blockSize, void *appData)
+{
+	Stash		stash = (Stash) allocStash(NULL, sizeof(struct Stash));
+	unsigned int nentries = 2 * HSTASH_MIN_SIZE;
+
+	while (nentries < 2 * stashSize)
+	{
+		nentries <<= 1;
+	}
+
+	stash->nblocks = 0;
+	stash->capacity = nentries / 2;
+	stash->blocks = (PLBList) allocStash(NULL, sizeof(PLBlock) * stash->capacity);
+	stash->table = NULL;
+	stash->it = 0;
+	resizeTable(stash, nentries);
+
+	return stash;
+}
+
+void
+stashGet(Stash stash, PLBlock block, BlockNumber pl_blkno, const char *filename, void *appData)
+{
+	unsigned int entry = findEntry(stash, pl_blkno);
+	PLBlock		aux;
+
+	if (entry == EMPTY_ENTRY)
+	{
+		return;
+	}
+
+	aux = stash->blocks[stash->table[entry].index];
+	block->blkno = aux->blkno;
+	block->size = aux->size;
+	block->block = malloc(aux->size);
+	block->location[0] = aux->location[0];
+	block->location[1] = aux->location[1];
+	memcpy(block->block, aux->block, aux->size);
+}
+
+void
+stashAdd(Stash stash, const char *filename, const PLBlock block, void *appData)
+{
+	unsigned int entry;
+
+	if (stash->nblocks == stash->capacity)
+	{
+		stash->capacity *= 2;
+		stash->blocks = (PLBList) allocStash(stash->blocks,
+                                             sizeof(PLBlock) * stash->capacity);
+		resizeTable(stash, 2 * (stash->mask + 1));
+	}
+
+	entry = hashBlkno(stash, block->blkno);
+	while (stash->table[entry].index != EMPTY_ENTRY)
+	{
+		entry = (entry + 1) & stash->mask;
+	}
+
+	stash->table[entry].blkno = block->blkno;
+	stash->table[entry].index = stash->nblocks;
+	stash->blocks[stash->nblocks] = block;
+	stash->nblocks++;
+}
+
+int
+stashUpdate(Stash stash, const char *filename, const PLBlock block, void *appData)
+{
+	unsigned int entry = findEntry(stash, block->blkno);
+	unsigned int index;
+
+	if (entry == EMPTY_ENTRY)
+	{
+		stashAdd(stash, filename, block, appData);
+		return 0;
+	}
+
+	/*
+	 * Replace the stashed block as a whole instead of moving the payload, as
+	 * pooled blocks must keep their own buffers.
+	 */
+	index = stash->table[entry].index;
+	freeBlock(stash->blocks[index]);
+	stash->blocks[index] = block;
+
+	return 1;
+}
+
+void
+stashRemove(Stash stash, const char *filename, const PLBlock block, void *appData)
+{
+	unsigned int entry = findEntry(stash, block->blkno);
+
+	if (entry != EMPTY_ENTRY)
+	{
+		deleteBlock(stash, entry);
+	}
+}
+
+int
+stashTake(Stash stash, const char *filename, unsigned int blkno, void *appData)
+{
+	unsigned int entry = findEntry(stash, (BlockNumber) blkno);
+	PLBlock		aux;
+
+	if (entry == EMPTY_ENTRY)
+	{
+		return 0;
+	}
+
+	aux = stash->blocks[stash->table[entry].index];
+	deleteBlock(stash, entry);
+	freeBlock(aux);
+
+	return 1;
+}
+
+void
+stashClose(Stash stash, const char *filename, void *appData)
+{
+	unsigned int index;
+
+	for (index = 0; index < stash->nblocks; index++)
+	{
+		freeBlock(stash->blocks[index]);
+	}
+
+	free(stash->blocks);
+	free(stash->table);
+	free(stash);
+}
+
+
+void
+stashStartIt(Stash stash, const char *filename, void *appData)
+{
+	stash->it = 0;
+}
+
+unsigned int
+stashNext(Stash stash, const char *filename, PLBlock *block, void *appData)
+{
+	if (stash->it == stash->nblocks)
+	{
+		return 0;
+	}
+
+	*block = stash->blocks[stash->it];
+	stash->it++;
+	return 1;
+}
+
+void
+stashCloseIt(Stash stash, const char *filename, void *appData)
+{
+	/* iterator = NULL; */
+}
+
+void stashPrint(Stash stash){
+
+	unsigned int index;
+
+	logger(DEBUG, "-----stash print--------\n");
+
+	for (index = 0; index < stash->nblocks; index++)
+	{
+		logger(DEBUG, "Stash has block blkno %d\n", stash->blocks[index]->blkno);
+	}
+
+}
@@ -129,14 +129,12 @@ stashUpdate(Stash stash, const char *filename, const PLBlock block, void *appDat
 		if ((unsigned int) aux->blkno == block->blkno)
 		{
 			found = 1;
-			free(aux->block);
-			aux->block = block->block;
-			aux->size = block->size;
-            aux->location[0] = block->location[0];
-            aux->location[1] = block->location[1];
-            //aux->location = block->location;
-            //aux->lsize = block->lsize;
-			free(block);
+			/*
+			 * Replace the stashed block as a whole instead of moving the
+			 * payload, as pooled blocks must keep their own buffers.
+			 */
+			list_iter_replace(&iter, block, NULL);
+			freeBlock(aux);
 			break;
 		}
 	}
@@ -163,11 +161,11 @@ stashRemove(Stash stash, const char *filename, const PLBlock block, void *appDat
         
 		if ((unsigned int) aux->blkno == block->blkno)
 		{
+			/* Blocks that are not stashed, e.g., dummies, are ignored */
+			list_remove(stash->list, aux, NULL);
 			break;
 		}
 	}
-
-	list_remove(stash->list, aux, NULL);
 }
 
 int
@@ -194,8 +192,7 @@ stashTake(Stash stash, const char *filename, unsigned int blkno, void *appData)
 	if (found)
 	{
 		list_remove(stash->list, aux, NULL);
-		free(aux->block);
-		free(aux);
+		freeBlock(aux);
 	}
 
 	return found;
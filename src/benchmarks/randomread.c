@@ -51,6 +51,9 @@ int test(size_t nblocks,
     char *data, *value = NULL;
 
     state = init_oram("teste", nblocks, blockSize, bucketCapcity, &amgr, NULL);
+#ifdef OFILE_EXT
+    setOFileExt(state, ofileExtCreate());
+#endif
 
     for (index = 0; index < nblocks; index++) {
         value = gen_random(blockSize);
@@ -0,0 +1,58 @@
+/*-------------------------------------------------------------------------
+ *
+ * aes.h
+ *	  AES-128 primitives used by the encrypting oblivious file.
+ *
+ * Blocks are encrypted with AES-NI when the processor supports it and with
+ * a portable implementation otherwise. Both produce the same output.
+ *
+ * Copyright (c) 2018-2020, HASLab
+ *
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef AES_H
+#define AES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define AES_BLOCK_SIZE 16
+#define AES_KEY_SIZE 16
+#define AES_ROUNDS 10
+
+typedef struct AESKey
+{
+	/* Expanded round keys, aligned for the AES-NI loads */
+	uint8_t		roundKeys[AES_ROUNDS + 1][AES_BLOCK_SIZE] __attribute__((aligned(16)));
+} AESKey;
+
+void		aesSetKey(AESKey *key, const uint8_t raw[AES_KEY_SIZE]);
+
+/*
+ * Encrypts nblocks independent 16-byte blocks from in to out. in and out may
+ * be the same buffer.
+ */
+void		aesEncryptBlocks(const AESKey *key, const uint8_t *in, uint8_t *out,
+                             size_t nblocks);
+
+/*
+ * XORs len bytes of data in place with the AES-CTR keystream of the given
+ * nonce, starting at block counter. Counter blocks are the 64-bit nonce
+ * followed by the 64-bit block counter, both little-endian. Encryption and
+ * decryption are the same operation.
+ */
+void		aesCtr(const AESKey *key, uint64_t nonce, uint64_t counter,
+                   uint8_t *data, size_t len);
+
+/*
+ * Absorbs nblocks 16-byte blocks of data into the AES-CBC-MAC chaining value
+ * mac, which starts as zeros. CBC-MAC is only secure for a set of messages
+ * where none is a prefix of another, e.g., messages that start with their
+ * length.
+ */
+void		aesCbcMac(const AESKey *key, uint8_t mac[AES_BLOCK_SIZE],
+                      const uint8_t *data, size_t nblocks);
+
+#endif							/* AES_H */
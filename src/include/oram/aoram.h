@@ -0,0 +1,79 @@
+/*-------------------------------------------------------------------------
+ *
+ * aoram.h
+ *	  prototypes for the asynchronous ORAM front-end of aoram.c.
+ *
+ *
+ * Copyright (c) 2018-2020, HASLab
+ *
+ * The ORAM state is not thread-safe: the stash iterator, the block pool and
+ * the buffers of the engines belong to a single caller. aoram.h lets several
+ * threads share a state without an external lock. Requests are pushed to a
+ * lock-free multi-producer queue and served, in submission order, by a
+ * worker thread that is the only one to call read_oram and write_oram on the
+ * state.
+ *
+ * The worker serves every request queued since its last pass at once. Each
+ * request is one ORAM access, whatever the blocks it shares with the rest of
+ * the pass, and the runs of consecutive reads or writes are served with
+ * read_oram_batch and write_oram_batch. Like any batch, a run reveals how
+ * many requests it holds, and hence where the pass switches between reads
+ * and writes, but not which blocks they target.
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef AORAM_H
+#define AORAM_H
+
+
+#include "oram/oram.h"
+
+/*
+ * Opaque asynchronous front-end of an ORAM state.
+ */
+typedef struct AORAMState *AORAMState;
+
+/*
+ * Opaque handle of a submitted request, valid until wait_aoram returns.
+ */
+typedef struct AORAMRequest *AORAMRequest;
+
+
+/*
+ * Starts the worker thread that serves the requests for state. appData is
+ * given to every ORAM operation of the worker. The caller keeps ownership of
+ * state and must not use it directly until close_aoram returns.
+ */
+AORAMState	init_aoram(ORAMState state, void *appData);
+
+/*
+ * Queues a read of blkno, following the semantics of read_oram.
+ */
+AORAMRequest submit_read_aoram(AORAMState astate, BlockNumber blkno);
+
+/*
+ * Queues a write of blksize bytes of data to blkno, following the semantics
+ * of write_oram. data is copied and can be reused as soon as the function
+ * returns.
+ */
+AORAMRequest submit_write_aoram(AORAMState astate, char *data, unsigned int blksize, BlockNumber blkno);
+
+/*
+ * Returns 1 if the request has been served and 0 otherwise, without blocking.
+ */
+int			poll_aoram(AORAMRequest request);
+
+/*
+ * Waits until the request is served, releases it and returns the result of
+ * read_oram or write_oram. For reads, the block is returned in ptr as
+ * read_oram does; ptr may be NULL for writes.
+ */
+int			wait_aoram(AORAMRequest request, char **ptr);
+
+/*
+ * Serves the requests still queued, stops the worker thread and releases
+ * the front-end. The ORAM state is not closed.
+ */
+void		close_aoram(AORAMState astate);
+
+#endif							/* AORAM_H */
@@ -15,4 +15,39 @@
 
 typedef unsigned int BlockNumber;
 
+/*
+ * Returns the deepest level of a tree of the given height shared by the paths
+ * to the leaves s_leaf and a_leaf, which is the deepest level where a block
+ * mapped to s_leaf can be placed when evicting along a_leaf.
+ *
+ * Two paths share every level until the first bit, starting from the most
+ * significant one, in which the leaves differ. The number of levels below the
+ * lowest common node is the position of the most significant bit set in
+ * s_leaf ^ a_leaf.
+ */
+static inline unsigned int
+getDeepestLevel(unsigned int height, unsigned int s_leaf, unsigned int a_leaf)
+{
+	unsigned int diff = s_leaf ^ a_leaf;
+
+	if (diff == 0)
+	{
+		return height;
+	}
+#if defined(__GNUC__) || defined(__clang__)
+	return height - (sizeof(unsigned int) * 8 - __builtin_clz(diff));
+#else
+	{
+		unsigned int bits = 0;
+
+		while (diff > 0)
+		{
+			diff >>= 1;
+			bits++;
+		}
+		return height - bits;
+	}
+#endif
+}
+
 #endif						
@@ -22,4 +22,20 @@
 
 void setToken(ORAMState state, const unsigned int* token);
 
+/*
+ * Hands over ntokens tokens at once, e.g., for a batched access. The tokens
+ * are queued and each of the following accesses, single or batched, takes
+ * the next one in order. A token set with setToken is used before the
+ * queued ones. Requires a position map extension with pmstokens, see
+ * setPMapExt.
+ */
+void setTokens(ORAMState state, const unsigned int* tokens, unsigned int ntokens);
+
+/*
+ * Enables the optional operations of the position map, e.g., the ext
+ * returned by pmapExtCreate of the position map in am_pmap. The state takes
+ * ownership of ext, released by close_oram as the access managers are.
+ */
+void setPMapExt(ORAMState state, AMPMapExt *ext);
+
 #endif						
@@ -0,0 +1,86 @@
+/*-------------------------------------------------------------------------
+ *
+ * diskformat.h
+ *	  Record format shared by the oblivious files in backend/ofile that store
+ *	  the slots as fixed size records (diskfile.c, uringfile.c and
+ *	  mmapfile.c).
+ *
+ * A record is a DiskHeader followed by blockSize bytes of payload, in host
+ * byte order. The header keeps blkno + 1, so that a record that was never
+ * written, which reads as zeros, is a dummy block.
+ *
+ * The files stored in the file system are created in the current directory
+ * with the name given to ofileinit between DISKFILE_PREFIX and
+ * DISKFILE_SUFFIX.
+ *
+ * Copyright (c) 2018-2020, HASLab
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef DISKFORMAT_H
+#define DISKFORMAT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "oram/plblock.h"
+
+#ifndef DISKFILE_PREFIX
+#define DISKFILE_PREFIX ""
+#endif
+
+#ifndef DISKFILE_SUFFIX
+#define DISKFILE_SUFFIX ".oram"
+#endif
+
+/* Alignment of the records, offsets and buffers used with O_DIRECT */
+#ifndef DISKFILE_ALIGNMENT
+#define DISKFILE_ALIGNMENT 4096
+#endif
+
+typedef struct DiskHeader
+{
+	int32_t		blkno;
+	/* blkno + 1 of the stored block, 0 for a dummy block */
+	int32_t		size;
+	uint32_t	location[2];
+} DiskHeader;
+
+static inline void
+encodeDiskHeader(DiskHeader *header, const PLBlock block)
+{
+	header->blkno = block->blkno + 1;
+	header->size = block->size;
+	header->location[0] = block->location[0];
+	header->location[1] = block->location[1];
+}
+
+/*
+ * Fills the block number, size and location of block. The size of a dummy
+ * block is blockSize, whatever the header holds.
+ */
+static inline void
+decodeDiskHeader(PLBlock block, const DiskHeader *header, unsigned int blockSize)
+{
+	block->blkno = header->blkno - 1;
+	block->size = header->blkno == 0 ? (int) blockSize : header->size;
+	block->location[0] = header->location[0];
+	block->location[1] = header->location[1];
+}
+
+/* Size of the buffer that holds the name of the file of filename */
+static inline size_t
+diskFilePathSize(const char *filename)
+{
+	return strlen(DISKFILE_PREFIX) + strlen(filename) + strlen(DISKFILE_SUFFIX) + 1;
+}
+
+static inline void
+formatDiskFilePath(char *path, size_t size, const char *filename)
+{
+	snprintf(path, size, "%s%s%s", DISKFILE_PREFIX, filename, DISKFILE_SUFFIX);
+}
+
+#endif							/* DISKFORMAT_H */
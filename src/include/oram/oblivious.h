@@ -0,0 +1,56 @@
+/*-------------------------------------------------------------------------
+ *
+ * oblivious.h
+ *	  Helpers shared by the oblivious scans of opmap.c, ofpmap.c and
+ *	  dstash.c.
+ *
+ * HAVE_AVX2 is defined when the compiler can build the AVX2 scans, which are
+ * only used if hasAVX2 reports that the processor supports them.
+ *
+ * The portable scans select an entry with masks computed from comparisons
+ * instead of branches. Nothing stops a compiler from turning such a mask
+ * back into a branch on the comparison, so OBLIVIOUS_BARRIER hides the value
+ * of a mask from the optimiser, which then has to use it as an opaque value
+ * instead of knowing whether it is zero.
+ *
+ * Copyright (c) 2018-2020, HASLab
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef OBLIVIOUS_H
+#define OBLIVIOUS_H
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define HAVE_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define OBLIVIOUS_BARRIER(value) __asm__ volatile("" : "+r"(value))
+#else
+#define OBLIVIOUS_BARRIER(value) ((void) 0)
+#endif
+
+#ifdef HAVE_AVX2
+
+/*
+ * Returns whether the AVX2 scans are used. The processor is only queried
+ * once.
+ */
+static inline int
+hasAVX2(void)
+{
+	static int	supported = -1;
+
+	if (supported < 0)
+	{
+		__builtin_cpu_init();
+		supported = __builtin_cpu_supports("avx2") ? 1 : 0;
+	}
+	return supported;
+}
+
+#endif
+
+#endif							/* OBLIVIOUS_H */
@@ -24,6 +24,16 @@ typedef FileHandler (*ofileinit_function) (const char *fileName,
                                            unsigned int locationSize,
                                            void *appData);
 
+/*
+ * Reads the block stored at ob_blkno. The implementation allocates the
+ * payload buffer with malloc and the caller frees it.
+ *
+ * Files handed to setOFileExt with an AMOFileExt also accept a block whose
+ * block->block is not NULL. It points to a buffer with room for blockSize
+ * bytes where the payload is copied instead, which lets the ORAM engines
+ * read straight into their pooled blocks. The oblivious files in
+ * backend/ofile follow both contracts.
+ */
 typedef void (*ofileread_function) (FileHandler handler, 
                                     PLBlock block, 
                                     const char *fileName, 
@@ -34,6 +44,33 @@ typedef void (*ofilewrite_function) (FileHandler handler,
                                      const char *fileName, 
                                      const BlockNumber ob_blkno, void *appData);
 
+/*
+ * Reads the nblocks blocks stored at ob_blknos[0..nblocks-1] into
+ * blocks[0..nblocks-1] in a single call, following the semantics of
+ * ofileread for each block. ORAM constructions use it to fetch all of the
+ * slots of a path that are not cached in client memory at once, so that
+ * implementations that cross a boundary (e.g., enclave OCALLs or system calls)
+ * do it once per path instead of once per block.
+ *
+ * Part of AMOFileExt. ORAM constructions without it call ofileread for each
+ * block.
+ */
+typedef void (*ofilereadpath_function) (FileHandler handler,
+                                        PLBList blocks,
+                                        const char *fileName,
+                                        const BlockNumber *ob_blknos,
+                                        unsigned int nblocks, void *appData);
+
+/*
+ * Writes blocks[0..nblocks-1] to ob_blknos[0..nblocks-1] in a single call.
+ * Part of AMOFileExt, without it ofilewrite is called for each block.
+ */
+typedef void (*ofilewritepath_function) (FileHandler handler,
+                                         const PLBList blocks,
+                                         const char *fileName,
+                                         const BlockNumber *ob_blknos,
+                                         unsigned int nblocks, void *appData);
+
 typedef void (*ofileclose_function) (FileHandler, 
                                      const char *fileName, void *appData);
 
@@ -45,6 +82,39 @@ typedef struct AMOFile
 	ofileclose_function ofileclose;
 } AMOFile;
 
+/*
+ * Optional operations of an oblivious file. They are kept out of AMOFile so
+ * that implementations written for its four functions, which applications
+ * often allocate with malloc and fill in, keep working unchanged. An
+ * application opts in by handing an AMOFileExt to setOFileExt (see oram.h)
+ * after init_oram, which also declares that ofileread copies into a given
+ * payload buffer. A NULL function falls back to the AMOFile ones.
+ */
+typedef struct AMOFileExt
+{
+	ofilereadpath_function ofilereadpath;
+	ofilewritepath_function ofilewritepath;
+} AMOFileExt;
+
+/*
+ * Oblivious files that are wrapped by another implementation, e.g., the
+ * encrypting file of encfile.c, are compiled with ENCFILE and export their
+ * constructor as innerOFileCreate, which the wrapper calls from its own
+ * ofileCreate.
+ */
+#ifdef ENCFILE
+#define OFILE_CREATE innerOFileCreate
+#define OFILE_EXT_CREATE innerOFileExtCreate
+#else
+#define OFILE_CREATE ofileCreate
+#define OFILE_EXT_CREATE ofileExtCreate
+#endif
+
 AMOFile    *ofileCreate(void);
+AMOFile    *innerOFileCreate(void);
+
+/* Optional operations of the oblivious files in backend/ofile */
+AMOFileExt *ofileExtCreate(void);
+AMOFileExt *innerOFileExtCreate(void);
 
 #endif							/* OFILE_H*/
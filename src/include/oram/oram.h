@@ -59,6 +59,9 @@ typedef struct Amgr
  * size_t bucketCapcity - Number of buckets in an ORAM Tree node.
  * Amgr amgr - Access manager functions to store data.
  *
+ * Circuit ORAM requires a bucketCapacity of at least 2 and aborts otherwise:
+ * with a single slot per bucket its two evictions per access do not keep up
+ * with the blocks added to the stash.
  */
 
 ORAMState	init_oram(const char *file, unsigned int nblocks, unsigned int blockSize, unsigned int bucketCapacity, Amgr *amgr, void *appData);
@@ -78,6 +81,40 @@ int			read_oram(char **ptr, BlockNumber blkno, ORAMState state, void *appdata);
  */
 int			write_oram(char *data, unsigned int blksize, BlockNumber blkno, ORAMState state, void *appData);
 
+/**
+ * Batched ORAM read of nrequests blocks. The i-th requested block is returned
+ * in ptrs[i] and the result of the request (block size or DUMMY_BLOCK) in
+ * results[i], following the semantics of read_oram.
+ *
+ * Implementations may serve several requests at once by fetching the union
+ * of the tree paths of the requested blocks and evicting along the same paths
+ * in a single pass. Path ORAM serves a batch in passes of at most
+ * BATCH_PASS_SIZE requests. Its first batch recreates the stash with room
+ * for the paths of a pass, so the size given to stashinit is all a stash with
+ * a fixed capacity has to hold. Returns the number of requests served.
+ */
+int			read_oram_batch(char **ptrs, int *results, const BlockNumber *blknos, unsigned int nrequests, ORAMState state, void *appData);
+
+/**
+ * Batched ORAM write of nrequests blocks. The i-th request writes blkSizes[i]
+ * bytes of data[i] to block blknos[i] and results[i] gets what write_oram
+ * returns for it. Requests are applied in order, so if the same block is
+ * written more than once the last write prevails.
+ * Returns the number of requests served.
+ */
+int			write_oram_batch(char **data, const unsigned int *blkSizes, int *results, const BlockNumber *blknos, unsigned int nrequests, ORAMState state, void *appData);
+
+
+/**
+ * Enables the optional operations of the oblivious file, e.g., the ext
+ * returned by ofileExtCreate of the file in am_ofile. Until then, or if ext
+ * is NULL, paths are read and written one block at a time and every payload
+ * read is malloc'ed by ofileread, see ofile.h. The state takes ownership of
+ * ext, released by close_oram as the access managers are. Ring and Circuit
+ * ORAM access single slots and only use it to read into their own buffers.
+ */
+void		setOFileExt(ORAMState state, AMOFileExt *ext);
+
 
 /**
  * Close request that correctly closes all of the ORAM resourceS:
@@ -13,7 +13,12 @@
 #ifndef ORANDOM_H
 #define ORANDOM_H
 
+#include <stddef.h>
+
 unsigned int getRandomInt(void);
 
+/* Fills values with n random integers, cheaper than n calls to getRandomInt */
+void getRandomInts(unsigned int *values, size_t n);
+
 #endif							/* ORANDOM_H*/
 
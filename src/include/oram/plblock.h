@@ -33,6 +33,8 @@
  * the second position is ignored. While not the most elegant solution,
  * it simplifies the integration with other projects.
  **/
+typedef struct BlockPool *BlockPool;
+
 typedef struct PLBlock
 {
     
@@ -41,11 +43,40 @@ typedef struct PLBlock
     int             size;
     unsigned int    location[2];
 	void*           block;
+    /*
+     * Pool that owns the block or NULL if it was individually allocated.
+     * Set by the constructors below and only read by freeBlock.
+     */
+    BlockPool       pool;
 
 }		   *PLBlock;
 
 typedef PLBlock *PLBList;
 
+/*
+ * A block pool preallocates block headers together with a payload buffer of
+ * blockSize bytes each and recycles them, so that the blocks an ORAM access
+ * reads, stashes and evicts do not go through the heap. A pool grows if it
+ * runs out of blocks and keeps the memory until it is freed.
+ *
+ * Pooled blocks are returned to their pool by freeBlock. A pooled block must
+ * keep its own payload buffer, as the pool reuses the pair.
+ *
+ * Blocks must be created with one of the constructors below, createBlock and
+ * createEmptyBlock outside of the ORAM engines, and released with freeBlock,
+ * never with free(). A PLBlock allocated by other means has an undefined pool
+ * and freeBlock would hand it to an unrelated pool. checkBlock aborts on
+ * blocks that belong neither to pool nor to the heap, and is used by the
+ * engines on the blocks returned by stash implementations.
+ */
+BlockPool   createBlockPool(unsigned int nblocks, unsigned int blockSize);
+
+PLBlock     createPooledBlock(BlockPool pool, int blkno, int size, void *block);
+
+PLBlock     createEmptyPooledBlock(BlockPool pool);
+
+void        freeBlockPool(BlockPool pool);
+
 PLBlock		createBlock(int blkno, int size, void *block);
 
 PLBlock		createEmptyBlock(void);
@@ -58,6 +89,18 @@ void        setLocation(PLBlock block, Location location, unsigned int size);
 
 void		freeBlock(PLBlock block);
 
+/*
+ * The ORAM engines read into pooled blocks, whose payload buffer must not be
+ * replaced. Unless the oblivious file opts in to copying into the buffer
+ * through an AMOFileExt, they wrap ofileread with detachPayload and
+ * attachPayload, which copies and frees the payload malloc'ed by the file.
+ */
+void	   *detachPayload(PLBlock block);
+
+void		attachPayload(PLBlock block, void *payload);
+
+void		checkBlock(PLBlock block, BlockPool pool);
+
 void        freeDummyBlock();
 
 #endif							/* PLBLOCK_H */
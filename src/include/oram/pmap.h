@@ -31,6 +31,9 @@ typedef void (*pmclose_function) (PMap pmap, const char *fileName);
 
 typedef void (*pmsettoken_function) (PMap pmap, const unsigned int* token);
 
+/* Queues ntokens tokens, consumed in order by the following accesses */
+typedef void (*pmsettokens_function) (PMap pmap, const unsigned int* tokens, unsigned int ntokens);
+
 
 /*Access manager to position map*/
 typedef struct AMPMap
@@ -42,6 +45,19 @@ typedef struct AMPMap
     pmsettoken_function pmstoken;
 } AMPMap;
 
+/*
+ * Optional operations of a position map, kept out of AMPMap so that position
+ * maps written for its functions keep working unchanged. An application opts
+ * in by handing an AMPMapExt to setPMapExt (see coram.h) after init_oram.
+ */
+typedef struct AMPMapExt
+{
+	pmsettokens_function pmstokens;
+} AMPMapExt;
+
 AMPMap	   *pmapCreate(void);
 
+/* Optional operations of the token position maps, tpmap.c and tfpmap.c */
+AMPMapExt  *pmapExtCreate(void);
+
 #endif							/* OFILE_H*/
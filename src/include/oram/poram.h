@@ -0,0 +1,47 @@
+/*-------------------------------------------------------------------------
+ *
+ * poram.h
+ *	  prototypes for the split read/evict interface of pathoram.c.
+ *
+ *
+ * Copyright (c) 2018-2020, HASLab
+ *
+ * poram.h is an extension of the ORAM interface for Path ORAM, similar to
+ * foram.h for Forest ORAM.
+ *
+ * read_poram fetches the path of the requested block, moves it to the stash,
+ * maps the block to a new leaf and returns it. The path is only written back
+ * when evict_poram is called for the same block, so the caller gets the block
+ * after half of the work of an access and can defer the eviction, e.g., until
+ * it releases the buffer of the block or to a background task.
+ *
+ * Several reads may be waiting for their eviction at the same time. The
+ * stash holds the blocks of every path read and not evicted yet, and a block
+ * read stays in the stash until its own eviction, so stash
+ * implementations with a fixed capacity bound the number of reads that can
+ * wait. read_oram and write_oram can be used while reads wait, but the
+ * batched functions of oram.h abort. Both functions must be called from the
+ * same thread or under the same lock, as the ORAM state is not thread-safe.
+ *
+ *-------------------------------------------------------------------------
+ */
+#ifndef PORAM_H
+#define PORAM_H
+
+
+#include "oram/oram.h"
+
+/*
+ * Reads block blkno, following the semantics of read_oram, without evicting
+ * the path that was read.
+ */
+int			read_poram(char **ptr, BlockNumber blkno, ORAMState state, void *appData);
+
+/*
+ * Evicts the path read by the last read_poram of blkno that has not been
+ * evicted yet. If blksize is not DUMMY_BLOCK, data is written to the block
+ * before the eviction, which completes a read-modify-write of the block.
+ */
+int			evict_poram(char *data, unsigned int blksize, BlockNumber blkno, ORAMState state, void *appData);
+
+#endif							/* PORAM_H */
@@ -39,6 +39,24 @@ typedef void (*stashcloseIt_function) (Stash stash, const char *filename, void *
 void stashPrint(Stash stash);
 
 
+/*
+ * Ownership of the blocks of a stash:
+ *
+ * - stashadd and stashupdate hand the block to the stash, which must keep
+ *   that same pointer. Blocks may come from the block pool of the ORAM (see
+ *   plblock.h), so the stash must not copy the header and free the original.
+ *   A stash with a fixed capacity that cannot hold a new block must abort
+ *   instead of dropping it.
+ * - stashupdate releases the block it replaces, and stashtake and stashclose
+ *   the blocks they drop, with freeBlock. Stashes never call free() on a
+ *   block or on its payload.
+ * - stashnext returns the stashed pointers, which stay owned by the stash
+ *   until stashremove hands them back to the ORAM without releasing them.
+ * - stashget copies the block into the given block with a payload allocated
+ *   with malloc, owned by the caller.
+ */
+
+
 /* Access manager to stash */
 typedef struct AMStash
 {
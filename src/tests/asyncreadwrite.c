@@ -0,0 +1,219 @@
+#include "oram/aoram.h"
+#include "oram/orandom.h"
+#include "oram/plblock.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NTHREADS 8
+#define MAX_INFLIGHT 4
+
+typedef struct Client
+{
+    AORAMState astate;
+    unsigned int id;
+    size_t nblocks;
+    size_t blockSize;
+    size_t nrounds;
+    char **strings;
+    int failed;
+} Client;
+
+char *gen_random(const int len) {
+    int i = 0;
+    char *s = (char *) malloc(sizeof(char) * len);
+
+    static const char alphanum[] =
+            "0123456789"
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+            "abcdefghijklmnopqrstuvwxyz";
+
+    for (i = 0; i < len - 1; ++i) {
+        s[i] = alphanum[getRandomInt() % (sizeof(alphanum) - 1)];
+    }
+
+    s[len - 1] = '\0';
+    return s;
+}
+
+
+int check(int result, char *data, char *expected) {
+    if (result == DUMMY_BLOCK) {
+        return expected != NULL;
+    }
+    return expected == NULL || result != strlen(data) + 1 || strcmp(data, expected) != 0;
+}
+
+
+/*
+ * Blocks in the first half of the file are written before the front-end is
+ * started and are only read, by every client. The second half is split among
+ * the clients, which read and write their own blocks.
+ */
+void *client(void *arg) {
+    Client *c = (Client *) arg;
+
+    size_t shared = c->nblocks / 2;
+    size_t nowned = (c->nblocks - shared) / NTHREADS;
+
+    int round = 0;
+    int index = 0;
+    int ninflight = 0;
+    int result = 0;
+    BlockNumber blkno;
+    char *data = NULL;
+    char *wdata = NULL;
+
+    AORAMRequest requests[MAX_INFLIGHT];
+    /* Expected block of a read or expected size of a write */
+    char *expected[MAX_INFLIGHT];
+    int wsizes[MAX_INFLIGHT];
+
+    for (round = 0; round < c->nrounds && !c->failed; round++) {
+
+        /* Several requests of a client are in flight at the same time */
+        ninflight = 1 + getRandomInt() % MAX_INFLIGHT;
+
+        for (index = 0; index < ninflight; index++) {
+            expected[index] = NULL;
+            wsizes[index] = -1;
+
+            if (getRandomInt() % 2) {
+                blkno = getRandomInt() % shared;
+                requests[index] = submit_read_aoram(c->astate, blkno);
+                expected[index] = strdup(c->strings[blkno]);
+                continue;
+            }
+
+            blkno = shared + c->id * nowned + getRandomInt() % nowned;
+
+            if (getRandomInt() % 2) {
+                wdata = gen_random(c->blockSize);
+                wsizes[index] = strlen(wdata) + 1;
+                requests[index] = submit_write_aoram(c->astate, wdata, wsizes[index], blkno);
+                free(c->strings[blkno]);
+                c->strings[blkno] = wdata;
+            } else {
+                requests[index] = submit_read_aoram(c->astate, blkno);
+                if (c->strings[blkno] != NULL) {
+                    expected[index] = strdup(c->strings[blkno]);
+                }
+            }
+        }
+
+        /* The first request is polled and the others waited for */
+        while (!poll_aoram(requests[0])) {
+            sched_yield();
+        }
+
+        for (index = 0; index < ninflight; index++) {
+            data = NULL;
+            result = wait_aoram(requests[index], &data);
+
+            if (wsizes[index] >= 0) {
+                c->failed |= result != wsizes[index];
+            } else {
+                c->failed |= check(result, data, expected[index]);
+            }
+            free(data);
+            free(expected[index]);
+        }
+    }
+
+    return NULL;
+}
+
+
+int test(size_t nblocks, size_t blockSize, size_t bucketCapcity, size_t nrounds) {
+
+    int failed = 0;
+
+    AMStash *stash;
+    AMPMap *pmap;
+    AMOFile *ofile;
+    ORAMState state;
+    AORAMState astate;
+
+    stash = stashCreate();
+    pmap = pmapCreate();
+    ofile = ofileCreate();
+
+    Amgr amgr;
+    amgr.am_stash = stash;
+    amgr.am_pmap = pmap;
+    amgr.am_ofile = ofile;
+
+    int index = 0;
+    int result = 0;
+    char *data = NULL;
+
+    pthread_t threads[NTHREADS];
+    Client clients[NTHREADS];
+
+    char **strings = (char **) malloc(sizeof(char *) * nblocks);
+
+    for (index = 0; index < nblocks; index++) {
+        strings[index] = NULL;
+    }
+
+    state = init_oram("teste", nblocks, blockSize, bucketCapcity, &amgr, NULL);
+
+    for (index = 0; index < nblocks / 2; index++) {
+        strings[index] = gen_random(blockSize);
+        write_oram(strings[index], strlen(strings[index]) + 1, index, state, NULL);
+    }
+
+    astate = init_aoram(state, NULL);
+
+    for (index = 0; index < NTHREADS; index++) {
+        clients[index].astate = astate;
+        clients[index].id = index;
+        clients[index].nblocks = nblocks;
+        clients[index].blockSize = blockSize;
+        clients[index].nrounds = nrounds;
+        clients[index].strings = strings;
+        clients[index].failed = 0;
+        pthread_create(&threads[index], NULL, client, &clients[index]);
+    }
+
+    for (index = 0; index < NTHREADS; index++) {
+        pthread_join(threads[index], NULL);
+        failed |= clients[index].failed;
+    }
+
+    close_aoram(astate);
+
+    /* The blocks written through the front-end are in the ORAM */
+    for (index = 0; index < nblocks && !failed; index++) {
+        result = read_oram(&data, index, state, NULL);
+        failed |= check(result, data, strings[index]);
+        free(data);
+    }
+
+    close_oram(state, NULL);
+
+    for (index = 0; index < nblocks; index++) {
+        free(strings[index]);
+    }
+    free(strings);
+
+    return failed;
+}
+
+int main(int argc, char *argv[]) {
+    size_t nblocks = 200;
+    size_t blockSize = 20; // bytes
+    size_t bucketCapcity = 4; // nblocks
+    size_t nrounds = 500;
+
+    int n_loops = 5;
+    int i;
+    int result = 0;
+    for (i = 0; i < n_loops; i++) {
+        result |= test(nblocks, blockSize, bucketCapcity, nrounds);
+    }
+    return result;
+}
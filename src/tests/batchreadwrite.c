@@ -0,0 +1,146 @@
+
+#include "oram/oram.h"
+#include "oram/orandom.h"
+#include "oram/plblock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+char *gen_random(const int len) {
+    int i = 0;
+    char *s = (char *) malloc(sizeof(char) * len);
+
+    static const char alphanum[] =
+            "0123456789"
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+            "abcdefghijklmnopqrstuvwxyz";
+
+    for (i = 0; i < len - 1; ++i) {
+        s[i] = alphanum[getRandomInt() % (sizeof(alphanum) - 1)];
+    }
+
+    s[len - 1] = '\0';
+    return s;
+}
+
+
+int check(int result, char *data, char *expected) {
+    if (result == DUMMY_BLOCK) {
+        return expected != NULL;
+    }
+    return result != strlen(data) + 1 || strcmp(data, expected) != 0;
+}
+
+
+int test(size_t nblocks, size_t blockSize, size_t bucketCapcity, 
+         size_t nbatches, size_t batchSize) {
+
+    int failed = 0;
+    size_t wOffset = 0;
+
+    AMStash *stash;
+    AMPMap *pmap;
+    AMOFile *ofile;
+    ORAMState state;
+
+    stash = stashCreate();
+    pmap = pmapCreate();
+    ofile = ofileCreate();
+
+    Amgr amgr;
+    amgr.am_stash = stash;
+    amgr.am_pmap = pmap;
+    amgr.am_ofile = ofile;
+
+    int index = 0;
+    int batch = 0;
+    int readi = 0;
+    char *data = NULL;
+    int result = 0;
+
+    char **strings = (char **) malloc(sizeof(char *) * nblocks);
+    char **wdata = (char **) malloc(sizeof(char *) * batchSize);
+    char **rdata = (char **) malloc(sizeof(char *) * nblocks);
+    int *results = (int *) malloc(sizeof(int) * nblocks);
+    unsigned int *sizes = (unsigned int *) malloc(sizeof(unsigned int) * batchSize);
+    BlockNumber *blknos = (BlockNumber *) malloc(sizeof(BlockNumber) * nblocks);
+
+    for (index = 0; index < nblocks; index++) {
+        strings[index] = NULL;
+    }
+
+    state = init_oram("teste", nblocks, blockSize, bucketCapcity, &amgr, NULL);
+#ifdef OFILE_EXT
+    setOFileExt(state, ofileExtCreate());
+#endif
+
+    for (batch = 0; batch < nbatches && !failed; batch++) {
+
+        /* Random batch of writes that may hit the same block twice. */
+        for (index = 0; index < batchSize; index++) {
+            wOffset = (getRandomInt() % nblocks);
+            wdata[index] = gen_random(blockSize);
+            sizes[index] = strlen(wdata[index]) + 1;
+            blknos[index] = wOffset;
+        }
+
+        write_oram_batch(wdata, sizes, results, blknos, batchSize, state, NULL);
+
+        /* The last write to a block is the one that prevails. */
+        for (index = 0; index < batchSize; index++) {
+            failed |= results[index] != (int) sizes[index];
+            free(strings[blknos[index]]);
+            strings[blknos[index]] = wdata[index];
+        }
+
+        /* Read every block back in a single batch. */
+        for (readi = 0; readi < nblocks; readi++) {
+            blknos[readi] = readi;
+        }
+
+        read_oram_batch(rdata, results, blknos, nblocks, state, NULL);
+
+        for (readi = 0; readi < nblocks; readi++) {
+            failed |= check(results[readi], rdata[readi], strings[readi]);
+            free(rdata[readi]);
+        }
+
+        /* Single requests must see the blocks evicted by the batches. */
+        for (readi = 0; readi < nblocks; readi++) {
+            result = read_oram(&data, readi, state, NULL);
+            failed |= check(result, data, strings[readi]);
+            free(data);
+        }
+    }
+
+    close_oram(state, NULL);
+
+    for (index = 0; index < nblocks; index++) {
+        free(strings[index]);
+    }
+    free(strings);
+    free(wdata);
+    free(rdata);
+    free(results);
+    free(sizes);
+    free(blknos);
+
+    return failed;
+}
+
+int main(int argc, char *argv[]) {
+    size_t nblocks = 200;
+    size_t blockSize = 20; // bytes
+    size_t bucketCapcity = 4; // nblocks
+    size_t nbatches = 20;
+    size_t batchSize = 32;
+
+    int n_loops = 10;
+    int i;
+    int result = 0;
+    for (i = 0; i < n_loops; i++) {
+        result |= test(nblocks, blockSize, bucketCapcity, nbatches, batchSize);
+    }
+    return result;
+}
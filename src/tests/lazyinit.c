@@ -0,0 +1,72 @@
+#include "oram/oram.h"
+#include "oram/orandom.h"
+#include "oram/plblock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * A tree too large to initialize eagerly in a test. Only the buckets and
+ * position map entries of the blocks accessed are ever materialized.
+ */
+#define NBLOCKS (1 << 22)
+#define NWRITES 256
+
+int main(int argc, char *argv[]) {
+
+    AMStash *stash;
+    AMPMap *pmap;
+    AMOFile *ofile;
+    ORAMState state;
+
+    stash = stashCreate();
+    pmap = pmapCreate();
+    ofile = ofileCreate();
+
+    Amgr amgr;
+    amgr.am_stash = stash;
+    amgr.am_pmap = pmap;
+    amgr.am_ofile = ofile;
+
+    size_t blockSize = 20;
+    size_t bucketCapcity = 4;
+
+    BlockNumber blknos[NWRITES];
+    char wdata[NWRITES][20];
+    char *data = NULL;
+    int failed = 0;
+    int result;
+    int index;
+
+    state = init_oram("teste", NBLOCKS, blockSize, bucketCapcity, &amgr, NULL);
+
+    /* Blocks never written are not found, whatever their initial leaf */
+    for (index = 0; index < NWRITES && !failed; index++) {
+        result = read_oram(&data, getRandomInt() % NBLOCKS, state, NULL);
+        failed |= result != DUMMY_BLOCK;
+        free(data);
+        data = NULL;
+    }
+
+    for (index = 0; index < NWRITES; index++) {
+        /* Distinct blocks, so that every write is read back as is */
+        blknos[index] = (BlockNumber) index * (NBLOCKS / NWRITES) + getRandomInt() % (NBLOCKS / NWRITES);
+        snprintf(wdata[index], blockSize, "block %u", (unsigned int) blknos[index]);
+        write_oram(wdata[index], strlen(wdata[index]) + 1, blknos[index], state, NULL);
+    }
+
+    for (index = 0; index < NWRITES && !failed; index++) {
+        result = read_oram(&data, blknos[index], state, NULL);
+        failed |= result == DUMMY_BLOCK || strcmp(data, wdata[index]) != 0;
+        free(data);
+        data = NULL;
+    }
+
+    close_oram(state, NULL);
+
+    if (failed) {
+        printf("Lazily initialized ORAM returned unexpected data\n");
+    }
+    return failed;
+}
@@ -0,0 +1,89 @@
+#include "oram/oram.h"
+#include "oram/orandom.h"
+#include "oram/plblock.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * Initializes an ORAM with the given bucket capacity and serves a few writes
+ * and reads of its blocks.
+ */
+int run(size_t nblocks, size_t blockSize, size_t bucketCapcity) {
+
+    AMStash *stash;
+    AMPMap *pmap;
+    AMOFile *ofile;
+    ORAMState state;
+    Amgr amgr;
+    char *data = NULL;
+    char block[32];
+    int index;
+
+    stash = stashCreate();
+    pmap = pmapCreate();
+    ofile = ofileCreate();
+
+    amgr.am_stash = stash;
+    amgr.am_pmap = pmap;
+    amgr.am_ofile = ofile;
+
+    state = init_oram("minbucket", nblocks, blockSize, bucketCapcity, &amgr, NULL);
+
+    for (index = 0; index < nblocks; index++) {
+        snprintf(block, sizeof(block), "block %d", index);
+        write_oram(block, strlen(block) + 1, index, state, NULL);
+    }
+
+    for (index = 0; index < nblocks; index++) {
+        snprintf(block, sizeof(block), "block %d", index);
+        read_oram(&data, index, state, NULL);
+        if (data == NULL || strcmp(data, block) != 0) {
+            return 1;
+        }
+        free(data);
+        data = NULL;
+    }
+
+    close_oram(state, NULL);
+    return 0;
+}
+
+/*
+ * Runs the test in a child process and returns 0 if it terminated as
+ * expected: aborted by init_oram if the bucket capacity is refused, normally
+ * otherwise.
+ */
+int test(size_t bucketCapcity, int refused) {
+    pid_t pid;
+    int status;
+
+    fflush(stdout);
+    pid = fork();
+
+    if (pid == 0) {
+        exit(run(100, 32, bucketCapcity));
+    }
+
+    if (pid < 0 || waitpid(pid, &status, 0) != pid) {
+        return 1;
+    }
+
+    if (!refused) {
+        return !(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    return !(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+}
+
+int main(int argc, char *argv[]) {
+    int result = 0;
+
+    result |= test(1, 1);
+    result |= test(2, 0);
+
+    return result;
+}
@@ -4,6 +4,11 @@
 #include <stdio.h>
 #include <string.h>
 
+/* Circuit ORAM needs at least two slots per bucket, see init_oram */
+#ifndef BUCKET_CAPACITY
+#define BUCKET_CAPACITY 1
+#endif
+
 int
 main(int argc, char *argv[])
 {
@@ -29,7 +34,7 @@ main(int argc, char *argv[])
 	size_t		blockSize = 20;
 
 	//block size of 20 bytes;
-	size_t		bucketCapcity = 1;
+	size_t		bucketCapcity = BUCKET_CAPACITY;
 
 	//1 bucket per tree node;
 	int			result = 0;
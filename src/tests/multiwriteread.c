@@ -5,6 +5,11 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* Circuit ORAM needs at least two slots per bucket, see init_oram */
+#ifndef BUCKET_CAPACITY
+#define BUCKET_CAPACITY 1
+#endif
+
 char *
 gen_random(const int len)
 {
@@ -49,7 +54,7 @@ main(int argc, char *argv[])
 	size_t		blockSize = 25;
 
 	//block size of 20 bytes;
-	size_t		bucketCapcity = 1;
+	size_t		bucketCapcity = BUCKET_CAPACITY;
 
 	//1 bucket per tree node;
 	int			result = 0;
@@ -62,6 +67,9 @@ main(int argc, char *argv[])
 	char	  **strings = (char **) malloc(sizeof(char *) * nblocks);
 
 	state = init_oram("teste", 100, blockSize, bucketCapcity, &amgr, NULL);
+#ifdef OFILE_EXT
+	setOFileExt(state, ofileExtCreate());
+#endif
 	/* printf("Going to write strings\n"); */
 
 	for (index = 0; index < nblocks; index++)
@@ -61,6 +61,9 @@ main(int argc, char *argv[])
 	char	  **strings = (char **) malloc(sizeof(char *) * nblocks);
 
 	state = init_oram("teste", 200, blockSize, bucketCapcity, &amgr, NULL);
+#ifdef OFILE_EXT
+	setOFileExt(state, ofileExtCreate());
+#endif
 	/* printf("Going to write strings\n"); */
 
 	for (index = 0; index < nblocks; index++)
@@ -0,0 +1,117 @@
+#include "oram/orandom.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define NVALUES (1 << 16)
+
+/*
+ * Draws values mixing single draws with bulk draws of several sizes, so that
+ * bulk draws start at every position of the generator's buffer.
+ */
+void draw(unsigned int *values, size_t nvalues) {
+    size_t drawn = 0;
+    size_t count = 1;
+
+    while (drawn < nvalues) {
+        values[drawn++] = getRandomInt();
+        count = count * 7 % 1031;
+        if (count > nvalues - drawn) {
+            count = nvalues - drawn;
+        }
+        getRandomInts(values + drawn, count);
+        drawn += count;
+    }
+}
+
+/* Every bit should be set in about half of the values */
+int testBits(const unsigned int *values, size_t nvalues) {
+    size_t ones[32] = {0};
+    size_t i;
+    int bit;
+
+    for (i = 0; i < nvalues; i++) {
+        for (bit = 0; bit < 32; bit++) {
+            ones[bit] += (values[i] >> bit) & 1;
+        }
+    }
+
+    for (bit = 0; bit < 32; bit++) {
+        if (ones[bit] < nvalues * 45 / 100 || ones[bit] > nvalues * 55 / 100) {
+            printf("bit %d set in %zu of %zu values\n", bit, ones[bit], nvalues);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* The leaves of a tree of height 10 should all be drawn about as often */
+int testLeaves(const unsigned int *values, size_t nvalues) {
+    size_t counts[1024] = {0};
+    size_t expected = nvalues / 1024;
+    size_t i;
+
+    for (i = 0; i < nvalues; i++) {
+        counts[values[i] & 1023]++;
+    }
+
+    for (i = 0; i < 1024; i++) {
+        if (counts[i] < expected / 2 || counts[i] > expected * 2) {
+            printf("leaf %zu drawn %zu times\n", i, counts[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* A forked child must not repeat the values drawn by its parent */
+int testFork(void) {
+    unsigned int parent[64];
+    unsigned int child[64];
+    int fds[2];
+    pid_t pid;
+    int status;
+
+    getRandomInt();
+
+    if (pipe(fds) != 0) {
+        return 1;
+    }
+
+    fflush(stdout);
+    pid = fork();
+
+    if (pid == 0) {
+        getRandomInts(child, 64);
+        exit(write(fds[1], child, sizeof(child)) != sizeof(child));
+    }
+
+    getRandomInts(parent, 64);
+
+    if (pid < 0 || read(fds[0], child, sizeof(child)) != sizeof(child)
+        || waitpid(pid, &status, 0) != pid) {
+        return 1;
+    }
+
+    close(fds[0]);
+    close(fds[1]);
+
+    return memcmp(parent, child, sizeof(parent)) == 0;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned int *values = (unsigned int *) malloc(sizeof(unsigned int) * NVALUES);
+    int result = 0;
+
+    draw(values, NVALUES);
+
+    result |= testBits(values, NVALUES);
+    result |= testLeaves(values, NVALUES);
+    result |= testFork();
+
+    free(values);
+    return result;
+}
@@ -6,6 +6,11 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* Circuit ORAM needs at least two slots per bucket, see init_oram */
+#ifndef BUCKET_CAPACITY
+#define BUCKET_CAPACITY 1
+#endif
+
 char *gen_random(const int len) {
     int i = 0;
     char *s = (char *) malloc(sizeof(char) * len);
@@ -56,6 +61,9 @@ int test(size_t nblocks, size_t blockSize, size_t bucketCapcity, size_t nwrites)
     }
 
     state = init_oram("teste", nblocks, blockSize, bucketCapcity, &amgr, NULL);
+#ifdef OFILE_EXT
+    setOFileExt(state, ofileExtCreate());
+#endif
     //printf("Going to write strings\n");
 
     for (index = 0; index < nwrites; index++) {
@@ -104,7 +112,7 @@ int test(size_t nblocks, size_t blockSize, size_t bucketCapcity, size_t nwrites)
 int main(int argc, char *argv[]) {
     size_t nblocks = 500; //bytes
     size_t blockSize = 20; // bytes
-    size_t bucketCapcity = 1; // nblocks
+    size_t bucketCapcity = BUCKET_CAPACITY; // slots per tree node
     size_t nwrites = 20;
 
     int n_loops = 100;
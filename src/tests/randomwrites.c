@@ -5,6 +5,11 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* Circuit ORAM needs at least two slots per bucket, see init_oram */
+#ifndef BUCKET_CAPACITY
+#define BUCKET_CAPACITY 1
+#endif
+
 char *gen_random(const int len) {
     int i = 0;
     char *s = (char *) malloc(sizeof(char) * len);
@@ -100,7 +105,7 @@ int test(size_t nblocks, size_t blockSize, size_t bucketCapcity, size_t nwrites)
 int main(int argc, char *argv[]) {
     size_t nblocks = 100; //bytes
     size_t blockSize = 20; // bytes
-    size_t bucketCapcity = 1; // nblocks
+    size_t bucketCapcity = BUCKET_CAPACITY; // slots per tree node
     size_t nwrites = 50;
 
     int n_loops = 100;
@@ -0,0 +1,146 @@
+#include "oram/poram.h"
+#include "oram/orandom.h"
+#include "oram/plblock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_PENDING 8
+
+char *gen_random(const int len) {
+    int i = 0;
+    char *s = (char *) malloc(sizeof(char) * len);
+
+    static const char alphanum[] =
+            "0123456789"
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+            "abcdefghijklmnopqrstuvwxyz";
+
+    for (i = 0; i < len - 1; ++i) {
+        s[i] = alphanum[getRandomInt() % (sizeof(alphanum) - 1)];
+    }
+
+    s[len - 1] = '\0';
+    return s;
+}
+
+
+int check(int result, char *data, char *expected) {
+    if (result == DUMMY_BLOCK) {
+        return expected != NULL;
+    }
+    return result != strlen(data) + 1 || strcmp(data, expected) != 0;
+}
+
+
+int test(size_t nblocks, size_t blockSize, size_t bucketCapcity, size_t nrounds) {
+
+    int failed = 0;
+
+    AMStash *stash;
+    AMPMap *pmap;
+    AMOFile *ofile;
+    ORAMState state;
+
+    stash = stashCreate();
+    pmap = pmapCreate();
+    ofile = ofileCreate();
+
+    Amgr amgr;
+    amgr.am_stash = stash;
+    amgr.am_pmap = pmap;
+    amgr.am_ofile = ofile;
+
+    int index = 0;
+    int round = 0;
+    int npending = 0;
+    int result = 0;
+    char *data = NULL;
+    char *wdata = NULL;
+    BlockNumber pending[MAX_PENDING];
+
+    char **strings = (char **) malloc(sizeof(char *) * nblocks);
+
+    for (index = 0; index < nblocks; index++) {
+        strings[index] = NULL;
+    }
+
+    state = init_oram("teste", nblocks, blockSize, bucketCapcity, &amgr, NULL);
+#ifdef OFILE_EXT
+    setOFileExt(state, ofileExtCreate());
+#endif
+
+    /* Half of the blocks are written before the first round. */
+    for (index = 0; index < nblocks / 2; index++) {
+        strings[index] = gen_random(blockSize);
+        write_oram(strings[index], strlen(strings[index]) + 1, index, state, NULL);
+    }
+
+    for (round = 0; round < nrounds && !failed; round++) {
+
+        /* Several reads are served before any of them is evicted. */
+        npending = 1 + getRandomInt() % MAX_PENDING;
+
+        for (index = 0; index < npending; index++) {
+            pending[index] = getRandomInt() % nblocks;
+            result = read_poram(&data, pending[index], state, NULL);
+            failed |= check(result, data, strings[pending[index]]);
+            free(data);
+        }
+
+        /* Regular accesses overlap with the paths waiting for eviction. */
+        if (getRandomInt() % 2) {
+            index = getRandomInt() % nblocks;
+            wdata = gen_random(blockSize);
+            write_oram(wdata, strlen(wdata) + 1, index, state, NULL);
+            free(strings[index]);
+            strings[index] = wdata;
+        }
+
+        /*
+         * Evictions run in reverse order and half of them write a new
+         * version of the block read.
+         */
+        for (index = npending - 1; index >= 0; index--) {
+            if (getRandomInt() % 2) {
+                wdata = gen_random(blockSize);
+                evict_poram(wdata, strlen(wdata) + 1, pending[index], state, NULL);
+                free(strings[pending[index]]);
+                strings[pending[index]] = wdata;
+            } else {
+                evict_poram(NULL, DUMMY_BLOCK, pending[index], state, NULL);
+            }
+        }
+    }
+
+    for (index = 0; index < nblocks && !failed; index++) {
+        result = read_oram(&data, index, state, NULL);
+        failed |= check(result, data, strings[index]);
+        free(data);
+    }
+
+    close_oram(state, NULL);
+
+    for (index = 0; index < nblocks; index++) {
+        free(strings[index]);
+    }
+    free(strings);
+
+    return failed;
+}
+
+int main(int argc, char *argv[]) {
+    size_t nblocks = 200;
+    size_t blockSize = 20; // bytes
+    size_t bucketCapcity = 4; // nblocks
+    size_t nrounds = 500;
+
+    int n_loops = 10;
+    int i;
+    int result = 0;
+    for (i = 0; i < n_loops; i++) {
+        result |= test(nblocks, blockSize, bucketCapcity, nrounds);
+    }
+    return result;
+}
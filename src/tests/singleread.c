@@ -4,6 +4,11 @@
 #include <stdio.h>
 #include <string.h>
 
+/* Circuit ORAM needs at least two slots per bucket, see init_oram */
+#ifndef BUCKET_CAPACITY
+#define BUCKET_CAPACITY 1
+#endif
+
 int main(int argc, char *argv[]) {
 
     AMStash *stash;
@@ -22,7 +27,7 @@ int main(int argc, char *argv[]) {
 
     size_t fileSize = 300;// file with 100 bytes;
     size_t blockSize = 20;// block size of 20 bytes;
-    size_t bucketCapcity = 1; // 1 bucket per tree node;
+    size_t bucketCapcity = BUCKET_CAPACITY; // slots per tree node
 
     int result = 0;
     char *data = NULL;
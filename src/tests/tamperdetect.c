@@ -0,0 +1,132 @@
+#include "oram/poram.h"
+#include "oram/orandom.h"
+#include "oram/plblock.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define NO_TAMPERING 0
+#define FLIP_PAYLOAD 1
+#define DROP_BLOCK 2
+
+/*
+ * The oblivious file of the test is wrapped so that, once tampering starts,
+ * the first real block returned by a path read is modified as a malicious
+ * storage host would.
+ */
+static ofilereadpath_function readPath;
+static int mode = NO_TAMPERING;
+static int tampering = 0;
+
+void tamperedReadPath(FileHandler handler, PLBList blocks, const char *fileName,
+                      const BlockNumber *ob_blknos, unsigned int nblocks,
+                      void *appData) {
+    unsigned int index;
+
+    readPath(handler, blocks, fileName, ob_blknos, nblocks, appData);
+
+    if (!tampering) {
+        return;
+    }
+
+    for (index = 0; index < nblocks; index++) {
+        if (blocks[index]->blkno == DUMMY_BLOCK) {
+            continue;
+        }
+        if (mode == FLIP_PAYLOAD) {
+            ((char *) blocks[index]->block)[0] ^= 1;
+        } else {
+            blocks[index]->blkno = DUMMY_BLOCK;
+        }
+        return;
+    }
+}
+
+int run(size_t nblocks, size_t blockSize, size_t bucketCapcity) {
+
+    AMStash *stash;
+    AMPMap *pmap;
+    AMOFile *ofile;
+    AMOFileExt *ext;
+    ORAMState state;
+    Amgr amgr;
+    char *data = NULL;
+    char block[64];
+    int index;
+
+    stash = stashCreate();
+    pmap = pmapCreate();
+    ofile = ofileCreate();
+
+    amgr.am_stash = stash;
+    amgr.am_pmap = pmap;
+    amgr.am_ofile = ofile;
+
+    state = init_oram("tamper", nblocks, blockSize, bucketCapcity, &amgr, NULL);
+
+    ext = ofileExtCreate();
+    readPath = ext->ofilereadpath;
+    ext->ofilereadpath = &tamperedReadPath;
+    setOFileExt(state, ext);
+
+    for (index = 0; index < nblocks; index++) {
+        snprintf(block, sizeof(block), "block %d", index);
+        write_oram(block, strlen(block) + 1, index, state, NULL);
+    }
+
+    tampering = mode != NO_TAMPERING;
+
+    for (index = 0; index < nblocks; index++) {
+        snprintf(block, sizeof(block), "block %d", index);
+        read_oram(&data, index, state, NULL);
+        if (data == NULL || strcmp(data, block) != 0) {
+            return 1;
+        }
+        free(data);
+        data = NULL;
+    }
+
+    close_oram(state, NULL);
+    return 0;
+}
+
+/*
+ * Runs the test in a child process and returns 0 if it terminated as
+ * expected: normally without tampering, aborted by the integrity checks
+ * otherwise.
+ */
+int test(int tamperMode) {
+    pid_t pid;
+    int status;
+
+    fflush(stdout);
+    pid = fork();
+
+    if (pid == 0) {
+        mode = tamperMode;
+        exit(run(100, 32, 4));
+    }
+
+    if (pid < 0 || waitpid(pid, &status, 0) != pid) {
+        return 1;
+    }
+
+    if (tamperMode == NO_TAMPERING) {
+        return !(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    return !(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+}
+
+int main(int argc, char *argv[]) {
+    int result = 0;
+
+    result |= test(NO_TAMPERING);
+    result |= test(FLIP_PAYLOAD);
+    result |= test(DROP_BLOCK);
+
+    return result;
+}
@@ -0,0 +1,226 @@
+#include "oram/oram.h"
+#include "oram/orandom.h"
+#include "oram/plblock.h"
+#include "oram/coram.h"
+
+#ifdef FOREST_ORAM
+#include "oram/pmapdefs/fdeforam.h"
+#else
+#include "oram/pmapdefs/pdeforam.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TOKEN_SIZE 4
+
+/* Tokens below the number of leaves of the test trees are leaves as is */
+#define TOKEN_LEAVES 4
+
+/*
+ * The position map of the test is wrapped to check that the leaf chosen
+ * after each update is the next leaf of the token queued for that access.
+ */
+static pmget_function pmapGet;
+static pmupdate_function pmapUpdate;
+static const unsigned int *expected;
+static unsigned int nexpected;
+static unsigned int updated = 0;
+static int mismatch = 0;
+
+Location checkedGet(PMap pmap, const char *fileName, const BlockNumber blkno) {
+    Location location = pmapGet(pmap, fileName, blkno);
+
+    if (updated) {
+        if (nexpected == 0 || location->leaf != expected[1]) {
+            mismatch = 1;
+        } else {
+            expected += TOKEN_SIZE;
+            nexpected--;
+        }
+        updated = 0;
+    }
+    return location;
+}
+
+void checkedUpdate(PMap pmap, const char *fileName, const BlockNumber blkno) {
+    pmapUpdate(pmap, fileName, blkno);
+    updated = 1;
+}
+
+void queue_tokens(ORAMState state, const unsigned int *tokens, unsigned int ntokens) {
+    expected = tokens;
+    nexpected = ntokens;
+    setTokens(state, tokens, ntokens);
+}
+
+char *gen_random(const int len) {
+    int i = 0;
+    char *s = (char *) malloc(sizeof(char) * len);
+
+    static const char alphanum[] =
+            "0123456789"
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+            "abcdefghijklmnopqrstuvwxyz";
+
+    for (i = 0; i < len - 1; ++i) {
+        s[i] = alphanum[getRandomInt() % (sizeof(alphanum) - 1)];
+    }
+
+    s[len - 1] = '\0';
+    return s;
+}
+
+/*
+ * Fills the token of every request with the current location of its block
+ * and a fresh next location, which becomes the current one. Requests are
+ * served in order, so a block requested twice uses the location left by its
+ * previous request.
+ */
+void make_tokens(unsigned int *tokens, const BlockNumber *blknos,
+                 unsigned int nrequests, unsigned int *leafs,
+                 unsigned int *partitions) {
+    unsigned int index;
+    unsigned int *token;
+
+    for (index = 0; index < nrequests; index++) {
+        token = tokens + index * TOKEN_SIZE;
+        token[0] = leafs[blknos[index]];
+        token[1] = getRandomInt() % TOKEN_LEAVES;
+        token[2] = partitions[blknos[index]];
+        token[3] = getRandomInt();
+        leafs[blknos[index]] = token[1];
+        partitions[blknos[index]] = token[3];
+    }
+}
+
+int test(size_t nblocks, size_t blockSize, size_t bucketCapcity,
+         size_t nbatches, size_t batchSize) {
+
+    AMStash *stash;
+    AMPMap *pmap;
+    AMOFile *ofile;
+    ORAMState state;
+    Amgr amgr;
+
+    unsigned int *leafs = (unsigned int *) malloc(sizeof(unsigned int) * nblocks);
+    unsigned int *partitions = (unsigned int *) malloc(sizeof(unsigned int) * nblocks);
+    unsigned int *tokens = (unsigned int *) malloc(sizeof(unsigned int) * TOKEN_SIZE * nblocks);
+    char **strings = (char **) malloc(sizeof(char *) * nblocks);
+    char **wdata = (char **) malloc(sizeof(char *) * batchSize);
+    char **rdata = (char **) malloc(sizeof(char *) * nblocks);
+    int *results = (int *) malloc(sizeof(int) * nblocks);
+    unsigned int *sizes = (unsigned int *) malloc(sizeof(unsigned int) * batchSize);
+    BlockNumber *blknos = (BlockNumber *) malloc(sizeof(BlockNumber) * nblocks);
+    size_t index;
+    size_t batch;
+    size_t readi;
+    int failed = 0;
+    char *data = NULL;
+    int result;
+
+    stash = stashCreate();
+    pmap = pmapCreate();
+    ofile = ofileCreate();
+
+    pmapGet = pmap->pmget;
+    pmapUpdate = pmap->pmupdate;
+    pmap->pmget = &checkedGet;
+    pmap->pmupdate = &checkedUpdate;
+
+    amgr.am_stash = stash;
+    amgr.am_pmap = pmap;
+    amgr.am_ofile = ofile;
+
+    for (index = 0; index < nblocks; index++) {
+        strings[index] = NULL;
+        leafs[index] = getRandomInt() % TOKEN_LEAVES;
+        partitions[index] = getRandomInt();
+    }
+
+    state = init_oram("teste", nblocks, blockSize, bucketCapcity, &amgr, NULL);
+    setPMapExt(state, pmapExtCreate());
+
+    for (batch = 0; batch < nbatches && !failed; batch++) {
+
+        /* Random batch of writes that may hit the same block twice. */
+        for (index = 0; index < batchSize; index++) {
+            blknos[index] = getRandomInt() % nblocks;
+            wdata[index] = gen_random(blockSize);
+            sizes[index] = strlen(wdata[index]) + 1;
+        }
+
+        make_tokens(tokens, blknos, batchSize, leafs, partitions);
+        queue_tokens(state, tokens, batchSize);
+        write_oram_batch(wdata, sizes, results, blknos, batchSize, state, NULL);
+
+        for (index = 0; index < batchSize; index++) {
+            free(strings[blknos[index]]);
+            strings[blknos[index]] = wdata[index];
+        }
+
+        /* Every block read back in one batch */
+        for (readi = 0; readi < nblocks; readi++) {
+            blknos[readi] = readi;
+        }
+
+        make_tokens(tokens, blknos, nblocks, leafs, partitions);
+        queue_tokens(state, tokens, nblocks);
+        read_oram_batch(rdata, results, blknos, nblocks, state, NULL);
+
+        for (readi = 0; readi < nblocks; readi++) {
+            if (strings[readi] != NULL && (results[readi] == DUMMY_BLOCK
+                || strcmp(rdata[readi], strings[readi]) != 0)) {
+                failed = 1;
+            }
+            free(rdata[readi]);
+        }
+    }
+
+    /* Tokens queued for single accesses are consumed in order as well */
+    for (readi = 0; readi < nblocks; readi++) {
+        blknos[readi] = readi;
+    }
+
+    make_tokens(tokens, blknos, nblocks, leafs, partitions);
+    queue_tokens(state, tokens, nblocks);
+
+    for (readi = 0; readi < nblocks && !failed; readi++) {
+        result = read_oram(&data, readi, state, NULL);
+        if (strings[readi] != NULL && (result == DUMMY_BLOCK
+            || strcmp(data, strings[readi]) != 0)) {
+            failed = 1;
+        }
+        free(data);
+    }
+
+    failed |= mismatch || nexpected != 0;
+
+    close_oram(state, NULL);
+
+    for (index = 0; index < nblocks; index++) {
+        free(strings[index]);
+    }
+    free(strings);
+    free(wdata);
+    free(rdata);
+    free(results);
+    free(sizes);
+    free(blknos);
+    free(tokens);
+    free(partitions);
+    free(leafs);
+
+    return failed;
+}
+
+int main(int argc, char *argv[]) {
+    size_t nblocks = 200;
+    size_t blockSize = 20;
+    size_t bucketCapcity = 4;
+    size_t nbatches = 10;
+    size_t batchSize = 16;
+
+    return test(nblocks, blockSize, bucketCapcity, nbatches, batchSize);
+}